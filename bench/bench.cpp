@@ -0,0 +1,282 @@
+// Phase level benchmarks: lexing, expression parsing, template parsing, the
+// tree walk and the line trim pass, each timed on its own. Results are
+// printed as JSON so runs can be compared across versions.
+//
+// usage: prism_bench [--example <file>] [--min-time <seconds>] [--out <file>]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <optional>
+#include <functional>
+
+#include "prism/processor.h"
+#include "prism/render.h"
+#include "prism/sink.h"
+
+namespace {
+// Counts what goes through without keeping it
+class CountingSink : public prism::OutputSink {
+  public:
+    void write(const char*, size_t size) override {
+        bytes += size;
+    }
+    size_t bytes = 0;
+};
+
+struct Result {
+    std::string input;
+    std::string phase;
+    size_t iterations = 0;
+    double seconds = 0.0;
+    // Bytes consumed or produced by one iteration
+    size_t bytes = 0;
+};
+
+double g_min_time = 0.25;
+std::string g_include_root;
+
+// Runs `body` until g_min_time has passed, at least 3 times
+Result measure(const std::string& input, const std::string& phase, size_t bytes, const std::function<void()>& body) {
+    using clock = std::chrono::steady_clock;
+    body(); // warm up
+    Result result{ input, phase, 0, 0.0, bytes };
+    auto start = clock::now();
+    do {
+        body();
+        result.iterations++;
+        result.seconds = std::chrono::duration<double>(clock::now() - start).count();
+    } while (result.seconds < g_min_time || result.iterations < 3);
+    return result;
+}
+
+std::optional<std::string> read_file(const std::string& path) {
+    std::ifstream input(path);
+    if (!input.is_open()) {
+        return std::nullopt;
+    }
+    std::stringstream ss;
+    ss << input.rdbuf();
+    return ss.str();
+}
+
+// The example includes files relative to the build directory, retry relative to the example itself
+std::optional<std::string> include_file(const std::string& path) {
+    auto data = read_file(path);
+    if (!data.has_value() && !g_include_root.empty()) {
+        data = read_file(g_include_root + "/" + path);
+    }
+    return data;
+}
+
+// Text of every @{...} and of the condition of every @if/@elseif/@for
+std::vector<std::string> collect_expressions(const std::string& source) {
+    std::vector<std::string> out;
+    for (size_t i = 0; i < source.size(); i++) {
+        if (source[i] != '@') {
+            continue;
+        }
+        auto open = source.find_first_of("{(", i);
+        if (open == std::string::npos) {
+            break;
+        }
+        auto keyword = source.substr(i + 1, open - i - 1);
+        if (!(source[open] == '{' && keyword.empty()) && keyword != "if" && keyword != "elseif" && keyword != "for") {
+            continue;
+        }
+        char opening = source[open];
+        char closing = opening == '{' ? '}' : ')';
+        int depth = 0;
+        for (size_t j = open; j < source.size(); j++) {
+            if (source[j] == opening) {
+                depth++;
+            } else if (source[j] == closing && --depth == 0) {
+                auto inner = source.substr(open + 1, j - open - 1);
+                out.push_back(opening == '{' ? inner : "(" + inner + ")");
+                i = j;
+                break;
+            }
+        }
+    }
+    return out;
+}
+
+// `lines` lines of shader text nested in `depth` loops, `density` percent of
+// them carrying directives
+std::string synthesize(int depth, int density, int lines) {
+    std::string out = "@prism(type='fragment', name='bench', version='1.0.0', description='synthetic', "
+                      "author='prism')\n\n";
+    for (int d = 0; d < depth; d++) {
+        out += "@for(i" + std::to_string(d) + " in 0..2)\n";
+    }
+    for (int line = 0; line < lines; line++) {
+        if (line * 37 % 100 >= density) {
+            out += "    vec4 color" + std::to_string(line) + " = texture(uTex, vTexCoord) * 0.5;\n";
+            continue;
+        }
+        switch (line % 3) {
+            case 0:
+                out += "    float v" + std::to_string(line) + " = @{a + b * 2};\n";
+                break;
+            case 1:
+                out += "    @{texture}(uTex, vTexCoord + vec2(@{b}, @{a - 1}));\n";
+                break;
+            default:
+                out += "    @if(flag == 1)\n    on = @{a};\n    @elseif(a == 2)\n    two;\n    @else\n    off;\n    @end\n";
+                break;
+        }
+    }
+    for (int d = 0; d < depth; d++) {
+        out += "@end\n";
+    }
+    return out;
+}
+
+prism::ContextItems synthetic_context() {
+    return {
+        { "a", prism::ContextTypes{ 3 } },
+        { "b", prism::ContextTypes{ 1.5f } },
+        { "flag", prism::ContextTypes{ 1 } },
+        { "texture", prism::ContextTypes{ std::string("texture2D") } },
+    };
+}
+
+void bench_frontend(const std::string& name, const std::string& source, std::vector<Result>& results) {
+    auto expressions = collect_expressions(source);
+    size_t exprBytes = 0;
+    std::vector<std::vector<prism::lexer::Token>> tokens;
+    for (const auto& expr : expressions) {
+        exprBytes += expr.size();
+        tokens.push_back(prism::lexer::Lexer(expr).tokenize());
+    }
+
+    results.push_back(measure(name, "lex", exprBytes, [&] {
+        for (const auto& expr : expressions) {
+            prism::lexer::Lexer lexer(expr);
+            auto list = lexer.tokenize();
+            if (list.empty()) {
+                std::abort();
+            }
+        }
+    }));
+    results.push_back(measure(name, "parse_expr", exprBytes, [&] {
+        prism::ast::Arena arena;
+        for (const auto& list : tokens) {
+            prism::ast::Parser parser(list, arena);
+            parser.parse();
+        }
+    }));
+
+    prism::Processor processor;
+    processor.bind_include_loader(include_file);
+    auto body = std::string(processor.parse_header(source));
+    results.push_back(measure(name, "parse", body.size(), [&] { processor.compile(body); }));
+}
+
+void bench_backend(const std::string& name, const std::string& source, const prism::ContextItems& items,
+                   std::vector<Result>& results) {
+    prism::Processor processor;
+    processor.bind_include_loader(include_file);
+    processor.load(source);
+    prism::Renderer renderer(processor.compiled());
+
+    prism::RenderState state;
+    state.items = items;
+    prism::StringSink raw;
+    renderer.render_raw(state, raw);
+    auto untrimmed = std::move(raw.str());
+    auto trimmedSize = renderer.render(items).size();
+
+    results.push_back(measure(name, "evaluate", untrimmed.size(), [&] {
+        CountingSink sink;
+        renderer.render_raw(state, sink);
+    }));
+    results.push_back(measure(name, "trim", untrimmed.size(), [&] {
+        CountingSink sink;
+        prism::LineTrimSink trim(sink);
+        trim.write(untrimmed);
+        trim.flush();
+    }));
+    results.push_back(measure(name, "render", trimmedSize, [&] {
+        CountingSink sink;
+        renderer.render(state, sink);
+    }));
+}
+
+void write_json(std::ostream& out, const std::vector<Result>& results) {
+    out << "{\n  \"min_time\": " << g_min_time << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& r = results[i];
+        auto perOp = r.seconds / (double) r.iterations;
+        char line[512];
+        std::snprintf(line, sizeof(line),
+                      "    { \"input\": \"%s\", \"phase\": \"%s\", \"iterations\": %zu, \"ns_per_op\": %.1f, "
+                      "\"ops_per_s\": %.2f, \"bytes\": %zu, \"bytes_per_s\": %.0f }%s\n",
+                      r.input.c_str(), r.phase.c_str(), r.iterations, perOp * 1e9, 1.0 / perOp, r.bytes,
+                      (double) r.bytes / perOp, i + 1 < results.size() ? "," : "");
+        out << line;
+    }
+    out << "  ]\n}\n";
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string example = "../examples/script.opengl.fs";
+    std::string outPath;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--example" && i + 1 < argc) {
+            example = argv[++i];
+        } else if (arg == "--min-time" && i + 1 < argc) {
+            g_min_time = std::stod(argv[++i]);
+        } else if (arg == "--out" && i + 1 < argc) {
+            outPath = argv[++i];
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--example <file>] [--min-time <seconds>] [--out <file>]"
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<Result> results;
+    try {
+        struct Shape {
+            const char* name;
+            int depth, density, lines;
+        };
+        const Shape shapes[] = {
+            { "flat_sparse", 0, 10, 400 }, { "flat_dense", 0, 80, 400 },   { "nested_2", 2, 40, 200 },
+            { "nested_4", 4, 40, 50 },     { "large_output", 1, 30, 4000 },
+        };
+        for (const auto& shape : shapes) {
+            auto source = synthesize(shape.depth, shape.density, shape.lines);
+            bench_frontend(shape.name, source, results);
+            bench_backend(shape.name, source, synthetic_context(), results);
+        }
+
+        // The example needs the natives of its host to render, only its front end is measured
+        if (auto source = read_file(example); source.has_value()) {
+            auto slash = example.find_last_of("/\\");
+            g_include_root = slash == std::string::npos ? "." : example.substr(0, slash);
+            bench_frontend("script.opengl.fs", source.value(), results);
+        } else {
+            std::cerr << "Skipping missing example " << example << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Benchmark failed: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (outPath.empty()) {
+        write_json(std::cout, results);
+    } else {
+        std::ofstream out(outPath);
+        write_json(out, results);
+    }
+    return 0;
+}
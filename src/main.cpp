@@ -1,9 +1,18 @@
 #include "prism/processor.h"
+#include "prism/cache.h"
+#include "prism/native.h"
+#include "prism/profile.h"
+#include "prism/reload.h"
+#include "prism/store.h"
+#include "prism/utils/mapped_file.h"
+#include "prism/utils/trace.h"
 
 #ifdef PRISM_STANDALONE
 
 #include <spdlog/spdlog.h>
-#include <fstream>
+#include <chrono>
+#include <cstdio>
+#include <string_view>
 
 enum {
     SHADER_0,
@@ -23,12 +32,12 @@ enum {
     SHADER_NOISE
 };
 
-extern "C" prism::ContextTypes* add_text(prism::ContextItems* _, prism::ContextTypes* arg1, prism::ContextTypes* arg2, prism::ContextTypes* arg3) {
+std::string add_text() {
     std::string items = "";
     for (int i = 0; i < 3; i++) {
         items += "add";
     }
-    return new prism::ContextTypes{ items };
+    return items;
 }
 
 #define RAND_NOISE "((random(vec3(floor(gl_FragCoord.xy * noise_scale), float(frame_count))) + 1.0) / 2.0)"
@@ -108,32 +117,15 @@ static const char* shader_item_to_str(uint32_t item, bool with_alpha, bool only_
     return "";
 }
 
-bool get_bool(prism::ContextTypes* value) {
-    if (std::holds_alternative<int>(*value)) {
-        return std::get<int>(*value) == 1;
-    }
-    return false;
-}
-
-extern "C" prism::ContextTypes* append_formula(prism::ContextItems* items, prism::ContextTypes* a_arg, prism::ContextTypes* a_single,
-                                    prism::ContextTypes* a_mult, prism::ContextTypes* a_mix,
-                                    prism::ContextTypes* a_with_alpha, prism::ContextTypes* a_only_alpha,
-                                    prism::ContextTypes* a_alpha, prism::ContextTypes* a_first_cycle) {
-    if (!items->contains("local_var")) {
-        items->insert({"local_var", prism::ContextTypes{0}});
+std::string append_formula(prism::ContextItems& items, const prism::MTDArray<int>& c, bool do_single, bool do_multiply,
+                           bool do_mix, bool with_alpha, bool only_alpha, bool opt_alpha, bool first_cycle) {
+    if (!items.contains("local_var")) {
+        items.insert({"local_var", prism::ContextTypes{0}});
     }
     // increase local_var by 1
-    auto& local_var = std::get<int>(items->at("local_var"));
+    auto& local_var = std::get<int>(items.at("local_var"));
     local_var++;
     // uint8_t c[2][4] =
-    auto c = std::get<prism::MTDArray<int>>(*a_arg);
-    bool do_single = get_bool(a_single);
-    bool do_multiply = get_bool(a_mult);
-    bool do_mix = get_bool(a_mix);
-    bool with_alpha = get_bool(a_with_alpha);
-    bool only_alpha = get_bool(a_only_alpha);
-    bool opt_alpha = get_bool(a_alpha);
-    bool first_cycle = get_bool(a_first_cycle);
     std::string out = "";
     if (do_single) {
         out += shader_item_to_str(c.at(only_alpha, 3), with_alpha, only_alpha, opt_alpha, first_cycle, false);
@@ -159,20 +151,15 @@ extern "C" prism::ContextTypes* append_formula(prism::ContextItems* items, prism
         out += " + ";
         out += shader_item_to_str(c.at(only_alpha, 3), with_alpha, only_alpha, opt_alpha, first_cycle, false);
     }
-    return new prism::ContextTypes{ out };
+    return out;
 }
 
-std::optional<std::string> include_fs(const std::string& path){
-    std::ifstream input(path);
-    if (!input.is_open()) {
+std::shared_ptr<const prism::MappedFile> include_fs(const std::string& path){
+    auto file = prism::MappedFile::open(path);
+    if (file == nullptr) {
         SPDLOG_ERROR("Failed to open file: {}", path);
-        return std::nullopt;
     }
-
-    std::vector<uint8_t> data = std::vector<uint8_t>(std::istreambuf_iterator(input), {});
-    input.close();
-
-    return std::string(data.begin(), data.end());
+    return file;
 }
 
 std::string to_string(const prism::ContextTypes& value) {
@@ -193,20 +180,50 @@ std::string to_string(const prism::ContextTypes& value) {
 }
 
 int main(int argc, char** argv) {
-    if (argc < 2) {
-        SPDLOG_ERROR("Usage: {} <file>", argv[0]);
+    const char* path = nullptr;
+    const char* store = nullptr;
+    const char* trace = nullptr;
+    bool watch = false;
+    std::string_view profile;
+    auto mode = prism::OutputMode::Trim;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "--minify") {
+            mode = prism::OutputMode::Minify;
+        } else if (arg == "--watch") {
+            watch = true;
+        } else if (arg == "--profile" && i + 1 < argc && (argv[i + 1] == std::string_view("text") ||
+                                                          argv[i + 1] == std::string_view("json"))) {
+            profile = argv[++i];
+        } else if (arg == "--store" && i + 1 < argc) {
+            store = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            trace = argv[++i];
+        } else if (path == nullptr && !arg.starts_with("--")) {
+            path = argv[i];
+        } else {
+            path = nullptr;
+            break;
+        }
+    }
+    if (path == nullptr) {
+        SPDLOG_ERROR("Usage: {} <file> [--minify] [--store <dir>] [--watch] [--profile text|json] [--trace <file>]",
+                     argv[0]);
         return 1;
     }
+    if (trace != nullptr) {
+        if (!prism::trace::COMPILED) {
+            SPDLOG_WARN("Built without PRISM_TRACING, the trace will be empty");
+        }
+        prism::trace::start();
+    }
 
-    std::ifstream input(argv[1]);
-    if (!input.is_open()) {
-        SPDLOG_ERROR("Failed to open file: {}", argv[1]);
+    auto file = prism::MappedFile::open(path);
+    if (file == nullptr) {
+        SPDLOG_ERROR("Failed to open file: {}", path);
         return 1;
     }
 
-    std::vector<uint8_t> data = std::vector<uint8_t>(std::istreambuf_iterator(input), {});
-    input.close();
-
     int o_textures[2] = { 1, 1 };
     int o_clamp[2][2] = { { 1, 0 }, { 0, 1 } };
     float o_float[] = { 1.1f, 2.2f, 3.3f, 4.4f, 5.5f, 6.6f };
@@ -280,7 +297,7 @@ int main(int argc, char** argv) {
         { "vOutColor", "gl_Position" },
         { "o_current_filter", 0 },
         { "o_c", M_ARRAY(o_c, int, 2, 2, 4) },
-        { "add_text", (InvokeFunc) add_text },
+        { "add_text", prism::make_native(add_text) },
         { "o_color_alpha_same", M_ARRAY(o_color_alpha_same, int, 3) },
         { "FILTER_THREE_POINT", 3 },
         { "SHADER_0", SHADER_0 },
@@ -298,21 +315,74 @@ int main(int argc, char** argv) {
         { "SHADER_1", SHADER_1 },
         { "SHADER_COMBINED", SHADER_COMBINED },
         { "SHADER_NOISE", SHADER_NOISE },
-        { "append_formula", (InvokeFunc) append_formula },
+        { "append_formula", prism::make_native(append_formula) },
         { "o_do_single", M_ARRAY(o_do_single, int, 2, 2) },
         { "o_do_multiply", M_ARRAY(o_do_multiply, int, 2, 2) },
         { "o_do_mix", M_ARRAY(o_do_mix, int, 2, 2) },
         { "texture", "texture2d" }
     };
 
+    auto cache = std::make_shared<prism::OutputCache>();
     prism::Processor processor;
     processor.bind_include_loader(include_fs);
+    processor.bind_cache(cache);
+    processor.set_output_mode(mode);
+    if (store != nullptr) {
+        processor.bind_template_store(std::make_shared<prism::TemplateStore>(store));
+    }
+    // Include paths are resolved against the context while loading
     processor.populate(vars);
-    processor.load(std::string(data.begin(), data.end()));
-    SPDLOG_INFO("Processed data: \n{}", processor.process());
+    prism::HotReloader reloader(cache);
+    if (watch) {
+        reloader.add(processor, path);
+    } else {
+        processor.load(file);
+    }
+    auto output = processor.render(vars);
+    SPDLOG_INFO("Processed data: \n{}", output);
+    if (trace != nullptr) {
+        prism::trace::stop();
+        auto events = prism::trace::to_chrome_json();
+        auto out = std::fopen(trace, "wb");
+        if (out == nullptr || std::fwrite(events.data(), 1, events.size(), out) != events.size()) {
+            SPDLOG_ERROR("Failed to write trace: {}", trace);
+        }
+        if (out != nullptr) {
+            std::fclose(out);
+        }
+    }
+    if (!profile.empty()) {
+        auto profiler = std::make_shared<prism::Profiler>();
+        processor.bind_profiler(profiler);
+        processor.render(vars);
+        processor.bind_profiler(nullptr);
+        auto report = profile == "json" ? profiler->to_json() : profiler->to_text();
+        std::fwrite(report.data(), 1, report.size(), stdout);
+    }
+    [[maybe_unused]] auto stats = cache->stats();
+    SPDLOG_DEBUG("Cache: {} hits, {} misses, {} entries, {} bytes", stats.hits, stats.misses, stats.entries,
+                 stats.bytes);
+    // What the last render assigned, cached or not
     for (const auto& item : processor.getTypes()) {
         SPDLOG_INFO("{}: {}", item.first, to_string(item.second));
     }
+    if (watch) {
+        SPDLOG_INFO("Watching {} and its includes, press Ctrl+C to stop", path);
+        while (true) {
+            if (reloader.poll(std::chrono::seconds(1)).empty()) {
+                continue;
+            }
+            auto start = std::chrono::steady_clock::now();
+            try {
+                output = processor.render(vars);
+            } catch (const std::exception& e) {
+                SPDLOG_ERROR("Render failed: {}", e.what());
+                continue;
+            }
+            auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+            SPDLOG_INFO("Reloaded, rendered in {:.2f} ms: \n{}", elapsed.count(), output);
+        }
+    }
     return 0;
 }
 #endif
\ No newline at end of file
@@ -3,196 +3,229 @@
 
 #define is_type(var, type) std::holds_alternative<type>((var))
 
-std::shared_ptr<prism::ast::ASTNode> prism::ast::Parser::parse() {
+void* prism::ast::Arena::allocate(size_t size, size_t align) {
+    auto padding = (align - ((uintptr_t) m_cursor & (align - 1))) & (align - 1);
+    if (m_cursor == nullptr || padding + size > m_left) {
+        // Oversized requests get a block of their own
+        auto blockSize = std::max(m_blockSize, size + align);
+        m_blocks.push_back(std::make_unique<char[]>(blockSize));
+        m_cursor = m_blocks.back().get();
+        m_left = blockSize;
+        padding = (align - ((uintptr_t) m_cursor & (align - 1))) & (align - 1);
+    }
+    auto result = m_cursor + padding;
+    m_cursor += padding + size;
+    m_left -= padding + size;
+    m_used += size;
+    return result;
+}
+
+std::string_view prism::ast::Arena::copy(std::string_view str) {
+    if (str.empty()) {
+        return {};
+    }
+    auto data = (char*) allocate(str.size(), 1);
+    std::copy(str.begin(), str.end(), data);
+    return { data, str.size() };
+}
+
+prism::ast::ASTNode* prism::ast::Parser::parse() {
     return parseAssign();
 }
 
-std::shared_ptr<prism::ast::ASTNode> prism::ast::Parser::parseAssign() {
+prism::ast::ASTNode* prism::ast::Parser::parseAssign() {
     auto node = parseOr();
     while (match(lexer::TokenType::Assign)) {
-        auto var = std::get<VariableNode>(node->node);
+        auto var = std::get_if<VariableNode>(&node->node);
+        if (var == nullptr) {
+            throw prism::SyntaxError("Can only assign to a variable");
+        }
         auto right = parseOr();
-        auto parent = std::make_shared<prism::ast::ASTNode>(AssignNode{ var, right });
+        auto parent = make(AssignNode{ *var, right });
         node = parent;
     }
     return node;
 }
 
-std::shared_ptr<prism::ast::ASTNode> prism::ast::Parser::parseOr() {
+prism::ast::ASTNode* prism::ast::Parser::parseOr() {
     auto node = parseAnd();
     while (match(lexer::TokenType::Or)) {
         auto right = parseAnd();
-        auto parent = std::make_shared<prism::ast::ASTNode>(OrNode{ node, right });
+        auto parent = make(OrNode{ node, right });
         node = parent;
     }
     return node;
 }
 
-std::shared_ptr<prism::ast::ASTNode> prism::ast::Parser::parseAnd() {
+prism::ast::ASTNode* prism::ast::Parser::parseAnd() {
     auto node = parseEqual();
     while (match(lexer::TokenType::And)) {
         auto right = parseEqual();
-        auto parent = std::make_shared<prism::ast::ASTNode>(AndNode{ node, right });
+        auto parent = make(AndNode{ node, right });
         node = parent;
     }
     return node;
 }
 
-std::shared_ptr<prism::ast::ASTNode> prism::ast::Parser::parseEqual() {
+prism::ast::ASTNode* prism::ast::Parser::parseEqual() {
     auto node = parseMul();
     while (match(lexer::TokenType::Equal)) {
         auto right = parseMul();
-        auto parent = std::make_shared<prism::ast::ASTNode>(EqualNode{ node, right });
+        auto parent = make(EqualNode{ node, right });
         node = parent;
     }
     return node;
 }
 
-std::shared_ptr<prism::ast::ASTNode> prism::ast::Parser::parseMul() {
+prism::ast::ASTNode* prism::ast::Parser::parseMul() {
     auto node = parseDiv();
     while (match(lexer::TokenType::Mul)) {
         auto right = parseDiv();
-        auto parent = std::make_shared<prism::ast::ASTNode>(MulNode{ node, right });
+        auto parent = make(MulNode{ node, right });
         node = parent;
     }
     return node;
 }
 
-std::shared_ptr<prism::ast::ASTNode> prism::ast::Parser::parseDiv() {
+prism::ast::ASTNode* prism::ast::Parser::parseDiv() {
     auto node = parseAdd();
     while (match(lexer::TokenType::Div)) {
         auto right = parseAdd();
-        auto parent = std::make_shared<prism::ast::ASTNode>(DivNode{ node, right });
+        auto parent = make(DivNode{ node, right });
         node = parent;
     }
     return node;
 }
 
-std::shared_ptr<prism::ast::ASTNode> prism::ast::Parser::parseAdd() {
+prism::ast::ASTNode* prism::ast::Parser::parseAdd() {
     auto node = parseSub();
     while (match(lexer::TokenType::Add)) {
         auto right = parseSub();
-        auto parent = std::make_shared<prism::ast::ASTNode>(AddNode{ node, right });
+        auto parent = make(AddNode{ node, right });
         node = parent;
     }
     return node;
 }
 
-std::shared_ptr<prism::ast::ASTNode> prism::ast::Parser::parseSub() {
+prism::ast::ASTNode* prism::ast::Parser::parseSub() {
     auto node = parseIn();
     while (match(lexer::TokenType::Sub)) {
         auto right = parseIn();
-        auto parent = std::make_shared<prism::ast::ASTNode>(SubNode{ node, right });
+        auto parent = make(SubNode{ node, right });
         node = parent;
     }
     return node;
 }
 
-std::shared_ptr<prism::ast::ASTNode> prism::ast::Parser::parseIn() {
+prism::ast::ASTNode* prism::ast::Parser::parseIn() {
     auto node = parseRange();
     while (match(lexer::TokenType::In)) {
         auto right = parseRange();
-        auto parent = std::make_shared<prism::ast::ASTNode>(InNode{ node, right });
+        auto parent = make(InNode{ node, right });
         node = parent;
     }
     return node;
 }
 
-std::shared_ptr<prism::ast::ASTNode> prism::ast::Parser::parseRange() {
+prism::ast::ASTNode* prism::ast::Parser::parseRange() {
     auto node = parsePrimary();
     while (match(lexer::TokenType::Range)) {
         auto right = parsePrimary();
-        auto parent = std::make_shared<prism::ast::ASTNode>(RangeNode{ node, right });
+        auto parent = make(RangeNode{ node, right });
         node = parent;
     }
     return node;
 }
 // Parses parentheses or variables
-std::shared_ptr<prism::ast::ASTNode> prism::ast::Parser::parsePrimary() {
+prism::ast::ASTNode* prism::ast::Parser::parsePrimary() {
     if (match(lexer::TokenType::LParen)) {
-        auto node = parse();
+        auto result = parse();
         expect(lexer::TokenType::RParen); // Ensure closing ')'
-        return node;
+        return result;
     }
 
     if (match(lexer::TokenType::Integer)) {
-        return std::make_shared<ASTNode>(IntegerNode{ std::stoi(previous().value) });
+        return make(IntegerNode{ lexer::parse_int(previous().value) });
     }
 
     if (match(lexer::TokenType::Float)) {
-        return std::make_shared<ASTNode>(FloatNode{ std::stof(previous().value) });
+        return make(FloatNode{ lexer::parse_float(previous().value) });
     }
 
     if (match(lexer::TokenType::True)) {
-        return std::make_shared<ASTNode>(IntegerNode{ 1 });
+        return make(IntegerNode{ 1 });
     }
 
     if (match(lexer::TokenType::False)) {
-        return std::make_shared<ASTNode>(IntegerNode{ 0 });
+        return make(IntegerNode{ 0 });
     }
 
     if (match(lexer::TokenType::If)) {
         auto condition = parse();
         expect(lexer::TokenType::Then); // Ensure 'then' keyword
         auto body = parse();
-        std::shared_ptr<std::vector<std::shared_ptr<ElseIfNode>>> elseIfs =
-            std::make_shared<std::vector<std::shared_ptr<ElseIfNode>>>();
+        std::vector<ElseIfNode> elseIfs;
         while (match(lexer::TokenType::Elseif)) {
             auto elseIfCondition = parse();
             expect(lexer::TokenType::Then); // Ensure 'then' keyword
             auto elseIfBody = parse();
-            elseIfs->push_back(std::make_shared<ElseIfNode>(ElseIfNode{ elseIfCondition, elseIfBody }));
+            elseIfs.push_back(ElseIfNode{ elseIfCondition, elseIfBody });
         }
 
         if (match(lexer::TokenType::Else)) {
             auto elseBody = parse();
-            return std::make_shared<ASTNode>(IfNode{ condition, body, elseIfs, elseBody });
+            return make(IfNode{ condition, body, arena.copy(std::span<const ElseIfNode>(elseIfs)), elseBody });
         }
 
-        throw std::runtime_error("Unexpected token");
+        throw prism::SyntaxError("Unexpected token");
     }
 
     if (match(lexer::TokenType::Quote)) {
-        return std::make_shared<ASTNode>(QuoteNode{ previous().value });
+        return make(QuoteNode{ arena.copy(previous().value) });
     }
 
     if (match(lexer::TokenType::Not)) {
-        return std::make_shared<ASTNode>(NotNode{ parsePrimary() });
+        return make(NotNode{ parsePrimary() });
     }
 
     if (match(lexer::TokenType::Identifier)) {
-        std::string varName = previous().value;
-        std::shared_ptr<VariableNode> variable = std::make_shared<VariableNode>(VariableNode{ varName });
+        VariableNode variable{ arena.copy(previous().value) };
 
         if (match(lexer::TokenType::LBracket)) {
-            auto arrayIndices = std::make_shared<std::vector<std::shared_ptr<ASTNode>>>();
+            auto start = scratch.size();
             // Loop to handle multiple array accesses (e.g., var[0][1][2])
             do {
                 auto indexNode = parsePrimary();    // Parse the index (e.g., 0, 1)
                 expect(lexer::TokenType::RBracket); // Expect closing bracket
 
-                arrayIndices->push_back(indexNode);
+                scratch.push_back(indexNode);
             } while (match(lexer::TokenType::LBracket));
 
-            return std::make_shared<ASTNode>(ArrayAccessNode{ variable, arrayIndices });
+            return make(ArrayAccessNode{ variable, finish(start) });
         }
 
         if (match(lexer::TokenType::LParen)) {
-            auto args = std::make_shared<std::vector<std::shared_ptr<ASTNode>>>();
+            auto start = scratch.size();
             do {
                 if (isNext(lexer::TokenType::RParen)) {
                     break;
                 }
                 auto arg = parse();
-                args->push_back(arg);
+                scratch.push_back(arg);
             } while (match(lexer::TokenType::Comma));
             expect(lexer::TokenType::RParen);
-            return std::make_shared<ASTNode>(FunctionCallNode{ variable, args });
+            return make(FunctionCallNode{ variable, finish(start) });
         }
-        return std::make_shared<ASTNode>(*variable);
+        return make(variable);
     }
 
-    throw std::runtime_error("Unexpected token");
+    throw prism::SyntaxError("Unexpected token");
+}
+
+std::span<prism::ast::ASTNode*> prism::ast::Parser::finish(size_t start) {
+    auto items = arena.copy(std::span<ASTNode* const>(scratch.data() + start, scratch.size() - start));
+    scratch.resize(start);
+    return items;
 }
 
 // Utility functions
@@ -220,7 +253,11 @@ prism::lexer::Token prism::ast::Parser::previous() {
     return tokens[pos - 1];
 }
 
-void prism::ast::print_ast_node(std::shared_ptr<prism::ast::ASTNode> node, int depth) {
+void prism::ast::print_ast_node(const prism::ast::ASTNode* node, int depth) {
+    // Templates read from a store keep no expression trees
+    if (node == nullptr) {
+        return;
+    }
     std::string indent = std::string(depth, ' ');
     if (is_type(node->node, VariableNode)) {
         std::cout << indent << "Variable: " << std::get<VariableNode>(node->node).name << std::endl;
@@ -232,8 +269,8 @@ void prism::ast::print_ast_node(std::shared_ptr<prism::ast::ASTNode> node, int d
         std::cout << indent << "Float: " << std::get<FloatNode>(node->node).value << std::endl;
         return;
     } else if (is_type(node->node, ArrayAccessNode)) {
-        std::cout << indent << "Array Access: " << std::get<ArrayAccessNode>(node->node).name->name << std::endl;
-        for (const auto& index : *std::get<ArrayAccessNode>(node->node).arrayIndices) {
+        std::cout << indent << "Array Access: " << std::get<ArrayAccessNode>(node->node).name.name << std::endl;
+        for (const auto& index : std::get<ArrayAccessNode>(node->node).arrayIndices) {
             print_ast_node(index, depth + 1);
         }
         return;
@@ -264,9 +301,9 @@ void prism::ast::print_ast_node(std::shared_ptr<prism::ast::ASTNode> node, int d
         std::cout << indent << "IF" << std::endl;
         print_ast_node(ifNode.condition, depth + 1);
         print_ast_node(ifNode.body, depth + 1);
-        for (const auto& elseIf : *ifNode.elseIfs) {
-            print_ast_node(elseIf->condition, depth + 1);
-            print_ast_node(elseIf->body, depth + 1);
+        for (const auto& elseIf : ifNode.elseIfs) {
+            print_ast_node(elseIf.condition, depth + 1);
+            print_ast_node(elseIf.body, depth + 1);
         }
         print_ast_node(ifNode.elseBody, depth + 1);
         return;
@@ -1,14 +1,58 @@
 #pragma once
 
-#include <stack>
+#include <span>
 #include <memory>
+#include <algorithm>
 #include <variant>
+#include <string_view>
+#include <type_traits>
 #include "lexer.h"
 
 namespace prism::ast {
+// Bump allocator owning every node of a template's expressions. Nodes are
+// linked with plain pointers and never destroyed one by one, the whole
+// forest goes away with the arena, so everything allocated here has to be
+// trivially destructible.
+class Arena {
+  public:
+    explicit Arena(size_t blockSize = 4096) : m_blockSize(blockSize) {
+    }
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    template <typename T, typename... Args> T* make(Args&&... args) {
+        static_assert(std::is_trivially_destructible_v<T>, "Arena objects are never destroyed");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T> std::span<T> copy(std::span<const T> items) {
+        static_assert(std::is_trivially_copyable_v<T>, "Arena arrays are copied bytewise");
+        if (items.empty()) {
+            return {};
+        }
+        auto data = (T*) allocate(items.size_bytes(), alignof(T));
+        std::copy(items.begin(), items.end(), data);
+        return { data, items.size() };
+    }
+
+    std::string_view copy(std::string_view str);
+    size_t used() const {
+        return m_used;
+    }
+
+  private:
+    void* allocate(size_t size, size_t align);
+
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    char* m_cursor = nullptr;
+    size_t m_left = 0;
+    size_t m_blockSize;
+    size_t m_used = 0;
+};
+
 struct ASTNode;
 struct VariableNode {
-    std::string name;
+    std::string_view name;
 };
 struct IntegerNode {
     int value;
@@ -17,59 +61,59 @@ struct FloatNode {
     float value;
 };
 struct ArrayAccessNode {
-    std::shared_ptr<VariableNode> name;
-    std::shared_ptr<std::vector<std::shared_ptr<ASTNode>>> arrayIndices;
+    VariableNode name;
+    std::span<ASTNode*> arrayIndices;
 };
 struct FunctionCallNode {
-    std::shared_ptr<VariableNode> name;
-    std::shared_ptr<std::vector<std::shared_ptr<ASTNode>>> args;
+    VariableNode name;
+    std::span<ASTNode*> args;
 };
 struct AssignNode {
     VariableNode name;
-    std::shared_ptr<ASTNode> value;
+    ASTNode* value;
 };
 struct OrNode {
-    std::shared_ptr<ASTNode> left, right;
+    ASTNode *left, *right;
 };
 struct AndNode {
-    std::shared_ptr<ASTNode> left, right;
+    ASTNode *left, *right;
 };
 struct ElseIfNode {
-    std::shared_ptr<ASTNode> condition;
-    std::shared_ptr<ASTNode> body;
+    ASTNode* condition;
+    ASTNode* body;
 };
 struct IfNode {
-    std::shared_ptr<ASTNode> condition;
-    std::shared_ptr<ASTNode> body;
-    std::shared_ptr<std::vector<std::shared_ptr<ElseIfNode>>> elseIfs;
-    std::shared_ptr<ASTNode> elseBody;
+    ASTNode* condition;
+    ASTNode* body;
+    std::span<ElseIfNode> elseIfs;
+    ASTNode* elseBody;
 };
 struct EqualNode {
-    std::shared_ptr<ASTNode> left, right;
+    ASTNode *left, *right;
 };
 struct AddNode {
-    std::shared_ptr<ASTNode> left, right;
+    ASTNode *left, *right;
 };
 struct SubNode {
-    std::shared_ptr<ASTNode> left, right;
+    ASTNode *left, *right;
 };
 struct MulNode {
-    std::shared_ptr<ASTNode> left, right;
+    ASTNode *left, *right;
 };
 struct DivNode {
-    std::shared_ptr<ASTNode> left, right;
+    ASTNode *left, *right;
 };
 struct RangeNode {
-    std::shared_ptr<ASTNode> left, right;
+    ASTNode *left, *right;
 };
 struct InNode {
-    std::shared_ptr<ASTNode> left, right;
+    ASTNode *left, *right;
 };
 struct NotNode {
-    std::shared_ptr<ASTNode> node;
+    ASTNode* node;
 };
 struct QuoteNode {
-    std::string value;
+    std::string_view value;
 };
 
 typedef std::variant<VariableNode, IntegerNode, FloatNode, ArrayAccessNode, FunctionCallNode, AssignNode, OrNode,
@@ -79,37 +123,45 @@ typedef std::variant<VariableNode, IntegerNode, FloatNode, ArrayAccessNode, Func
 struct ASTNode {
     ASTTypes node;
 
-    explicit ASTNode(ASTTypes node) : node(std::move(node)) {
+    explicit ASTNode(ASTTypes node) : node(node) {
     }
 };
 
-void print_ast_node(std::shared_ptr<ASTNode> node, int depth = 0);
+void print_ast_node(const ASTNode* node, int depth = 0);
 
 class Parser {
   private:
     std::vector<lexer::Token> tokens;
     size_t pos = 0;
+    Arena& arena;
+    // Shared stack for index and argument lists while they are being
+    // collected, the finished list is copied into the arena
+    std::vector<ASTNode*> scratch;
 
   public:
-    explicit Parser(std::vector<lexer::Token> tokenList) : tokens(std::move(tokenList)) {
+    Parser(std::vector<lexer::Token> tokenList, Arena& arena) : tokens(std::move(tokenList)), arena(arena) {
     }
-    std::shared_ptr<ASTNode> parse();
+    ASTNode* parse();
 
   private:
-    std::shared_ptr<ASTNode> parseAssign();
-    std::shared_ptr<ASTNode> parseOr();
-    std::shared_ptr<ASTNode> parseAnd();
-    std::shared_ptr<ASTNode> parseEqual();
-    std::shared_ptr<ASTNode> parseAdd();
-    std::shared_ptr<ASTNode> parseSub();
-    std::shared_ptr<ASTNode> parseMul();
-    std::shared_ptr<ASTNode> parseDiv();
-    std::shared_ptr<ASTNode> parseRange();
-    std::shared_ptr<ASTNode> parseIn();
-    std::shared_ptr<ASTNode> parsePrimary();
+    ASTNode* parseAssign();
+    ASTNode* parseOr();
+    ASTNode* parseAnd();
+    ASTNode* parseEqual();
+    ASTNode* parseAdd();
+    ASTNode* parseSub();
+    ASTNode* parseMul();
+    ASTNode* parseDiv();
+    ASTNode* parseRange();
+    ASTNode* parseIn();
+    ASTNode* parsePrimary();
+    template <typename T> ASTNode* make(T value) {
+        return arena.make<ASTNode>(ASTTypes{ value });
+    }
+    std::span<ASTNode*> finish(size_t start);
     bool match(lexer::TokenType type);
     lexer::Token expect(lexer::TokenType type);
     bool isNext(lexer::TokenType type);
     lexer::Token previous();
 };
-} // namespace prism::ast
\ No newline at end of file
+} // namespace prism::ast
@@ -0,0 +1,38 @@
+#include "batch.h"
+
+#include <string_view>
+#include <unordered_map>
+
+prism::BatchResult prism::render_batch(const Renderer& renderer, std::span<const ContextItems> contexts,
+                                       JobSystem* jobs) {
+    if (jobs == nullptr) {
+        jobs = &default_job_system();
+    }
+
+    std::vector<std::string> rendered(contexts.size());
+    jobs->parallel_for(contexts.size(), [&](size_t i) {
+        // One per worker, its buffers stay warm from one render to the next
+        thread_local RenderState state;
+        state.shared = &contexts[i];
+        StringSink sink(rendered[i]);
+        renderer.render(state, sink);
+    });
+
+    BatchResult result;
+    result.index.reserve(contexts.size());
+    // Reserved up front, the keys point into the strings and must not move
+    result.outputs.reserve(contexts.size());
+    std::unordered_map<std::string_view, uint32_t> seen;
+    for (auto& output : rendered) {
+        auto found = seen.find(output);
+        if (found != seen.end()) {
+            result.index.push_back(found->second);
+            continue;
+        }
+        auto id = (uint32_t) result.outputs.size();
+        result.outputs.push_back(std::move(output));
+        seen.emplace(result.outputs.back(), id);
+        result.index.push_back(id);
+    }
+    return result;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "jobs.h"
+#include "render.h"
+
+namespace prism {
+// Outputs of a batch render. Permutations that render to the same text
+// share one entry of `outputs`.
+struct BatchResult {
+    // Distinct outputs in order of first appearance
+    std::vector<std::string> outputs;
+    // outputs[index[i]] is the render of the i-th context
+    std::vector<uint32_t> index;
+
+    const std::string& operator[](size_t i) const {
+        return outputs[index[i]];
+    }
+    size_t size() const {
+        return index.size();
+    }
+};
+
+// Renders every context in parallel on `jobs`, or on the default pool when
+// it is nullptr. Results come back in the order of `contexts`.
+BatchResult render_batch(const Renderer& renderer, std::span<const ContextItems> contexts, JobSystem* jobs = nullptr);
+} // namespace prism
@@ -0,0 +1,157 @@
+#include "bytecode.h"
+
+#include <bit>
+#include "utils/exceptions.h"
+
+#define is_type(var, type) std::holds_alternative<type>((var))
+
+uint32_t prism::bytecode::SlotTable::resolve(std::string_view name) {
+    for (auto it = scope.rbegin(); it != scope.rend(); it++) {
+        if (it->first == name) {
+            return it->second;
+        }
+    }
+    auto key = std::string(name);
+    auto global = globals.find(key);
+    if (global != globals.end()) {
+        return global->second;
+    }
+    names.push_back(key);
+    loop.push_back(false);
+    globals[key] = (uint32_t) names.size() - 1;
+    return (uint32_t) names.size() - 1;
+}
+
+uint32_t prism::bytecode::SlotTable::open_loop(const std::string& name) {
+    names.push_back(name);
+    loop.push_back(true);
+    scope.emplace_back(name, (uint32_t) names.size() - 1);
+    return (uint32_t) names.size() - 1;
+}
+
+void prism::bytecode::SlotTable::close_loop() {
+    scope.pop_back();
+}
+
+prism::bytecode::Program prism::bytecode::compile(const ast::ASTNode* node, SlotTable& slots) {
+    return Compiler(slots).compile(node);
+}
+
+prism::bytecode::Program prism::bytecode::Compiler::compile(const ast::ASTNode* node) {
+    m_program = Program{};
+    emit(node);
+    return std::move(m_program);
+}
+
+void prism::bytecode::Compiler::emit(const ast::ASTNode* node) {
+    auto& code = m_program.code;
+    if (!node) {
+        code.push_back({ OpCode::PushInt, 0, 0 });
+        return;
+    }
+
+    if (auto var = std::get_if<ast::VariableNode>(&node->node)) {
+        code.push_back({ OpCode::Load, 0, m_slots.resolve(var->name) });
+    } else if (auto integer = std::get_if<ast::IntegerNode>(&node->node)) {
+        code.push_back({ OpCode::PushInt, 0, (uint32_t) integer->value });
+    } else if (auto number = std::get_if<ast::FloatNode>(&node->node)) {
+        code.push_back({ OpCode::PushFloat, 0, std::bit_cast<uint32_t>(number->value) });
+    } else if (auto quote = std::get_if<ast::QuoteNode>(&node->node)) {
+        m_program.strings.emplace_back(quote->value);
+        code.push_back({ OpCode::PushString, 0, (uint32_t) m_program.strings.size() - 1 });
+    } else if (auto array = std::get_if<ast::ArrayAccessNode>(&node->node)) {
+        if (array->arrayIndices.size() > 4) {
+            throw SyntaxError("We dont support array indexes bigger than 4");
+        }
+        for (const auto& index : array->arrayIndices) {
+            emit(index);
+        }
+        code.push_back({ OpCode::Index, (uint8_t) array->arrayIndices.size(), m_slots.resolve(array->name.name) });
+    } else if (auto call = std::get_if<ast::FunctionCallNode>(&node->node)) {
+        if (call->args.size() > UINT8_MAX) {
+            throw SyntaxError("Too many arguments for " + std::string(call->name.name));
+        }
+        for (const auto& arg : call->args) {
+            emit(arg);
+        }
+        code.push_back({ OpCode::Call, (uint8_t) call->args.size(), m_slots.resolve(call->name.name) });
+    } else if (auto assign = std::get_if<ast::AssignNode>(&node->node)) {
+        emit(assign->value);
+        code.push_back({ OpCode::Assign, 0, m_slots.resolve(assign->name.name) });
+    } else if (auto in = std::get_if<ast::InNode>(&node->node)) {
+        auto var = std::get_if<ast::VariableNode>(&in->left->node);
+        if (var == nullptr) {
+            throw SyntaxError("Invalid IN operation");
+        }
+        emit(in->right);
+        code.push_back({ OpCode::In, 0, m_slots.resolve(var->name) });
+    } else if (auto notNode = std::get_if<ast::NotNode>(&node->node)) {
+        emit(notNode->node);
+        code.push_back({ OpCode::Not });
+    } else if (auto orNode = std::get_if<ast::OrNode>(&node->node)) {
+        emit_logical(OpCode::Or, orNode->left, orNode->right);
+    } else if (auto andNode = std::get_if<ast::AndNode>(&node->node)) {
+        emit_logical(OpCode::And, andNode->left, andNode->right);
+    } else if (auto equal = std::get_if<ast::EqualNode>(&node->node)) {
+        emit_binary(OpCode::Equal, equal->left, equal->right);
+    } else if (auto add = std::get_if<ast::AddNode>(&node->node)) {
+        emit_binary(OpCode::Add, add->left, add->right);
+    } else if (auto sub = std::get_if<ast::SubNode>(&node->node)) {
+        emit_binary(OpCode::Sub, sub->left, sub->right);
+    } else if (auto mul = std::get_if<ast::MulNode>(&node->node)) {
+        emit_binary(OpCode::Mul, mul->left, mul->right);
+    } else if (auto div = std::get_if<ast::DivNode>(&node->node)) {
+        emit_binary(OpCode::Div, div->left, div->right);
+    } else if (auto range = std::get_if<ast::RangeNode>(&node->node)) {
+        emit_binary(OpCode::Range, range->left, range->right);
+    } else if (auto ifNode = std::get_if<ast::IfNode>(&node->node)) {
+        if (ifNode->elseBody == nullptr) {
+            throw SyntaxError("Invalid IF condition");
+        }
+        // Only the taken branch is evaluated
+        std::vector<size_t> exits;
+        emit(ifNode->condition);
+        auto next = emit_jump(OpCode::JumpIfFalse);
+        emit(ifNode->body);
+        exits.push_back(emit_jump(OpCode::Jump));
+        for (const auto& elseIf : ifNode->elseIfs) {
+            patch(next);
+            emit(elseIf.condition);
+            next = emit_jump(OpCode::JumpIfFalse);
+            emit(elseIf.body);
+            exits.push_back(emit_jump(OpCode::Jump));
+        }
+        patch(next);
+        emit(ifNode->elseBody);
+        for (auto exit : exits) {
+            patch(exit);
+        }
+    } else {
+        code.push_back({ OpCode::PushInt, 0, 0 });
+    }
+}
+
+void prism::bytecode::Compiler::emit_binary(OpCode op, const ast::ASTNode* left,
+                                            const ast::ASTNode* right) {
+    emit(left);
+    emit(right);
+    m_program.code.push_back({ op });
+}
+
+// The right operand is only evaluated when the left one does not decide
+void prism::bytecode::Compiler::emit_logical(OpCode op, const ast::ASTNode* left, const ast::ASTNode* right) {
+    emit(left);
+    auto decided = emit_jump(op);
+    emit(right);
+    m_program.code.push_back({ OpCode::Truth, 0, (uint32_t) op });
+    patch(decided);
+}
+
+size_t prism::bytecode::Compiler::emit_jump(OpCode op) {
+    m_program.code.push_back({ op });
+    return m_program.code.size() - 1;
+}
+
+void prism::bytecode::Compiler::patch(size_t jump) {
+    m_program.code[jump].arg = (uint32_t) m_program.code.size();
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include "ast.h"
+
+namespace prism::bytecode {
+enum class OpCode : uint8_t {
+    PushInt,     // push arg as an int
+    PushFloat,   // push the bits of arg as a float
+    PushString,  // push strings[arg]
+    Load,        // push slot arg
+    Index,       // pop `count` indices, push slot arg at those indices
+    Call,        // pop `count` arguments, push the result of the native in slot arg
+    Assign,      // pop a value, store it in slot arg, push Void
+    In,          // pop an iterable, push a ForContext binding slot arg
+    Not,         // logical not of an int
+    Or,          // ||: pop the left operand, if it is true push 1 and continue at arg
+    And,         // &&: pop the left operand, unless it is true push 0 and continue at arg
+    Truth,       // right operand of the Or or And in arg: 1 if it is true, else 0
+    Equal,       // ==
+    Add,         // +
+    Sub,         // -
+    Mul,         // *
+    Div,         // /
+    Range,       // ..
+    Jump,        // continue at arg
+    JumpIfFalse, // pop a condition, continue at arg unless it is the int 1
+};
+
+struct Instruction {
+    OpCode op;
+    uint8_t count = 0;
+    uint32_t arg = 0;
+};
+
+constexpr uint32_t NOT_HOISTED = UINT32_MAX;
+
+// An expression lowered to a linear instruction list; running it leaves
+// exactly one value on the stack. Numbers are stored inline in the
+// instruction, strings in a side table and variables as slot indices.
+struct Program {
+    std::vector<Instruction> code;
+    std::vector<std::string> strings;
+    // Set by hoist::compile when the value is computed once per loop entry
+    uint32_t hoisted = NOT_HOISTED;
+};
+
+// Variables are bound to dense slot indices while a template is compiled.
+// Globals are looked up in the context once per render; every @for gets a
+// slot of its own for its variable, shadowing any global of the same name.
+struct SlotTable {
+    std::vector<std::string> names;
+    std::vector<bool> loop;
+    std::unordered_map<std::string, uint32_t> globals;
+    // Loop variables in scope, innermost last
+    std::vector<std::pair<std::string, uint32_t>> scope;
+
+    uint32_t resolve(std::string_view name);
+    uint32_t open_loop(const std::string& name);
+    void close_loop();
+    size_t size() const {
+        return names.size();
+    }
+};
+
+class Compiler {
+  public:
+    explicit Compiler(SlotTable& slots) : m_slots(slots) {
+    }
+    Program compile(const ast::ASTNode* node);
+
+  private:
+    void emit(const ast::ASTNode* node);
+    void emit_binary(OpCode op, const ast::ASTNode* left, const ast::ASTNode* right);
+    void emit_logical(OpCode op, const ast::ASTNode* left, const ast::ASTNode* right);
+    size_t emit_jump(OpCode op);
+    void patch(size_t jump);
+
+    SlotTable& m_slots;
+    Program m_program;
+};
+
+Program compile(const ast::ASTNode* node, SlotTable& slots);
+} // namespace prism::bytecode
@@ -0,0 +1,239 @@
+#include "cache.h"
+
+#include <algorithm>
+#include "utils/hash.h"
+
+namespace {
+template <typename T> void put(std::string& out, const T& value) {
+    out.append((const char*) &value, sizeof(T));
+}
+
+template <typename T> void encode_array(const prism::MTDArray<T>& array, std::string& out) {
+    size_t count = 1;
+    put(out, (uint32_t) array.dimensions.size());
+    for (auto dimension : array.dimensions) {
+        put(out, (uint64_t) dimension);
+        count *= dimension;
+    }
+    out.append((const char*) array.ptr, count * sizeof(T));
+}
+
+template <typename T> void encode_cell(prism::MTDArray<T> array, const std::vector<int>& indices, std::string& out) {
+    if (indices.size() > array.dimensions.size()) {
+        out += '\xFF';
+        return;
+    }
+    for (size_t i = 0; i < indices.size(); i++) {
+        auto index = indices[i];
+        if (index < 0 || (size_t) index >= array.dimensions[0]) {
+            out += '\xFE';
+            return;
+        }
+        if (i + 1 == indices.size() && array.dimensions.size() == 1) {
+            out += '\x01';
+            put(out, array.at(index));
+            return;
+        }
+        array = array.get(index);
+    }
+    out += '\x02';
+    encode_array(array, out);
+}
+
+void encode_value(const prism::ContextTypes& value, std::string& out) {
+    out += (char) value.index();
+    if (is_type(value, int)) {
+        put(out, std::get<int>(value));
+    } else if (is_type(value, float)) {
+        put(out, std::get<float>(value));
+    } else if (is_type(value, std::string)) {
+        const auto& str = std::get<std::string>(value);
+        put(out, (uint64_t) str.size());
+        out += str;
+    } else if (is_type(value, prism::MTDArray<bool>)) {
+        encode_array(std::get<prism::MTDArray<bool>>(value), out);
+    } else if (is_type(value, prism::MTDArray<int>)) {
+        encode_array(std::get<prism::MTDArray<int>>(value), out);
+    } else if (is_type(value, prism::MTDArray<float>)) {
+        encode_array(std::get<prism::MTDArray<float>>(value), out);
+    } else if (is_type(value, prism::GeneratedRange)) {
+        const auto& range = std::get<prism::GeneratedRange>(value);
+        put(out, (uint64_t) range.start);
+        put(out, (uint64_t) range.end);
+    } else if (is_type(value, prism::Native)) {
+        const auto& native = std::get<prism::Native>(value);
+        put(out, (uintptr_t) native.function);
+        put(out, (uintptr_t) native.data);
+    } else if (is_type(value, prism::Opaque)) {
+        put(out, std::get<prism::Opaque>(value).ptr);
+    }
+}
+} // namespace
+
+void prism::encode_read(const ReadRecord& record, const ContextTypes* value, std::string& out) {
+    if (value == nullptr) {
+        out += '\xFD';
+        return;
+    }
+    if (record.indices.empty()) {
+        encode_value(*value, out);
+        return;
+    }
+    // The array type goes first so a cell never reads the same as a plain value
+    if (is_type(*value, MTDArray<bool>)) {
+        out += (char) value->index();
+        encode_cell(std::get<MTDArray<bool>>(*value), record.indices, out);
+    } else if (is_type(*value, MTDArray<int>)) {
+        out += (char) value->index();
+        encode_cell(std::get<MTDArray<int>>(*value), record.indices, out);
+    } else if (is_type(*value, MTDArray<float>)) {
+        out += (char) value->index();
+        encode_cell(std::get<MTDArray<float>>(*value), record.indices, out);
+    } else {
+        encode_value(*value, out);
+    }
+}
+
+uint64_t prism::hash_read(const ReadRecord& record, const ContextTypes* value) {
+    std::string encoded;
+    encode_read(record, value, encoded);
+    return hash::fnv1a(encoded);
+}
+
+size_t prism::OutputCache::size_of(const Entry& entry) {
+    auto bytes = sizeof(Entry) + entry.values.size() + entry.render.output.size();
+    for (const auto& write : entry.render.writes) {
+        bytes += sizeof(write) + write.first.size();
+    }
+    return bytes;
+}
+
+std::optional<prism::CachedRender> prism::OutputCache::find(uint64_t templateHash, const ContextResolver& resolve) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto shapes = m_shapes.find(templateHash);
+    if (shapes != m_shapes.end()) {
+        std::string values;
+        for (const auto& shape : shapes->second) {
+            values.clear();
+            for (const auto& record : shape->reads) {
+                encode_read(record, resolve(record.name), values);
+            }
+            auto entry = m_entries.find(hash::fnv1a(values, hash::mix(templateHash, shape->hash)));
+            // The key is only a hash, the entry has to have read the same values
+            if (entry == m_entries.end() || entry->second->templateHash != templateHash ||
+                entry->second->shape != shape || entry->second->values != values) {
+                continue;
+            }
+            m_lru.splice(m_lru.begin(), m_lru, entry->second);
+            m_stats.hits++;
+            return entry->second->render;
+        }
+    }
+    m_stats.misses++;
+    return std::nullopt;
+}
+
+void prism::OutputCache::insert(uint64_t templateHash, ReadSet reads, std::string values, CachedRender render) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (render.output.size() > m_budget) {
+        return;
+    }
+
+    auto& shapes = m_shapes[templateHash];
+    std::shared_ptr<Shape> shape;
+    for (const auto& candidate : shapes) {
+        if (candidate->reads == reads) {
+            shape = candidate;
+            break;
+        }
+    }
+    if (shape == nullptr) {
+        shape = std::make_shared<Shape>();
+        shape->reads = std::move(reads);
+        shape->hash = hash::FNV_OFFSET;
+        shape->bytes = sizeof(Shape);
+        for (const auto& record : shape->reads) {
+            shape->hash = hash::fnv1a(record.name, shape->hash);
+            shape->hash = hash::fnv1a(record.indices.data(), record.indices.size() * sizeof(int), shape->hash);
+            shape->hash = hash::mix(shape->hash, record.indices.size());
+            shape->bytes += sizeof(ReadRecord) + record.name.size() + record.indices.size() * sizeof(int);
+        }
+        shapes.push_back(shape);
+        m_stats.bytes += shape->bytes;
+    }
+
+    auto key = hash::fnv1a(values, hash::mix(templateHash, shape->hash));
+    if (CONTAINS(m_entries, key)) {
+        return;
+    }
+
+    m_lru.push_front(Entry{ key, templateHash, shape, std::move(values), std::move(render) });
+    m_entries[key] = m_lru.begin();
+    shape->users++;
+    m_stats.bytes += size_of(m_lru.front());
+    m_stats.insertions++;
+    m_stats.entries++;
+    evict();
+}
+
+void prism::OutputCache::evict() {
+    while (m_stats.bytes > m_budget && !m_lru.empty()) {
+        auto& entry = m_lru.back();
+        m_entries.erase(entry.key);
+        m_stats.bytes -= size_of(entry);
+        m_stats.evictions++;
+        m_stats.entries--;
+        release(entry.templateHash, entry.shape);
+        m_lru.pop_back();
+    }
+}
+
+void prism::OutputCache::release(uint64_t templateHash, const std::shared_ptr<Shape>& shape) {
+    if (--shape->users > 0) {
+        return;
+    }
+    auto& shapes = m_shapes[templateHash];
+    shapes.erase(std::remove(shapes.begin(), shapes.end(), shape), shapes.end());
+    m_stats.bytes -= shape->bytes;
+    if (shapes.empty()) {
+        m_shapes.erase(templateHash);
+    }
+}
+
+size_t prism::OutputCache::invalidate(uint64_t templateHash) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t removed = 0;
+    for (auto entry = m_lru.begin(); entry != m_lru.end();) {
+        if (entry->templateHash != templateHash) {
+            ++entry;
+            continue;
+        }
+        m_entries.erase(entry->key);
+        m_stats.bytes -= size_of(*entry);
+        m_stats.entries--;
+        release(entry->templateHash, entry->shape);
+        entry = m_lru.erase(entry);
+        removed++;
+    }
+    return removed;
+}
+
+void prism::OutputCache::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_lru.clear();
+    m_entries.clear();
+    m_shapes.clear();
+    m_stats.bytes = 0;
+    m_stats.entries = 0;
+}
+
+void prism::OutputCache::set_budget(size_t budget) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_budget = budget;
+    evict();
+}
+
+prism::CacheStats prism::OutputCache::stats() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <optional>
+#include <functional>
+#include <unordered_map>
+
+#include "processor.h"
+
+namespace prism {
+// Returns the value a render would see for a name, nullptr if it is unknown
+typedef std::function<const ContextTypes*(const std::string&)> ContextResolver;
+
+// Appends what `record` selects out of `value`, the root entry it names, in a
+// form that is equal exactly when the selected values are
+void encode_read(const ReadRecord& record, const ContextTypes* value, std::string& out);
+// Hash of encode_read()
+uint64_t hash_read(const ReadRecord& record, const ContextTypes* value);
+
+// What a render left behind: its output and the values it assigned
+struct CachedRender {
+    std::string output;
+    std::vector<std::pair<std::string, ContextTypes>> writes;
+};
+
+struct CacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t insertions = 0;
+    size_t evictions = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+};
+
+// Rendered output cache. Entries are keyed by the template fingerprint and by
+// the values of only those context entries the render actually read, so two
+// contexts that differ in variables the taken branches never touch share an
+// entry. A hit hands back the output and the assignments of the render, which
+// the renderer applies to the context as if it had run. Renders that call a
+// native taking the context are never stored; other natives are expected to
+// be pure functions of their arguments.
+class OutputCache {
+  public:
+    explicit OutputCache(size_t budget = 16 * 1024 * 1024) : m_budget(budget) {
+    }
+
+    std::optional<CachedRender> find(uint64_t templateHash, const ContextResolver& resolve);
+    // `values` holds encode_read() of every record, taken when it was read
+    void insert(uint64_t templateHash, ReadSet reads, std::string values, CachedRender render);
+    // Drops every render of the template, returns how many there were
+    size_t invalidate(uint64_t templateHash);
+    void clear();
+    void set_budget(size_t budget);
+    CacheStats stats();
+
+  private:
+    struct Shape {
+        ReadSet reads;
+        uint64_t hash = 0;
+        size_t bytes = 0;
+        size_t users = 0;
+    };
+    struct Entry {
+        uint64_t key;
+        uint64_t templateHash;
+        std::shared_ptr<Shape> shape;
+        // Compared on a hit, the key alone could collide
+        std::string values;
+        CachedRender render;
+    };
+
+    static size_t size_of(const Entry& entry);
+    void evict();
+    void release(uint64_t templateHash, const std::shared_ptr<Shape>& shape);
+
+    std::mutex m_mutex;
+    size_t m_budget;
+    CacheStats m_stats;
+    std::list<Entry> m_lru;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> m_entries;
+    // Distinct read sets seen per template; a lookup probes each of them
+    std::unordered_map<uint64_t, std::vector<std::shared_ptr<Shape>>> m_shapes;
+};
+} // namespace prism
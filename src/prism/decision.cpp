@@ -0,0 +1,419 @@
+#include "decision.h"
+
+#include <optional>
+#include <unordered_map>
+#include "processor.h"
+
+namespace {
+using prism::bytecode::OpCode;
+typedef std::vector<std::shared_ptr<prism::Node>> NodeList;
+
+constexpr size_t MAX_ATOMS = 64;
+// A run whose diagrams grow past this is left to the tree walk
+constexpr size_t MAX_NODES = 4096;
+
+constexpr uint32_t FALSE = 0;
+constexpr uint32_t TRUE = 1;
+
+// What a toggle condition leaves on the stack while it is read
+struct Operand {
+    enum Kind { Const, Load, Bool } kind;
+    // Const: the int, Load: the slot, Bool: the diagram
+    uint32_t value;
+};
+
+// Whether `program` only combines slots and int constants with !, ==, || and &&
+bool is_toggle(const prism::bytecode::Program& program) {
+    std::vector<Operand::Kind> stack;
+    for (const auto& ins : program.code) {
+        switch (ins.op) {
+            case OpCode::PushInt:
+                stack.push_back(Operand::Const);
+                break;
+            case OpCode::Load:
+                stack.push_back(Operand::Load);
+                break;
+            case OpCode::Not:
+                stack.back() = Operand::Bool;
+                break;
+            case OpCode::Or:
+            case OpCode::And:
+                // Both operands are read, the jump only skips work
+                break;
+            case OpCode::Truth:
+                stack.pop_back();
+                stack.back() = Operand::Bool;
+                break;
+            case OpCode::Equal: {
+                auto right = stack.back();
+                stack.pop_back();
+                auto left = stack.back();
+                // An atom compares a variable with a constant
+                if ((left == Operand::Load && right != Operand::Const) ||
+                    (right == Operand::Load && left != Operand::Const)) {
+                    return false;
+                }
+                stack.back() = Operand::Bool;
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return stack.size() == 1;
+}
+
+bool assigns(const prism::bytecode::Program& program) {
+    for (const auto& ins : program.code) {
+        if (ins.op == OpCode::Assign) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Whether `node` may be part of a run. Else and elseif nodes follow their if
+// and are judged with it.
+bool is_flat(const prism::Node& node) {
+    if (is_type(node.node, prism::TextNode)) {
+        return true;
+    }
+    if (auto var = std::get_if<prism::VariableNode>(&node.node)) {
+        // Assignments could change an atom after the run has read it
+        return !assigns(var->program);
+    }
+    auto flat = [](const NodeList& nodes) {
+        for (const auto& child : nodes) {
+            if (!is_type(child->node, prism::ElseIfNode) && !is_type(child->node, prism::ElseNode) &&
+                !is_flat(*child)) {
+                return false;
+            }
+        }
+        return true;
+    };
+    if (auto ifNode = std::get_if<prism::IfNode>(&node.node)) {
+        if (!is_toggle(ifNode->program) || !flat(*ifNode->children)) {
+            return false;
+        }
+        for (const auto& node : ifNode->elseIfs) {
+            const auto& elseIf = std::get<prism::ElseIfNode>(node->node);
+            if (!is_toggle(elseIf.program) || !flat(*elseIf.children)) {
+                return false;
+            }
+        }
+        return ifNode->elseBody == nullptr || flat(*std::get<prism::ElseNode>(ifNode->elseBody->node).children);
+    }
+    return false;
+}
+
+// Builds the diagrams and segments of one run
+class Builder {
+  public:
+    explicit Builder(prism::CompiledTemplate& compiled) : m_compiled(compiled) {
+        m_program.nodes = { { UINT32_MAX, FALSE, FALSE }, { UINT32_MAX, TRUE, TRUE } };
+    }
+
+    // nullptr if the run needs too many atoms or nodes
+    std::shared_ptr<prism::decision::Program> build(const NodeList& nodes) {
+        emit(nodes, TRUE);
+        if (m_failed) {
+            return nullptr;
+        }
+        merge();
+        return std::make_shared<prism::decision::Program>(std::move(m_program));
+    }
+
+  private:
+    void emit(const NodeList& nodes, uint32_t guard) {
+        for (const auto& node : nodes) {
+            if (guard == FALSE || m_failed) {
+                return;
+            }
+            if (auto text = std::get_if<prism::TextNode>(&node->node)) {
+                m_program.segments.push_back({ text->text, nullptr, guard });
+            } else if (is_type(node->node, prism::VariableNode)) {
+                m_program.segments.push_back({ {}, node.get(), guard });
+            } else if (auto ifNode = std::get_if<prism::IfNode>(&node->node)) {
+                // Each branch holds when no earlier one did
+                auto condition = read(ifNode->program);
+                emit(*ifNode->children, apply(true, guard, condition));
+                auto rest = apply(true, guard, negate(condition));
+                for (const auto& branch : ifNode->elseIfs) {
+                    const auto& elseIf = std::get<prism::ElseIfNode>(branch->node);
+                    condition = read(elseIf.program);
+                    emit(*elseIf.children, apply(true, rest, condition));
+                    rest = apply(true, rest, negate(condition));
+                }
+                if (ifNode->elseBody != nullptr) {
+                    emit(*std::get<prism::ElseNode>(ifNode->elseBody->node).children, rest);
+                }
+            }
+        }
+    }
+
+    // Adjacent text under the same guard becomes one segment
+    void merge() {
+        std::vector<prism::decision::Segment> merged;
+        std::string joined;
+        size_t pieces = 0;
+        auto close = [&] {
+            if (pieces > 1) {
+                m_compiled.text.push_back(std::move(joined));
+                merged.back().text = m_compiled.text.back();
+            }
+            joined.clear();
+            pieces = 0;
+        };
+        for (const auto& segment : m_program.segments) {
+            if (segment.guard == FALSE || (segment.node == nullptr && segment.text.empty())) {
+                continue;
+            }
+            if (segment.node == nullptr && pieces > 0 && merged.back().guard == segment.guard) {
+                if (pieces == 1) {
+                    joined.assign(merged.back().text);
+                }
+                joined.append(segment.text);
+                pieces++;
+                continue;
+            }
+            close();
+            merged.push_back(segment);
+            pieces = segment.node == nullptr ? 1 : 0;
+        }
+        close();
+        m_program.segments = std::move(merged);
+    }
+
+    // The diagram of a condition accepted by is_toggle()
+    uint32_t read(const prism::bytecode::Program& program) {
+        std::vector<Operand> stack;
+        for (const auto& ins : program.code) {
+            switch (ins.op) {
+                case OpCode::PushInt:
+                    stack.push_back({ Operand::Const, ins.arg });
+                    break;
+                case OpCode::Load:
+                    stack.push_back({ Operand::Load, ins.arg });
+                    break;
+                case OpCode::Not: {
+                    // The render's ! maps 0 to 1 and anything else to 0
+                    auto& value = stack.back();
+                    if (value.kind == Operand::Load) {
+                        value = { Operand::Bool, atom(value.value, 0) };
+                    } else if (value.kind == Operand::Const) {
+                        value = { Operand::Bool, (int) value.value == 0 ? TRUE : FALSE };
+                    } else {
+                        value.value = negate(value.value);
+                    }
+                    break;
+                }
+                case OpCode::Truth: {
+                    auto right = truth(stack.back());
+                    stack.pop_back();
+                    stack.back() = { Operand::Bool, apply((OpCode) ins.arg == OpCode::And, truth(stack.back()), right) };
+                    break;
+                }
+                case OpCode::Equal: {
+                    auto right = stack.back();
+                    stack.pop_back();
+                    stack.back() = { Operand::Bool, equal(stack.back(), right) };
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+        return truth(stack.back());
+    }
+
+    // The render takes a condition as true only when it is the int 1
+    uint32_t truth(const Operand& value) {
+        switch (value.kind) {
+            case Operand::Const:
+                return (int) value.value == 1 ? TRUE : FALSE;
+            case Operand::Load:
+                return atom(value.value, 1);
+            default:
+                return value.value;
+        }
+    }
+
+    uint32_t equal(Operand left, Operand right) {
+        if (left.kind == Operand::Const) {
+            std::swap(left, right);
+        }
+        if (right.kind != Operand::Const) {
+            // Both are 0 or 1
+            auto a = left.value;
+            auto b = right.value;
+            return apply(false, apply(true, a, b), apply(true, negate(a), negate(b)));
+        }
+        auto constant = (int) right.value;
+        switch (left.kind) {
+            case Operand::Const:
+                return (int) left.value == constant ? TRUE : FALSE;
+            case Operand::Load:
+                return atom(left.value, constant);
+            default:
+                return constant == 1 ? left.value : constant == 0 ? negate(left.value) : FALSE;
+        }
+    }
+
+    uint32_t atom(uint32_t slot, int value) {
+        for (size_t i = 0; i < m_program.atoms.size(); i++) {
+            if (m_program.atoms[i].slot == slot && m_program.atoms[i].value == value) {
+                return make((uint32_t) i, FALSE, TRUE);
+            }
+        }
+        if (m_program.atoms.size() == MAX_ATOMS) {
+            m_failed = true;
+            return FALSE;
+        }
+        m_program.atoms.push_back({ slot, value });
+        return make((uint32_t) m_program.atoms.size() - 1, FALSE, TRUE);
+    }
+
+    uint32_t make(uint32_t atom, uint32_t low, uint32_t high) {
+        if (low == high) {
+            return low;
+        }
+        auto key = (uint64_t) atom << 40 | (uint64_t) low << 20 | high;
+        auto found = m_unique.find(key);
+        if (found != m_unique.end()) {
+            return found->second;
+        }
+        if (m_program.nodes.size() == MAX_NODES) {
+            m_failed = true;
+            return FALSE;
+        }
+        m_program.nodes.push_back({ atom, low, high });
+        auto node = (uint32_t) m_program.nodes.size() - 1;
+        m_unique[key] = node;
+        return node;
+    }
+
+    uint32_t negate(uint32_t node) {
+        if (node <= TRUE) {
+            return node == TRUE ? FALSE : TRUE;
+        }
+        auto found = m_negated.find(node);
+        if (found != m_negated.end()) {
+            return found->second;
+        }
+        auto decision = m_program.nodes[node];
+        auto result = make(decision.atom, negate(decision.low), negate(decision.high));
+        m_negated[node] = result;
+        return result;
+    }
+
+    // && when `conjunction`, || otherwise
+    uint32_t apply(bool conjunction, uint32_t a, uint32_t b) {
+        auto absorbing = conjunction ? FALSE : TRUE;
+        if (a == absorbing || b == absorbing) {
+            return absorbing;
+        }
+        if (a == 1 - absorbing || a == b) {
+            return b;
+        }
+        if (b == 1 - absorbing) {
+            return a;
+        }
+        if (a > b) {
+            std::swap(a, b);
+        }
+        auto key = (uint64_t) a << 32 | b;
+        auto& memo = conjunction ? m_and : m_or;
+        auto found = memo.find(key);
+        if (found != memo.end()) {
+            return found->second;
+        }
+        auto left = m_program.nodes[a];
+        auto right = m_program.nodes[b];
+        auto top = std::min(left.atom, right.atom);
+        auto low = apply(conjunction, left.atom == top ? left.low : a, right.atom == top ? right.low : b);
+        auto high = apply(conjunction, left.atom == top ? left.high : a, right.atom == top ? right.high : b);
+        auto result = make(top, low, high);
+        memo[key] = result;
+        return result;
+    }
+
+    prism::CompiledTemplate& m_compiled;
+    prism::decision::Program m_program;
+    bool m_failed = false;
+    std::unordered_map<uint64_t, uint32_t> m_unique;
+    std::unordered_map<uint32_t, uint32_t> m_negated;
+    std::unordered_map<uint64_t, uint32_t> m_and;
+    std::unordered_map<uint64_t, uint32_t> m_or;
+};
+
+const std::shared_ptr<NodeList>* children_of(const prism::Node& node) {
+    if (auto ifNode = std::get_if<prism::IfNode>(&node.node)) {
+        return &ifNode->children;
+    }
+    if (auto elseIf = std::get_if<prism::ElseIfNode>(&node.node)) {
+        return &elseIf->children;
+    }
+    if (auto elseNode = std::get_if<prism::ElseNode>(&node.node)) {
+        return &elseNode->children;
+    }
+    if (auto forNode = std::get_if<prism::ForNode>(&node.node)) {
+        return &forNode->children;
+    }
+    return nullptr;
+}
+
+void scan(NodeList& nodes, const std::shared_ptr<prism::Node>& parent, prism::CompiledTemplate& compiled) {
+    NodeList out;
+    size_t i = 0;
+    while (i < nodes.size()) {
+        // Longest run of flat nodes starting at i
+        size_t end = i;
+        bool branches = false;
+        bool ownerFlat = false;
+        while (end < nodes.size()) {
+            const auto& node = *nodes[end];
+            bool flat;
+            if (is_type(node.node, prism::ElseIfNode) || is_type(node.node, prism::ElseNode)) {
+                flat = ownerFlat;
+            } else {
+                flat = is_flat(node);
+                ownerFlat = flat && is_type(node.node, prism::IfNode);
+                branches |= ownerFlat;
+            }
+            if (!flat) {
+                break;
+            }
+            end++;
+        }
+
+        if (branches) {
+            NodeList run(nodes.begin() + (long) i, nodes.begin() + (long) end);
+            if (auto program = Builder(compiled).build(run)) {
+                auto decision = std::make_shared<prism::Node>(
+                    prism::DecisionNode{ std::move(program), std::make_shared<NodeList>(std::move(run)) }, parent);
+                decision->location = nodes[i]->location;
+                out.push_back(std::move(decision));
+                i = end;
+                continue;
+            }
+        }
+        if (end > i) {
+            out.insert(out.end(), nodes.begin() + (long) i, nodes.begin() + (long) end);
+            i = end;
+            continue;
+        }
+
+        // Not part of a run, runs may still be found inside
+        if (auto children = children_of(*nodes[i])) {
+            scan(**children, nodes[i], compiled);
+        }
+        out.push_back(nodes[i]);
+        i++;
+    }
+    nodes = std::move(out);
+}
+} // namespace
+
+void prism::decision::compile(CompiledTemplate& compiled) {
+    scan(*std::get<RootNode>(compiled.root->node).children, compiled.root, compiled);
+}
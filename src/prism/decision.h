@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+namespace prism {
+class Node;
+struct CompiledTemplate;
+} // namespace prism
+
+namespace prism::decision {
+// True when `slot` holds the int `value`. Toggles test for 1, `!toggle` for 0.
+struct Atom {
+    uint32_t slot;
+    int value;
+};
+
+// Node of a reduced ordered decision diagram. Entries 0 and 1 of
+// Program::nodes are the false and true terminals, every other entry tests
+// one atom; atoms are tested in index order along any path.
+struct Decision {
+    uint32_t atom;
+    uint32_t low;
+    uint32_t high;
+};
+
+// Output of a run of text and @{} directives nested in @if chains over
+// toggles, flattened: every segment is emitted when its guard holds. Text
+// segments are precomputed; `node` is set for a directive instead.
+struct Segment {
+    std::string_view text;
+    const Node* node = nullptr;
+    uint32_t guard = 1;
+};
+
+struct Program {
+    // At most 64, the render evaluates them into one mask
+    std::vector<Atom> atoms;
+    std::vector<Decision> nodes;
+    std::vector<Segment> segments;
+
+    // Follows the diagram of `guard` for the atoms set in `mask`
+    bool holds(uint32_t guard, uint64_t mask) const {
+        while (guard > 1) {
+            const auto& node = nodes[guard];
+            guard = (mask >> node.atom) & 1 ? node.high : node.low;
+        }
+        return guard == 1;
+    }
+};
+
+// Replaces every run of sibling nodes made only of text, @{} directives that
+// assign nothing and @if chains over toggle conditions by a decision node.
+// Folded text is kept in the template.
+void compile(CompiledTemplate& compiled);
+} // namespace prism::decision
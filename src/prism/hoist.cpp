@@ -0,0 +1,262 @@
+#include "hoist.h"
+
+#include <algorithm>
+#include "processor.h"
+
+namespace {
+using prism::bytecode::OpCode;
+typedef std::vector<std::shared_ptr<prism::Node>> NodeList;
+
+// Dependencies are the depth of the innermost enclosing loop read, 1 for
+// the outermost one. Neither reads a loop: cached for the outermost loop.
+constexpr uint32_t INVARIANT = 0;
+// Has to be evaluated every time
+constexpr uint32_t VARIANT = UINT32_MAX;
+
+// Text, and else and elseif nodes, which are rendered through their if
+bool is_neutral(const prism::Node& node) {
+    return is_type(node.node, prism::TextNode) || is_type(node.node, prism::ElseIfNode) ||
+           is_type(node.node, prism::ElseNode);
+}
+
+class Hoister {
+  public:
+    explicit Hoister(prism::CompiledTemplate& compiled) : m_compiled(compiled) {
+    }
+
+    void run() {
+        auto& children = *std::get<prism::RootNode>(m_compiled.root->node).children;
+        m_compiled.hoisted = 0;
+        survey(children, 0);
+        visit(children, m_compiled.root);
+    }
+
+  private:
+    // Depth of every loop variable and slots assigned anywhere. Clears what
+    // a previous pass left in programs copied from another tree.
+    void survey(NodeList& nodes, uint32_t depth) {
+        for (auto& node : nodes) {
+            if (auto var = std::get_if<prism::VariableNode>(&node->node)) {
+                survey(var->program);
+            } else if (auto ifNode = std::get_if<prism::IfNode>(&node->node)) {
+                survey(ifNode->program);
+                survey(*ifNode->children, depth);
+            } else if (auto elseIf = std::get_if<prism::ElseIfNode>(&node->node)) {
+                survey(elseIf->program);
+                survey(*elseIf->children, depth);
+            } else if (auto elseNode = std::get_if<prism::ElseNode>(&node->node)) {
+                survey(*elseNode->children, depth);
+            } else if (auto forNode = std::get_if<prism::ForNode>(&node->node)) {
+                survey(forNode->program);
+                forNode->hoisted.clear();
+                grow(forNode->slot);
+                m_depth[forNode->slot] = depth + 1;
+                survey(*forNode->children, depth + 1);
+            } else if (auto decision = std::get_if<prism::DecisionNode>(&node->node)) {
+                survey(*decision->children, depth);
+            }
+        }
+    }
+
+    void survey(prism::bytecode::Program& program) {
+        program.hoisted = prism::bytecode::NOT_HOISTED;
+        for (const auto& ins : program.code) {
+            if (ins.op == OpCode::Assign) {
+                grow(ins.arg);
+                m_assigned[ins.arg] = true;
+            }
+        }
+    }
+
+    void grow(uint32_t slot) {
+        if (slot >= m_depth.size()) {
+            m_depth.resize(slot + 1, 0);
+            m_assigned.resize(slot + 1, false);
+        }
+    }
+
+    // Loops deeper than `depth` are part of what is judged
+    uint32_t depends(const prism::bytecode::Program& program, uint32_t depth) const {
+        uint32_t result = INVARIANT;
+        for (const auto& ins : program.code) {
+            switch (ins.op) {
+                case OpCode::Call:
+                case OpCode::Assign:
+                case OpCode::In:
+                    return VARIANT;
+                case OpCode::Load:
+                case OpCode::Index: {
+                    if (ins.arg < m_assigned.size() && m_assigned[ins.arg]) {
+                        return VARIANT;
+                    }
+                    auto loop = ins.arg < m_depth.size() ? m_depth[ins.arg] : 0;
+                    if (loop <= depth) {
+                        result = std::max(result, loop);
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+        return result;
+    }
+
+    uint32_t depends(const NodeList& nodes, uint32_t depth) const {
+        uint32_t result = INVARIANT;
+        for (const auto& node : nodes) {
+            result = std::max(result, depends(*node, depth));
+            if (result == VARIANT) {
+                break;
+            }
+        }
+        return result;
+    }
+
+    uint32_t depends(const prism::Node& node, uint32_t depth) const {
+        if (auto var = std::get_if<prism::VariableNode>(&node.node)) {
+            return depends(var->program, depth);
+        }
+        if (auto ifNode = std::get_if<prism::IfNode>(&node.node)) {
+            auto result = std::max(depends(ifNode->program, depth), depends(*ifNode->children, depth));
+            for (const auto& elseIf : ifNode->elseIfs) {
+                const auto& branch = std::get<prism::ElseIfNode>(elseIf->node);
+                result = std::max({ result, depends(branch.program, depth), depends(*branch.children, depth) });
+            }
+            if (ifNode->elseBody != nullptr) {
+                result = std::max(result, depends(*std::get<prism::ElseNode>(ifNode->elseBody->node).children, depth));
+            }
+            return result;
+        }
+        if (auto forNode = std::get_if<prism::ForNode>(&node.node)) {
+            return std::max(depends(forNode->program, depth), depends(*forNode->children, depth));
+        }
+        if (auto decision = std::get_if<prism::DecisionNode>(&node.node)) {
+            return depends(*decision->children, depth);
+        }
+        return INVARIANT;
+    }
+
+    // Index of a new cache entry, forgotten whenever the loop at `level` is entered
+    uint32_t allocate(uint32_t level) {
+        auto index = m_compiled.hoisted++;
+        m_loops[level - 1]->hoisted.push_back(index);
+        return index;
+    }
+
+    void hoist(prism::bytecode::Program& program) {
+        auto depth = (uint32_t) m_loops.size();
+        auto level = depends(program, depth);
+        if (level < depth) {
+            program.hoisted = allocate(level + 1);
+        }
+    }
+
+    void visit(NodeList& nodes, const std::shared_ptr<prism::Node>& parent) {
+        auto depth = (uint32_t) m_loops.size();
+        NodeList out;
+        size_t i = 0;
+        while (i < nodes.size()) {
+            // Longest run of nodes that do not depend on the innermost loop
+            uint32_t level = INVARIANT;
+            size_t end = i;
+            while (end < nodes.size()) {
+                auto node = depends(*nodes[end], depth);
+                if (node >= depth) {
+                    break;
+                }
+                level = std::max(level, node);
+                end++;
+            }
+
+            size_t first = i;
+            size_t last = end;
+            while (first < last && is_neutral(*nodes[first])) {
+                first++;
+            }
+            while (last > first && is_neutral(*nodes[last - 1])) {
+                last--;
+            }
+            if (first < last) {
+                out.insert(out.end(), nodes.begin() + (long) i, nodes.begin() + (long) first);
+                if (last - first == 1 && is_type(nodes[first]->node, prism::VariableNode)) {
+                    // Caching the value is enough
+                    std::get<prism::VariableNode>(nodes[first]->node).program.hoisted = allocate(level + 1);
+                    out.push_back(nodes[first]);
+                } else {
+                    auto block = std::make_shared<prism::Node>(
+                        prism::HoistNode{ std::make_shared<NodeList>(nodes.begin() + (long) first,
+                                                                     nodes.begin() + (long) last),
+                                          allocate(level + 1) },
+                        parent);
+                    block->location = nodes[first]->location;
+                    out.push_back(std::move(block));
+                }
+                out.insert(out.end(), nodes.begin() + (long) last, nodes.begin() + (long) end);
+                i = end;
+                continue;
+            }
+            if (end > i) {
+                out.insert(out.end(), nodes.begin() + (long) i, nodes.begin() + (long) end);
+                i = end;
+                continue;
+            }
+
+            // Depends on the loop, what it evaluates may still not
+            descend(nodes[i]);
+            out.push_back(nodes[i]);
+            i++;
+        }
+        nodes = std::move(out);
+    }
+
+    void descend(const std::shared_ptr<prism::Node>& node) {
+        if (auto ifNode = std::get_if<prism::IfNode>(&node->node)) {
+            hoist(ifNode->program);
+            visit(*ifNode->children, node);
+            for (const auto& elseIf : ifNode->elseIfs) {
+                auto& branch = std::get<prism::ElseIfNode>(elseIf->node);
+                hoist(branch.program);
+                visit(*branch.children, elseIf);
+            }
+            if (ifNode->elseBody != nullptr) {
+                visit(*std::get<prism::ElseNode>(ifNode->elseBody->node).children, ifNode->elseBody);
+            }
+        } else if (auto forNode = std::get_if<prism::ForNode>(&node->node)) {
+            // The iterable is evaluated outside of the loop
+            hoist(forNode->program);
+            m_loops.push_back(forNode);
+            visit(*forNode->children, node);
+            m_loops.pop_back();
+        } else if (auto decision = std::get_if<prism::DecisionNode>(&node->node)) {
+            // The segments point at these nodes, only their values can be cached
+            descend_decision(*decision->children);
+        }
+    }
+
+    void descend_decision(NodeList& nodes) {
+        for (auto& node : nodes) {
+            if (auto var = std::get_if<prism::VariableNode>(&node->node)) {
+                hoist(var->program);
+            } else if (auto ifNode = std::get_if<prism::IfNode>(&node->node)) {
+                descend_decision(*ifNode->children);
+            } else if (auto elseIf = std::get_if<prism::ElseIfNode>(&node->node)) {
+                descend_decision(*elseIf->children);
+            } else if (auto elseNode = std::get_if<prism::ElseNode>(&node->node)) {
+                descend_decision(*elseNode->children);
+            }
+        }
+    }
+
+    prism::CompiledTemplate& m_compiled;
+    // Loop depth of every loop variable slot, 0 for globals
+    std::vector<uint32_t> m_depth;
+    std::vector<bool> m_assigned;
+    // Enclosing loops, innermost last
+    std::vector<prism::ForNode*> m_loops;
+};
+} // namespace
+
+void prism::hoist::compile(CompiledTemplate& compiled) {
+    Hoister(compiled).run();
+}
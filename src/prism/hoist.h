@@ -0,0 +1,14 @@
+#pragma once
+
+namespace prism {
+struct CompiledTemplate;
+} // namespace prism
+
+namespace prism::hoist {
+// Finds what the body of every @for computes the same way on each iteration:
+// nodes that read neither the loop variable nor anything assigned by the
+// template and call no native. Runs of such nodes become hoist nodes whose
+// output is rendered once per entry of the loop; expressions of the other
+// nodes that qualify on their own get their value cached the same way.
+void compile(CompiledTemplate& compiled);
+} // namespace prism::hoist
@@ -0,0 +1,47 @@
+#include "include_cache.h"
+
+prism::IncludeUnit::~IncludeUnit() {
+    // Nodes keep a strong reference to their parent, break the cycles
+    delete_node(root);
+}
+
+std::shared_ptr<const prism::IncludeUnit> prism::IncludeCache::find(const std::string& path) {
+    std::lock_guard lock(m_mutex);
+    auto found = m_paths.find(path);
+    return found != m_paths.end() ? found->second : nullptr;
+}
+
+std::shared_ptr<const prism::IncludeUnit> prism::IncludeCache::find_content(uint64_t hash) {
+    std::lock_guard lock(m_mutex);
+    auto found = m_contents.find(hash);
+    if (found == m_contents.end()) {
+        return nullptr;
+    }
+    auto unit = found->second.lock();
+    if (unit == nullptr) {
+        m_contents.erase(found);
+    }
+    return unit;
+}
+
+void prism::IncludeCache::insert(const std::string& path, std::shared_ptr<const IncludeUnit> unit) {
+    std::lock_guard lock(m_mutex);
+    m_contents[unit->hash] = unit;
+    m_paths[path] = std::move(unit);
+}
+
+void prism::IncludeCache::invalidate(const std::string& path) {
+    std::lock_guard lock(m_mutex);
+    m_paths.erase(path);
+}
+
+void prism::IncludeCache::clear() {
+    std::lock_guard lock(m_mutex);
+    m_paths.clear();
+    m_contents.clear();
+}
+
+size_t prism::IncludeCache::size() {
+    std::lock_guard lock(m_mutex);
+    return m_paths.size();
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <mutex>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+
+#include "processor.h"
+
+namespace prism {
+// An included file parsed on its own. The tree does not depend on where the
+// file gets included: expressions are parsed but not bound to slots and
+// nested includes are left as IncludeNodes, both are resolved every time
+// the unit is linked into a template.
+struct IncludeUnit {
+    // Of the file contents, header included
+    uint64_t hash = 0;
+    // The body, header stripped; path is the one it was first loaded from
+    SourceBuffer source;
+    std::shared_ptr<Node> root;
+    std::unique_ptr<ast::Arena> arena;
+
+    ~IncludeUnit();
+};
+
+// Parsed includes by path and by content hash, so each version of a file is
+// parsed once and files with the same contents share a parse. Processors
+// still read the file on every include and only reuse a unit while its hash
+// matches. Units are immutable once stored and can be shared by any number
+// of processors.
+class IncludeCache {
+  public:
+    std::shared_ptr<const IncludeUnit> find(const std::string& path);
+    std::shared_ptr<const IncludeUnit> find_content(uint64_t hash);
+    void insert(const std::string& path, std::shared_ptr<const IncludeUnit> unit);
+    // Drops the path, the next include loads it again
+    void invalidate(const std::string& path);
+    void clear();
+    size_t size();
+
+  private:
+    std::mutex m_mutex;
+    std::unordered_map<std::string, std::shared_ptr<const IncludeUnit>> m_paths;
+    std::unordered_map<uint64_t, std::weak_ptr<const IncludeUnit>> m_contents;
+};
+} // namespace prism
@@ -0,0 +1,140 @@
+#include "jobs.h"
+
+#include <algorithm>
+#include <exception>
+#include "utils/trace.h"
+
+prism::ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) {
+        threads = 1;
+    }
+    for (size_t i = 0; i < threads; i++) {
+        m_queues.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i < threads; i++) {
+        m_threads.emplace_back([this, i] { worker(i); });
+    }
+}
+
+prism::ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void prism::ThreadPool::push(std::function<void()> task) {
+    auto& queue = *m_queues[m_next.fetch_add(1, std::memory_order_relaxed) % m_queues.size()];
+    {
+        std::lock_guard lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard lock(m_mutex);
+        m_queued++;
+    }
+    m_wake.notify_one();
+}
+
+bool prism::ThreadPool::run_one(size_t self) {
+    std::function<void()> task;
+    auto count = m_queues.size();
+    for (size_t i = 0; i < count && !task; i++) {
+        auto index = (self + i) % count;
+        auto& queue = *m_queues[index];
+        std::lock_guard lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        if (index == self) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+    }
+    if (!task) {
+        return false;
+    }
+    {
+        std::lock_guard lock(m_mutex);
+        m_queued--;
+    }
+    task();
+    return true;
+}
+
+void prism::ThreadPool::worker(size_t index) {
+    PRISM_TRACE_THREAD("prism worker " + std::to_string(index));
+    while (true) {
+        if (run_one(index)) {
+            continue;
+        }
+        std::unique_lock lock(m_mutex);
+        m_wake.wait(lock, [this] { return m_stop || m_queued > 0; });
+        if (m_stop && m_queued == 0) {
+            return;
+        }
+    }
+}
+
+void prism::ThreadPool::parallel_for(size_t count, const std::function<void(size_t)>& job) {
+    if (count == 0) {
+        return;
+    }
+
+    struct Batch {
+        std::atomic<size_t> remaining;
+        std::mutex mutex;
+        std::condition_variable done;
+        std::exception_ptr error;
+    } batch;
+
+    // A few chunks per worker leaves room for stealing without paying a task per item
+    auto chunk = std::max<size_t>(1, count / (m_queues.size() * 4));
+    auto chunks = (count + chunk - 1) / chunk;
+    batch.remaining = chunks;
+    for (size_t start = 0; start < count; start += chunk) {
+        auto end = std::min(count, start + chunk);
+        push([&batch, &job, start, end] {
+            std::exception_ptr error;
+            try {
+                for (auto i = start; i < end; i++) {
+                    job(i);
+                }
+            } catch (...) {
+                error = std::current_exception();
+            }
+            // Under the lock: the caller may destroy the batch as soon as it sees zero
+            std::lock_guard lock(batch.mutex);
+            if (error && !batch.error) {
+                batch.error = error;
+            }
+            if (--batch.remaining == 0) {
+                batch.done.notify_all();
+            }
+        });
+    }
+
+    // Help instead of blocking until the queues run dry, then wait for the
+    // chunks still running elsewhere
+    auto self = m_next.load(std::memory_order_relaxed) % m_queues.size();
+    while (batch.remaining.load() > 0 && run_one(self)) {
+    }
+    std::unique_lock lock(batch.mutex);
+    batch.done.wait(lock, [&batch] { return batch.remaining.load() == 0; });
+
+    if (batch.error) {
+        std::rethrow_exception(batch.error);
+    }
+}
+
+prism::JobSystem& prism::default_job_system() {
+    static ThreadPool pool;
+    return pool;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+namespace prism {
+// Where batch work runs. Hosts with a job system of their own implement
+// this to keep prism off extra threads.
+class JobSystem {
+  public:
+    virtual ~JobSystem() = default;
+    // Runs job(i) for every i in [0, count), returns once all of them are
+    // done and rethrows the first exception a job threw
+    virtual void parallel_for(size_t count, const std::function<void(size_t)>& job) = 0;
+};
+
+// Work-stealing pool. Each worker pops from the back of its own queue and
+// steals from the front of the others once it runs dry; the thread calling
+// parallel_for helps out until its jobs are done.
+class ThreadPool : public JobSystem {
+  public:
+    explicit ThreadPool(size_t threads = std::thread::hardware_concurrency());
+    ~ThreadPool() override;
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void parallel_for(size_t count, const std::function<void(size_t)>& job) override;
+    size_t size() const {
+        return m_threads.size();
+    }
+
+  private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void push(std::function<void()> task);
+    // Runs one task from queue `self` or stolen from another, false if all are empty
+    bool run_one(size_t self);
+    void worker(size_t index);
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    size_t m_queued = 0;
+    bool m_stop = false;
+    std::atomic<size_t> m_next{ 0 };
+};
+
+// Process-wide pool used when no job system is given
+JobSystem& default_job_system();
+} // namespace prism
@@ -1,166 +1,164 @@
 #include "lexer.h"
+
+#include <charconv>
+#include <cstdlib>
 #include "utils/exceptions.h"
 
-bool isKeyWord(const std::string& input, size_t pos) {
-    return input.substr(pos, 2) != "in" && input.substr(pos, 2) != "if" && input.substr(pos, 4) != "else" &&
-           input.substr(pos, 6) != "elseif" && input.substr(pos, 4) != "then" && input.substr(pos, 4) != "true" &&
-           input.substr(pos, 5) != "false";
+// Keywords are told apart by their first character and length, so an
+// identifier costs at most one comparison against a single candidate.
+prism::lexer::TokenType prism::lexer::keyword(std::string_view word) {
+    switch (word[0]) {
+        case 'i':
+            if (word == "in") {
+                return TokenType::In;
+            }
+            if (word == "if") {
+                return TokenType::If;
+            }
+            break;
+        case 'e':
+            if (word.size() == 4 && word == "else") {
+                return TokenType::Else;
+            }
+            if (word.size() == 6 && word == "elseif") {
+                return TokenType::Elseif;
+            }
+            break;
+        case 't':
+            if (word.size() == 4 && word == "then") {
+                return TokenType::Then;
+            }
+            if (word.size() == 4 && word == "true") {
+                return TokenType::True;
+            }
+            break;
+        case 'f':
+            if (word.size() == 5 && word == "false") {
+                return TokenType::False;
+            }
+            break;
+    }
+    return TokenType::Identifier;
+}
+
+int prism::lexer::parse_int(std::string_view value) {
+    int result = 0;
+    auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+    if (error != std::errc() || end != value.data() + value.size()) {
+        throw prism::SyntaxError("Invalid integer " + std::string(value));
+    }
+    return result;
+}
+
+float prism::lexer::parse_float(std::string_view value) {
+    float result = 0.0f;
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+    if (error != std::errc() || end != value.data() + value.size()) {
+        throw prism::SyntaxError("Invalid float " + std::string(value));
+    }
+#else
+    // Standard libraries without floating point from_chars
+    char buffer[64];
+    if (value.size() >= sizeof(buffer)) {
+        throw prism::SyntaxError("Invalid float " + std::string(value));
+    }
+    std::copy(value.begin(), value.end(), buffer);
+    buffer[value.size()] = '\0';
+    result = std::strtof(buffer, nullptr);
+#endif
+    return result;
 }
 
 std::vector<prism::lexer::Token> prism::lexer::Lexer::tokenize() {
     std::vector<prism::lexer::Token> tokens;
-    bool inString = false;
-    std::string currentString;
 
     while (pos < input.size()) {
         char current = input[pos];
-        if (inString) {
-            if (current == '"') {
-                tokens.emplace_back(TokenType::Quote, currentString);
-                currentString.clear();
-                inString = false;
-            } else {
-                currentString += current;
-            }
-            pos++;
-            continue;
-        }
         if (std::isspace(current)) {
             pos++; // Skip whitespace
             continue;
         }
 
-        if (isKeyWord(input, pos) && std::isalpha(current) || current == '_') {
-            tokens.emplace_back(TokenType::Identifier, parseIdentifier());
+        if (std::isalpha(current) || current == '_') {
+            auto word = parseIdentifier();
+            tokens.emplace_back(keyword(word), word);
             continue;
         }
 
         if (std::isdigit(current)) {
             bool hasDecimal = false;
-            if (input.substr(pos + 1, 2) == "..") {
-                auto result = parseNumber(nullptr);
-                tokens.emplace_back(TokenType::Integer, result);
-            } else {
-                auto result = parseNumber(&hasDecimal);
-                tokens.emplace_back(hasDecimal ? TokenType::Float : TokenType::Integer, result);
-            }
+            auto result = parseNumber(&hasDecimal);
+            tokens.emplace_back(hasDecimal ? TokenType::Float : TokenType::Integer, result);
             continue;
         }
 
         switch (current) {
             case '(':
-                tokens.emplace_back(TokenType::LParen, "(");
-                pos++;
+                tokens.emplace_back(TokenType::LParen, input.substr(pos++, 1));
                 break;
             case ')':
-                tokens.emplace_back(TokenType::RParen, ")");
-                pos++;
+                tokens.emplace_back(TokenType::RParen, input.substr(pos++, 1));
                 break;
             case ',':
-                tokens.emplace_back(TokenType::Comma, ",");
-                pos++;
+                tokens.emplace_back(TokenType::Comma, input.substr(pos++, 1));
                 break;
             case '[':
-                tokens.emplace_back(TokenType::LBracket, "[");
-                pos++;
+                tokens.emplace_back(TokenType::LBracket, input.substr(pos++, 1));
                 break;
             case ']':
-                tokens.emplace_back(TokenType::RBracket, "]");
-                pos++;
+                tokens.emplace_back(TokenType::RBracket, input.substr(pos++, 1));
                 break;
             case '!':
-                tokens.emplace_back(TokenType::Not, "!");
-                pos++;
+                tokens.emplace_back(TokenType::Not, input.substr(pos++, 1));
                 break;
-            case '"':
-                pos++;
-                inString = true;
+            case '"': {
+                auto start = ++pos;
+                auto end = input.find('"', start);
+                if (end == std::string_view::npos) {
+                    throw prism::SyntaxError("Unterminated string");
+                }
+                tokens.emplace_back(TokenType::Quote, input.substr(start, end - start));
+                pos = end + 1;
                 break;
+            }
             case '|':
-                if (peek() == '|') {
-                    tokens.emplace_back(TokenType::Or, "||");
-                    pos += 2;
+                if (peek() != '|') {
+                    throw prism::SyntaxError("Unexpected character |");
                 }
+                tokens.emplace_back(TokenType::Or, input.substr(pos, 2));
+                pos += 2;
                 break;
             case '&':
-                if (peek() == '&') {
-                    tokens.emplace_back(TokenType::And, "&&");
-                    pos += 2;
+                if (peek() != '&') {
+                    throw prism::SyntaxError("Unexpected character &");
                 }
+                tokens.emplace_back(TokenType::And, input.substr(pos, 2));
+                pos += 2;
                 break;
             case '=':
                 if (peek() == '=') {
-                    tokens.emplace_back(TokenType::Equal, "==");
+                    tokens.emplace_back(TokenType::Equal, input.substr(pos, 2));
                     pos += 2;
                 } else {
-                    tokens.emplace_back(TokenType::Assign, "=");
-                    pos++;
+                    tokens.emplace_back(TokenType::Assign, input.substr(pos++, 1));
                 }
                 break;
             case '+':
-                tokens.emplace_back(TokenType::Add, "+");
-                pos++;
+                tokens.emplace_back(TokenType::Add, input.substr(pos++, 1));
                 break;
             case '-':
-                tokens.emplace_back(TokenType::Sub, "-");
-                pos++;
+                tokens.emplace_back(TokenType::Sub, input.substr(pos++, 1));
                 break;
             case '*':
-                tokens.emplace_back(TokenType::Mul, "*");
-                pos++;
+                tokens.emplace_back(TokenType::Mul, input.substr(pos++, 1));
                 break;
             case '/':
-                tokens.emplace_back(TokenType::Div, "/");
-                pos++;
-                break;
-            case 'i':
-                if (peek() == 'n' && input.substr(pos, 7) != "include") {
-                    tokens.emplace_back(TokenType::In, "in");
-                    pos += 2;
-                } else if (peek() == 'f') {
-                    tokens.emplace_back(TokenType::If, "if");
-                    pos += 2;
-                } else {
-                    tokens.emplace_back(TokenType::Identifier, parseIdentifier());
-                }
-                break;
-            case 'e':
-                if (peek() == 'l') {
-                    if (input.substr(pos, 4) == "else") {
-                        tokens.emplace_back(TokenType::Else, "else");
-                        pos += 4;
-                    } else if (input.substr(pos, 6) == "elseif") {
-                        tokens.emplace_back(TokenType::Elseif, "elseif");
-                        pos += 6;
-                    } else {
-                        tokens.emplace_back(TokenType::Identifier, parseIdentifier());
-                    }
-                } else {
-                    tokens.emplace_back(TokenType::Identifier, parseIdentifier());
-                }
-                break;
-            case 't':
-                if (input.substr(pos, 4) == "then") {
-                    tokens.emplace_back(TokenType::Then, "then");
-                    pos += 4;
-                } else if (input.substr(pos, 4) == "true") {
-                    tokens.emplace_back(TokenType::True, "true");
-                    pos += 4;
-                } else {
-                    tokens.emplace_back(TokenType::Identifier, parseIdentifier());
-                }
-                break;
-            case 'f':
-                if (input.substr(pos, 5) == "false") {
-                    tokens.emplace_back(TokenType::False, "false");
-                    pos += 5;
-                } else {
-                    tokens.emplace_back(TokenType::Identifier, parseIdentifier());
-                }
+                tokens.emplace_back(TokenType::Div, input.substr(pos++, 1));
                 break;
             case '.':
                 if (peek() == '.') {
-                    tokens.emplace_back(TokenType::Range, "..");
+                    tokens.emplace_back(TokenType::Range, input.substr(pos, 2));
                     pos += 2;
                 } else {
                     throw prism::SyntaxError("Unexpected character " + std::string(1, current));
@@ -182,7 +180,7 @@ char prism::lexer::Lexer::peek() const {
     return (pos + 1 < input.size()) ? input[pos + 1] : '\0';
 }
 
-std::string prism::lexer::Lexer::parseIdentifier() {
+std::string_view prism::lexer::Lexer::parseIdentifier() {
     size_t start = pos;
     while (pos < input.size() && (std::isalnum(input[pos]) || input[pos] == '_')) {
         pos++;
@@ -190,7 +188,7 @@ std::string prism::lexer::Lexer::parseIdentifier() {
     return input.substr(start, pos - start);
 }
 
-std::string prism::lexer::Lexer::parseNumber(bool* hasDecimalPoint) {
+std::string_view prism::lexer::Lexer::parseNumber(bool* hasDecimalPoint) {
     size_t start = pos;
 
     while (pos < input.size()) {
@@ -199,10 +197,8 @@ std::string prism::lexer::Lexer::parseNumber(bool* hasDecimalPoint) {
         // If it's a digit, we continue parsing
         if (std::isdigit(currentChar)) {
             pos++;
-        } else if (currentChar == '.' && hasDecimalPoint != nullptr) {
-            if ((*hasDecimalPoint)) {
-                break;
-            }
+        } else if (currentChar == '.' && peek() != '.' && !(*hasDecimalPoint)) {
+            // A second dot starts a range (0..2), not a fraction
             (*hasDecimalPoint) = true;
             pos++;
         } else {
@@ -3,6 +3,7 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <string_view>
 
 namespace prism::lexer {
 enum class TokenType {
@@ -35,21 +36,22 @@ enum class TokenType {
     EndOfinput // End of script
 };
 
+// Tokens are views into the lexed text, which has to outlive them
 struct Token {
     TokenType type;
-    std::string value;
+    std::string_view value;
 
-    Token(TokenType type, std::string value = "") : type(type), value(std::move(value)) {
+    Token(TokenType type, std::string_view value = {}) : type(type), value(value) {
     }
 };
 
 class Lexer {
   private:
-    std::string input;
+    std::string_view input;
     size_t pos = 0;
 
   public:
-    explicit Lexer(std::string text) : input(text) {
+    explicit Lexer(std::string_view text) : input(text) {
     }
     std::vector<Token> tokenize();
     size_t length() {
@@ -58,7 +60,11 @@ class Lexer {
 
   private:
     [[nodiscard]] char peek() const;
-    std::string parseIdentifier();
-    std::string parseNumber(bool* hasDecimalPoint);
+    std::string_view parseIdentifier();
+    std::string_view parseNumber(bool* hasDecimalPoint);
 };
+
+TokenType keyword(std::string_view word);
+int parse_int(std::string_view value);
+float parse_float(std::string_view value);
 } // namespace prism::lexer
\ No newline at end of file
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "value.h"
+#include "utils/exceptions.h"
+
+namespace prism {
+namespace native {
+// How a parameter of a native is filled. Most take the next argument of the
+// call; ContextItems& gets the render's context and a pointer the user data.
+template <typename T> struct Param;
+
+template <> struct Param<int> {
+    static constexpr bool argument = true;
+    static int get(NativeCall& call, const Native&, size_t index) {
+        const auto& value = call.args[index];
+        if (value.type != Value::Int) {
+            throw SyntaxError("Argument " + std::to_string(index + 1) + " of native call is not an int");
+        }
+        return value.i;
+    }
+};
+
+template <> struct Param<float> {
+    static constexpr bool argument = true;
+    static float get(NativeCall& call, const Native&, size_t index) {
+        const auto& value = call.args[index];
+        if (value.type == Value::Int) {
+            return (float) value.i;
+        }
+        if (value.type != Value::Float) {
+            throw SyntaxError("Argument " + std::to_string(index + 1) + " of native call is not a number");
+        }
+        return value.f;
+    }
+};
+
+// Conditions are true when they are the int 1, so are bool arguments
+template <> struct Param<bool> {
+    static constexpr bool argument = true;
+    static bool get(NativeCall& call, const Native&, size_t index) {
+        return call.args[index].is_true();
+    }
+};
+
+template <> struct Param<std::string> {
+    static constexpr bool argument = true;
+    static const std::string& get(NativeCall& call, const Native&, size_t index) {
+        const auto& value = call.args[index];
+        if (value.type != Value::String) {
+            throw SyntaxError("Argument " + std::to_string(index + 1) + " of native call is not a string");
+        }
+        return *value.str;
+    }
+};
+
+template <> struct Param<std::string_view> {
+    static constexpr bool argument = true;
+    static std::string_view get(NativeCall& call, const Native& self, size_t index) {
+        return Param<std::string>::get(call, self, index);
+    }
+};
+
+template <typename T> struct Param<MTDArray<T>> {
+    static constexpr bool argument = true;
+    static const MTDArray<T>& get(NativeCall& call, const Native&, size_t index) {
+        const auto& value = call.args[index];
+        if (value.type != Value::Array || !std::holds_alternative<MTDArray<T>>(*value.boxed)) {
+            throw SyntaxError("Argument " + std::to_string(index + 1) + " of native call has the wrong array type");
+        }
+        return std::get<MTDArray<T>>(*value.boxed);
+    }
+};
+
+// Any value, copied out of the evaluator
+template <> struct Param<ContextTypes> {
+    static constexpr bool argument = true;
+    static ContextTypes get(NativeCall& call, const Native&, size_t index) {
+        return to_context(call.args[index]);
+    }
+};
+
+template <> struct Param<ContextItems> {
+    static constexpr bool argument = false;
+    static ContextItems& get(NativeCall& call, const Native&, size_t) {
+        return call.items;
+    }
+};
+
+template <typename D> struct Param<D*> {
+    static constexpr bool argument = false;
+    static D* get(NativeCall&, const Native& self, size_t) {
+        return (D*) self.data;
+    }
+};
+
+template <typename T> using ParamOf = Param<std::remove_cvref_t<T>>;
+
+// Index into the call's arguments of every parameter
+template <typename... Args> constexpr std::array<size_t, sizeof...(Args)> argument_indices() {
+    constexpr bool takes[] = { ParamOf<Args>::argument..., false };
+    std::array<size_t, sizeof...(Args)> indices{};
+    size_t next = 0;
+    for (size_t i = 0; i < sizeof...(Args); i++) {
+        indices[i] = next;
+        next += takes[i] ? 1 : 0;
+    }
+    return indices;
+}
+
+template <typename... Args> constexpr size_t argument_count() {
+    return (size_t(ParamOf<Args>::argument) + ... + 0);
+}
+
+template <typename R> ContextTypes to_value(R&& value) {
+    using T = std::remove_cvref_t<R>;
+    if constexpr (std::is_same_v<T, bool>) {
+        return value ? 1 : 0;
+    } else if constexpr (std::is_same_v<T, const char*> || std::is_same_v<T, char*>) {
+        return std::string(value);
+    } else if constexpr (std::is_same_v<T, std::string_view>) {
+        return std::string(value);
+    } else {
+        return ContextTypes{ std::forward<R>(value) };
+    }
+}
+
+template <typename R, typename... Args, size_t... I>
+void dispatch(R (*fn)(Args...), const Native& self, NativeCall& call, std::index_sequence<I...>) {
+    constexpr auto indices = argument_indices<Args...>();
+    if constexpr (std::is_void_v<R>) {
+        fn(ParamOf<Args>::get(call, self, indices[I])...);
+        call.result = Void{};
+    } else {
+        call.result = to_value(fn(ParamOf<Args>::get(call, self, indices[I])...));
+    }
+}
+
+template <typename R, typename... Args> void thunk(const Native& self, NativeCall& call) {
+    constexpr auto count = argument_count<Args...>();
+    if (call.args.size() != count) {
+        throw SyntaxError("Native call takes " + std::to_string(count) + " arguments, got " +
+                          std::to_string(call.args.size()));
+    }
+    dispatch((R(*)(Args...)) self.function, self, call, std::index_sequence_for<Args...>{});
+}
+} // namespace native
+
+// Wraps a function for use as a context entry. Parameters may be int, float,
+// bool, std::string (best taken by const reference), std::string_view,
+// const MTDArray<T>& or ContextTypes for a copy of any value; each takes the
+// next argument of the call. A ContextItems& parameter gets the render's
+// context, whose changes the directives after the call see, and a pointer
+// parameter gets `data`. Arguments are read straight off the evaluator stack
+// and the result is returned by value, so a call allocates nothing beyond
+// what the function itself does.
+template <typename R, typename... Args> Native make_native(R (*fn)(Args...), void* data = nullptr) {
+    constexpr bool context = (std::is_same_v<std::remove_cvref_t<Args>, ContextItems> || ... || false);
+    return Native{ &native::thunk<R, Args...>, (void (*)()) fn, data, context };
+}
+} // namespace prism
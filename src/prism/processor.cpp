@@ -1,20 +1,59 @@
 #include "processor.h"
 
 #include <spdlog/spdlog.h>
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
 #include <sstream>
+#include "cache.h"
+#include "hoist.h"
+#include "include_cache.h"
+#include "render.h"
+#include "store.h"
+#include "utils/mapped_file.h"
 #include "utils/exceptions.h"
 #include "utils/gv.h"
+#include "utils/hash.h"
+#include "utils/trace.h"
+
+char* prism::format_float(char* first, char* last, float v, int precision) {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    return std::to_chars(first, last, v, std::chars_format::general, precision).ptr;
+#else
+    // Standard libraries without floating point to_chars
+    auto size = std::snprintf(first, last - first, "%.*g", precision, v);
+    return first + std::min<ptrdiff_t>(size, last - first);
+#endif
+}
 
 std::string prism::format_float_literal(float v) {
     char buf[64];
-    std::snprintf(buf, sizeof(buf), "%.9g", v);
-    std::string s(buf);
+    auto end = format_float(buf, buf + sizeof(buf), v, 9);
+    std::string s(buf, end);
     if (s.find_first_of(".eE") == std::string::npos) {
         s += ".0";
     }
     return s;
 }
 
+std::string prism::SourceLocation::to_string() const {
+    if (source == nullptr) {
+        return "unknown";
+    }
+    size_t line = source->firstLine;
+    size_t column = 1;
+    for (size_t i = 0; i < offset && i < source->text.size(); i++) {
+        if (source->text[i] == '\n') {
+            line++;
+            column = 1;
+        } else {
+            column++;
+        }
+    }
+    return (source->path.empty() ? std::string("template") : source->path) + ":" + std::to_string(line) + ":" +
+           std::to_string(column);
+}
+
 void prism::Processor::populate(const ContextItems& items) {
     if (CONTAINS(items, "@if")) {
         throw SyntaxError("Reserved keyword if");
@@ -43,24 +82,18 @@ void prism::Processor::populate(const ContextItems& items) {
     m_items = items;
 }
 
-std::string prism::Processor::parse_header(const std::string& data) {
-    std::vector<std::string> m_lines;
-    std::stringstream ss(data);
-    std::string line;
-    std::string result;
-    while (std::getline(ss, line)) {
-        m_lines.push_back(line);
-    }
-
-    if (m_lines.empty()) {
+std::string_view prism::Processor::parse_header(std::string_view data, uint32_t* headerLines) {
+    PRISM_TRACE_SCOPE("parse_header", "load");
+    if (data.empty()) {
         throw RuntimeError("No data to process");
     }
-    
-    if (m_lines[0].rfind("@prism", 0) != 0) {
+    auto lineEnd = data.find('\n');
+    auto line = data.substr(0, lineEnd);
+    if (!line.starts_with("@prism")) {
         throw SyntaxError("Invalid prism file");
     }
 
-    auto header = gv::parenthesis(m_lines[0].substr(6));
+    auto header = gv::parenthesis(std::string(line.substr(6)));
     auto args = gv::il_args(header[0]);
 
     if (!CONTAINS(args, "type")) {
@@ -72,352 +105,72 @@ std::string prism::Processor::parse_header(const std::string& data) {
     auto version = args["version"].value_or("1.0.0");
     auto description = args["description"].value_or("Unknown");
     auto author = args["author"].value_or("Someone very clever");
-    m_lines.erase(m_lines.begin());
-    if (m_lines[0].empty()) {
-        m_lines.erase(m_lines.begin());
+    auto body = lineEnd == std::string_view::npos ? std::string_view() : data.substr(lineEnd + 1);
+    uint32_t lines = 1;
+    // A blank line after the header goes with it
+    if (body.starts_with('\n')) {
+        body.remove_prefix(1);
+        lines++;
     }
-    result = "";
-    for (const auto& n_line : m_lines) {
-        result += n_line + "\n";
+    if (headerLines != nullptr) {
+        *headerLines = lines;
     }
     SPDLOG_DEBUG("Prism script: {} v{} by {}", name, version, author);
-    return result;
-}
-
-void prism::Processor::load(const std::string& data) {
-   m_settings.clear();
-   m_input = parse_header(data);
+    return body;
 }
 
-template <typename T> prism::ContextTypes read_array(prism::Processor* proc, prism::ast::ArrayAccessNode& array) {
-    auto var = proc->getTypes().at(array.name->name);
-    if (!is_type(var, prism::MTDArray<T>)) {
-        throw prism::SyntaxError(array.name->name + " is not an array");
+prism::SourceBuffer prism::Processor::read_source(std::string path, std::string_view data,
+                                                  std::shared_ptr<const void> owner) {
+    uint32_t headerLines = 0;
+    auto body = parse_header(data, &headerLines);
+    SourceBuffer source{ std::move(path), {}, 1 + headerLines, nullptr };
+    // The body reaches the end of `data`, so the byte after it is owned too.
+    // The last line needs a newline like every other one.
+    if (owner != nullptr && (body.empty() || body.back() == '\n')) {
+        source.text = body;
+        source.owner = std::move(owner);
+    } else {
+        std::string text(body);
+        if (!text.empty() && text.back() != '\n') {
+            text += '\n';
+        }
+        source.assign(std::move(text));
     }
-    prism::MTDArray<T> arrayVar = std::get<prism::MTDArray<T>>(var);
-    auto indices = array.arrayIndices;
-    auto length = indices->size();
+    return source;
+}
 
-#define g_idx(x) std::get<int>(proc->evaluate(indices->at(x)))
-    if (arrayVar.dimensions.size() != length) {
-        switch (length) {
-            case 1:
-                return arrayVar.get(g_idx(0));
-            case 2:
-                return arrayVar.get(g_idx(0), g_idx(1));
-            case 3:
-                return arrayVar.get(g_idx(0), g_idx(1), g_idx(2));
-            default:
-                throw prism::SyntaxError("We dont support array indexes bigger than 3");
-        }
-    }
+void prism::Processor::load(const std::string& input) {
+    load(std::string_view(input), nullptr);
+}
 
-    switch (indices->size()) {
-        case 1:
-            return arrayVar.at(g_idx(0));
-        case 2:
-            return arrayVar.at(g_idx(0), g_idx(1));
-        case 3:
-            return arrayVar.at(g_idx(0), g_idx(1), g_idx(2));
-        case 4:
-            return arrayVar.at(g_idx(0), g_idx(1), g_idx(2), g_idx(3));
+void prism::Processor::load(std::shared_ptr<const MappedFile> file) {
+    if (file == nullptr) {
+        throw RuntimeError("No data to process");
     }
-#undef g_idx
-    throw prism::SyntaxError("We dont support array indexes bigger than 4");
+    auto data = file->view();
+    load(data, std::move(file));
 }
 
-prism::ContextTypes prism::Processor::evaluate(const std::shared_ptr<prism::ast::ASTNode>& node) {
-    if (!node)
-        return false;
-    if (is_type(node->node, prism::ast::VariableNode)) {
-        auto var = std::get<prism::ast::VariableNode>(node->node);
-        if (!CONTAINS(this->m_items, var.name)) {
-            throw SyntaxError("Unknown variable " + var.name);
-        }
-        auto value = this->m_items.at(var.name);
-        if (is_type(value, int)) {
-            return std::get<int>(value);
-        }
-        if (is_type(value, float)) {
-            return std::get<float>(value);
-        }
-        if (is_type(value, std::string)) {
-            return std::get<std::string>(value);
-        }
-        if (is_type(value, MTDArray<bool>)) {
-            return std::get<MTDArray<bool>>(value);
-        }
-        if (is_type(value, MTDArray<int>)) {
-            return std::get<MTDArray<int>>(value);
-        }
-        if (is_type(value, MTDArray<float>)) {
-            return std::get<MTDArray<float>>(value);
-        }
-        throw SyntaxError("Unsupported type");
-    } else if (is_type(node->node, prism::ast::IntegerNode)) {
-        return std::get<prism::ast::IntegerNode>(node->node).value;
-    } else if (is_type(node->node, prism::ast::FloatNode)) {
-        return std::get<prism::ast::FloatNode>(node->node).value;
-    } else if (is_type(node->node, prism::ast::ArrayAccessNode)) {
-        auto array = std::get<prism::ast::ArrayAccessNode>(node->node);
-        if (!CONTAINS(this->m_items, array.name->name)) {
-            throw SyntaxError("Unknown variable " + array.name->name);
-        }
-        auto var = this->m_items.at(array.name->name);
-        if (is_type(var, MTDArray<bool>)) {
-            return read_array<bool>(this, array);
-        }
-        if (is_type(var, MTDArray<int>)) {
-            return read_array<int>(this, array);
-        }
-        if (is_type(var, MTDArray<float>)) {
-            return read_array<float>(this, array);
-        }
-
-        throw SyntaxError("Invalid array access");
-    } else if (is_type(node->node, prism::ast::InNode)) {
-        auto inNode = std::get<prism::ast::InNode>(node->node);
-        auto var = std::get<prism::ast::VariableNode>(inNode.left->node);
-        auto result = evaluate(inNode.right);
-        if (is_type(result, int) || is_type(result, float)) {
-            throw SyntaxError("Invalid IN operation");
-        }
-        if (is_type(result, MTDArray<int>)) {
-            return ForContext{ var.name, std::get<MTDArray<int>>(result) };
-        }
-        if (is_type(result, MTDArray<float>)) {
-            return ForContext{ var.name, std::get<MTDArray<float>>(result) };
-        }
-        if (is_type(result, MTDArray<bool>)) {
-            return ForContext{ var.name, std::get<MTDArray<bool>>(result) };
-        }
-        if (is_type(result, GeneratedRange)) {
-            return ForContext{ var.name, std::get<GeneratedRange>(result) };
-        }
-        throw SyntaxError("Invalid IN operation");
-    } else if (is_type(node->node, prism::ast::NotNode)) {
-        auto notNode = std::get<prism::ast::NotNode>(node->node);
-        auto value = evaluate(notNode.node);
-        if (is_type(value, int)) {
-            return std::get<int>(value) == 0;
-        }
-        throw SyntaxError("Invalid NOT operation");
-    } else if (is_type(node->node, prism::ast::AssignNode)) {
-        auto assignNode = std::get<prism::ast::AssignNode>(node->node);
-        auto value = evaluate(assignNode.value);
-        if (is_type(value, GeneratedRange) || is_type(value, std::string) || is_type(value, ForContext)) {
-            throw SyntaxError("Invalid assign operation");
-        }
-        this->m_items[assignNode.name.name] = prism::ContextTypes{ value };
-        return Void{};
-    } else if (is_type(node->node, prism::ast::OrNode)) {
-        auto orNode = std::get<prism::ast::OrNode>(node->node);
-        auto left = evaluate(orNode.left);
-        auto right = evaluate(orNode.right);
-        bool resLeft = false;
-        bool resRight = false;
-        
-        if (is_type(left, int)) {
-            resLeft = std::get<int>(left) == 1;
-        }
-        
-        if (is_type(right, int)) {
-            resRight = std::get<int>(right) == 1;
-        }
-        
-        if (is_type(left, float) || is_type(right, float)) {
-            throw SyntaxError("Invalid AND operation, float are not supported");
-        }
-        
-        return resLeft || resRight;
-    } else if (is_type(node->node, prism::ast::AndNode)) {
-        auto andNode = std::get<prism::ast::AndNode>(node->node);
-        auto left = evaluate(andNode.left);
-        auto right = evaluate(andNode.right);
-        bool resLeft = false;
-        bool resRight = false;
-        
-        if (is_type(left, int)) {
-            resLeft = std::get<int>(left) == 1;
-        }
-        
-        if (is_type(right, int)) {
-            resRight = std::get<int>(right) == 1;
-        }
-        
-        if (is_type(left, float) || is_type(right, float)) {
-            throw SyntaxError("Invalid AND operation, float are not supported");
-        }
-        return resLeft && resRight;
-    } else if (is_type(node->node, prism::ast::EqualNode)) {
-        auto equalNode = std::get<prism::ast::EqualNode>(node->node);
-        auto left = evaluate(equalNode.left);
-        auto right = evaluate(equalNode.right);
-
-        if (is_type(left, int) && is_type(right, int)) {
-            return std::get<int>(left) == std::get<int>(right);
-        }
-
-        if (is_type(left, float) && is_type(right, float)) {
-            return std::get<float>(left) == std::get<float>(right);
-        }
-
-        throw SyntaxError("Invalid EQUAL operation");
-    } else if (is_type(node->node, prism::ast::AddNode)) {
-        auto addNode = std::get<prism::ast::AddNode>(node->node);
-        auto left = evaluate(addNode.left);
-        auto right = evaluate(addNode.right);
-
-        if (is_type(left, int) && is_type(right, int)) {
-            return std::get<int>(left) + std::get<int>(right);
-        }
-
-        if (is_type(left, float) && is_type(right, float)) {
-            return std::get<float>(left) + std::get<float>(right);
-        }
-
-        if (is_type(left, float) && is_type(right, int)) {
-            return std::get<float>(left) + std::get<int>(right);
-        }
-
-        if (is_type(left, int) && is_type(right, float)) {
-            return std::get<int>(left) + std::get<float>(right);
-        }
-
-        if (is_type(left, std::string) && is_type(right, std::string)) {
-            return std::get<std::string>(left) + std::get<std::string>(right);
-        }
-
-        throw SyntaxError("Invalid ADD operation");
-    } else if (is_type(node->node, prism::ast::SubNode)) {
-        auto subNode = std::get<prism::ast::SubNode>(node->node);
-        auto left = evaluate(subNode.left);
-        auto right = evaluate(subNode.right);
-
-        if (is_type(left, int) && is_type(right, int)) {
-            return std::get<int>(left) - std::get<int>(right);
-        }
-
-        if (is_type(left, float) && is_type(right, float)) {
-            return std::get<float>(left) - std::get<float>(right);
-        }
-
-        if (is_type(left, float) && is_type(right, int)) {
-            return std::get<float>(left) - std::get<int>(right);
-        }
-
-        if (is_type(left, int) && is_type(right, float)) {
-            return std::get<int>(left) - std::get<float>(right);
-        }
-
-        throw SyntaxError("Invalid SUB operation");
-    } else if (is_type(node->node, prism::ast::MulNode)) {
-        auto mulNode = std::get<prism::ast::MulNode>(node->node);
-        auto left = evaluate(mulNode.left);
-        auto right = evaluate(mulNode.right);
-
-        if (is_type(left, int) && is_type(right, int)) {
-            return std::get<int>(left) * std::get<int>(right);
-        }
-
-        if (is_type(left, float) && is_type(right, float)) {
-            return std::get<float>(left) * std::get<float>(right);
-        }
-
-        if (is_type(left, float) && is_type(right, int)) {
-            return std::get<float>(left) * std::get<int>(right);
-        }
-
-        if (is_type(left, int) && is_type(right, float)) {
-            return std::get<int>(left) * std::get<float>(right);
-        }
-
-        throw SyntaxError("Invalid MUL operation");
-    } else if (is_type(node->node, prism::ast::DivNode)) {
-        auto mulNode = std::get<prism::ast::DivNode>(node->node);
-        auto left = evaluate(mulNode.left);
-        auto right = evaluate(mulNode.right);
-
-        if (is_type(left, int) && is_type(right, int)) {
-            return std::get<int>(left) / std::get<int>(right);
-        }
-
-        if (is_type(left, float) && is_type(right, float)) {
-            return std::get<float>(left) / std::get<float>(right);
+void prism::Processor::load(std::string_view data, std::shared_ptr<const void> owner) {
+    PRISM_TRACE_SCOPE("load", "load");
+    if (m_store != nullptr) {
+        PRISM_TRACE_SCOPE("store_find", "io");
+        auto stored = m_store->find(data);
+        if (stored != nullptr && includes_unchanged(*stored)) {
+            m_template = std::move(stored);
+            return;
         }
-
-        if (is_type(left, float) && is_type(right, int)) {
-            return std::get<float>(left) / std::get<int>(right);
-        }
-
-        if (is_type(left, int) && is_type(right, float)) {
-            return std::get<int>(left) / std::get<float>(right);
-        }
-
-        throw SyntaxError("Invalid MUL operation");
-    } else if (is_type(node->node, prism::ast::RangeNode)) {
-        auto rangeNode = std::get<prism::ast::RangeNode>(node->node);
-        auto start = evaluate(rangeNode.left);
-        auto end = evaluate(rangeNode.right);
-        if (!is_type(start, int) || !is_type(end, int)) {
-            throw SyntaxError("Invalid range");
-        }
-
-        return prism::GeneratedRange{ (size_t) std::get<int>(start), (size_t) std::get<int>(end) };
-    } else if (is_type(node->node, prism::ast::IfNode)) {
-        auto ifNode = std::get<prism::ast::IfNode>(node->node);
-        auto condition = evaluate(ifNode.condition);
-        if ((is_type(condition, int) && std::get<int>(condition) == 1)) {
-            return evaluate(ifNode.body);
-        } else if (!ifNode.elseIfs->empty()) {
-            for (const auto& elseIf : *ifNode.elseIfs) {
-                condition = evaluate(elseIf->condition);
-                if ((is_type(condition, int) && std::get<int>(condition) == 1)) {
-                    return evaluate(elseIf->body);
-                }
-            }
-        }
-
-        if (ifNode.elseBody != nullptr) {
-            return evaluate(ifNode.elseBody);
-        }
-        throw SyntaxError("Invalid IF condition");
-    } else if (is_type(node->node, prism::ast::FunctionCallNode)) {
-        auto func = std::get<prism::ast::FunctionCallNode>(node->node);
-        if (CONTAINS(m_items, func.name->name)) {
-            auto value = m_items.at(func.name->name);
-            if (is_type(value, InvokeFunc)) {
-                std::vector<uintptr_t> args;
-                args.push_back((uintptr_t) &m_items);
-                for (const auto& arg : *func.args) {
-                    ContextTypes type = evaluate(arg);
-                    args.push_back((uintptr_t) new ContextTypes{ type });
-                }
-                auto ptr = std::get<InvokeFunc>(value);
-                auto raw = invoke(ptr, args.data(), args.size());
-                // erase the first item which is the context items
-                args.erase(args.begin());
-                for (auto& c : args) {
-                    delete (ContextTypes*) c;
-                }
-                args.clear();
-                if (raw != (uintptr_t) nullptr) {
-                    ContextTypes cnv = *((ContextTypes*) raw);
-                    delete (ContextTypes*) raw;
-                    return cnv;
-                } else {
-                    return Void{};
-                }
-            }
-        }
-        throw SyntaxError("Unsupported function call " + func.name->name);
-    } else if (is_type(node->node, prism::ast::QuoteNode)) {
-        return std::get<prism::ast::QuoteNode>(node->node).value;
     }
-    return false;
+    // `data` stays mapped while it is copied
+    auto compiled = compile(read_source("", data, m_copy_sources ? nullptr : std::move(owner)));
+    if (m_store != nullptr && compiled->storable && !m_store->insert(data, *compiled)) {
+        SPDLOG_WARN("Failed to store the compiled template");
+    }
+    m_template = std::move(compiled);
 }
 
-std::string get_parenthesis(std::string::iterator& c, std::string::iterator end) {
+// Returns a view into the template source, valid until it is modified
+std::string_view get_parenthesis(std::string_view::const_iterator& c, std::string_view::const_iterator end) {
     auto start = c;
     int parenthesis = 0;
     while (c != end) {
@@ -436,7 +189,7 @@ std::string get_parenthesis(std::string::iterator& c, std::string::iterator end)
         throw prism::SyntaxError("Unterminated parenthesis");
     }
     c++;
-    return { start, c };
+    return { &*start, (size_t) (c - start) };
 }
 
 static std::vector<std::pair<std::string, std::string>> parse_setting_args(const std::string& inner) {
@@ -480,15 +233,18 @@ static std::vector<std::pair<std::string, std::string>> parse_setting_args(const
     return out;
 }
 
-std::shared_ptr<prism::ast::ASTNode> parse_parenthesis(std::string::iterator& c, std::string::iterator end) {
+prism::ast::ASTNode* parse_parenthesis(std::string_view::const_iterator& c, std::string_view::const_iterator end, prism::ast::Arena& arena) {
     prism::lexer::Lexer eval(get_parenthesis(c, end));
-    auto tokens = eval.tokenize();
-    prism::ast::Parser parser(tokens);
-    auto ast = parser.parse();
-    return ast;
+    auto tokens = [&eval] {
+        PRISM_TRACE_SCOPE("lex", "compile");
+        return eval.tokenize();
+    }();
+    PRISM_TRACE_SCOPE("parse_ast", "compile");
+    prism::ast::Parser parser(std::move(tokens), arena);
+    return parser.parse();
 }
 
-std::string get_accolade(std::string::iterator& c, std::string::iterator end) {
+std::string_view get_accolade(std::string_view::const_iterator& c, std::string_view::const_iterator end) {
     auto start = c + 1;
     int accolade = 0;
     while (c != end) {
@@ -506,20 +262,23 @@ std::string get_accolade(std::string::iterator& c, std::string::iterator end) {
     if (c == end) {
         throw prism::SyntaxError("Unterminated accolade");
     }
-    auto result = std::string(start, c);
+    auto result = std::string_view(&*start, c - start);
     c++;
     return result;
 }
 
-std::shared_ptr<prism::ast::ASTNode> parse_accolade(std::string::iterator& c, std::string::iterator end) {
+prism::ast::ASTNode* parse_accolade(std::string_view::const_iterator& c, std::string_view::const_iterator end, prism::ast::Arena& arena) {
     prism::lexer::Lexer eval(get_accolade(c, end));
-    auto tokens = eval.tokenize();
-    prism::ast::Parser parser(tokens);
-    auto ast = parser.parse();
-    return ast;
+    auto tokens = [&eval] {
+        PRISM_TRACE_SCOPE("lex", "compile");
+        return eval.tokenize();
+    }();
+    PRISM_TRACE_SCOPE("parse_ast", "compile");
+    prism::ast::Parser parser(std::move(tokens), arena);
+    return parser.parse();
 }
 
-std::string get_keyword(std::string::iterator& c, std::string::iterator end) {
+std::string get_keyword(std::string_view::const_iterator& c, std::string_view::const_iterator end) {
     auto start = c;
     char match[] = { 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r',
                      's', 't', 'u', 'v', 'w', 'x', 'y', 'z', 'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J',
@@ -549,8 +308,8 @@ std::shared_ptr<std::vector<std::shared_ptr<prism::Node>>> get_children(const st
     throw prism::SyntaxError("Unsupported node type");
 }
 
-bool is_on_the_same_line(std::string::iterator& c, std::string::iterator end) {
-    while (*c != '\n') {
+bool is_on_the_same_line(std::string_view::const_iterator& c, std::string_view::const_iterator end) {
+    while (c != end && *c != '\n') {
         if (*c == ';') {
             return true;
         }
@@ -559,7 +318,12 @@ bool is_on_the_same_line(std::string::iterator& c, std::string::iterator end) {
     return false;
 }
 
-prism::Node prism::Processor::parse(std::string input) {
+prism::Node prism::Processor::parse(const SourceBuffer& source) {
+    PRISM_TRACE_SCOPE_DETAIL("build_tree", "compile", source.path);
+    const auto& input = source.text;
+    if (m_arena == nullptr) {
+        m_arena = std::make_unique<ast::Arena>();
+    }
     std::shared_ptr<prism::Node> root = std::make_shared<prism::Node>(
         prism::RootNode{ std::make_shared<std::vector<std::shared_ptr<prism::Node>>>() }, nullptr);
     auto current = root;
@@ -570,319 +334,245 @@ prism::Node prism::Processor::parse(std::string input) {
     bool isOnTheSameLine = false;
     int ifCount = 0;
     auto end = input.end();
-    while (c != end) {
-        if (canBeOnTheSameLine) {
-            if (!std::isspace(*c)) {
-                isOnTheSameLine = true;
-            }
-            if (isOnTheSameLine) {
-                if (*c == '\n') {
-                    canBeOnTheSameLine = false;
-                    children->push_back(
-                        std::make_shared<prism::Node>(prism::TextNode{ std::string(previous, c + 1) }, current));
-                    previous = c;
-                    current = current->parent;
-                    children = get_children(current);
+    // Nodes are located at the directive they were parsed from
+    auto directive = c;
+    auto locate = [&] { return SourceLocation{ &source, (uint32_t) (directive - input.begin()) }; };
+    auto make_node = [&](prism::NodeType type, const std::shared_ptr<prism::Node>& parent) {
+        auto node = std::make_shared<prism::Node>(std::move(type), parent);
+        node->location = locate();
+        return node;
+    };
+    auto text = [&](std::string_view::const_iterator from, std::string_view::const_iterator to) {
+        return prism::TextNode{ std::string_view(input.data() + (from - input.begin()), to - from) };
+    };
+    try {
+        while (c != end) {
+            if (canBeOnTheSameLine) {
+                if (!std::isspace(*c)) {
+                    isOnTheSameLine = true;
+                }
+                if (isOnTheSameLine) {
+                    if (*c == '\n') {
+                        canBeOnTheSameLine = false;
+                        children->push_back(
+                            make_node(text(previous, c + 1), current));
+                        previous = c;
+                        current = current->parent;
+                        children = get_children(current);
+                    }
                 }
             }
-        }
-        if (*c == '\n' && canBeOnTheSameLine && !isOnTheSameLine) {
-            isOnTheSameLine = false;
-            canBeOnTheSameLine = false;
-            continue;
-        }
-        if (*c == '@') {
-            children->push_back(std::make_shared<prism::Node>(prism::TextNode{ std::string(previous, c) }, current));
-            c++;
-            if (*c == '{') {
-                auto ast = parse_accolade(c, input.end());
-                children->push_back(std::make_shared<prism::Node>(prism::VariableNode{ ast }, current));
-                previous = c;
-            } else {
-                auto expr = get_keyword(c, input.end());
-                previous = c;
-                if (expr == "if") {
-                    ifCount++;
-                    auto ast = parse_parenthesis(c, input.end());
+            if (*c == '\n' && canBeOnTheSameLine && !isOnTheSameLine) {
+                isOnTheSameLine = false;
+                canBeOnTheSameLine = false;
+                continue;
+            }
+            if (*c == '@') {
+                directive = c;
+                children->push_back(make_node(text(previous, c), current));
+                c++;
+                if (*c == '{') {
+                    auto ast = parse_accolade(c, input.end(), *m_arena);
+                    children->push_back(make_node(prism::VariableNode{ ast, {} }, current));
                     previous = c;
+                } else {
+                    auto expr = get_keyword(c, input.end());
+                    previous = c;
+                    if (expr == "if") {
+                        ifCount++;
+                        auto ast = parse_parenthesis(c, input.end(), *m_arena);
+                        previous = c;
 
-                    children->push_back(std::make_shared<prism::Node>(
-                        prism::IfNode{ ast, std::make_shared<std::vector<std::shared_ptr<prism::Node>>>() }, current));
-                    current = children->back();
-                    children = std::get<prism::IfNode>(current->node).children;
-
-                    canBeOnTheSameLine = true;
-                    isOnTheSameLine = false;
-                    continue;
-                } else if (expr == "else") {
-                    auto ifNode = current;
-                    if (!is_type(ifNode->node, prism::IfNode) && !is_type(ifNode->node, prism::ElseIfNode) ) {
-                        auto previous = children->at(children->size() - 2);
-                        if (!(isOnTheSameLine && (is_type(previous->node, prism::IfNode) || is_type(previous->node, prism::ElseIfNode))) ) {
-                            throw prism::SyntaxError("Else without if");
-                        } else if (isOnTheSameLine && (is_type(previous->node, prism::IfNode) || is_type(previous->node, prism::ElseIfNode))) {
-                            ifNode = previous;
+                        children->push_back(make_node(
+                            prism::IfNode{ ast, std::make_shared<std::vector<std::shared_ptr<prism::Node>>>(), nullptr, {}, {} },
+                            current));
+                        current = children->back();
+                        children = std::get<prism::IfNode>(current->node).children;
+
+                        canBeOnTheSameLine = true;
+                        isOnTheSameLine = false;
+                        continue;
+                    } else if (expr == "else") {
+                        auto ifNode = current;
+                        if (!is_type(ifNode->node, prism::IfNode) && !is_type(ifNode->node, prism::ElseIfNode) ) {
+                            auto previous = children->at(children->size() - 2);
+                            if (!(isOnTheSameLine && (is_type(previous->node, prism::IfNode) || is_type(previous->node, prism::ElseIfNode))) ) {
+                                throw prism::SyntaxError("Else without if");
+                            } else if (isOnTheSameLine && (is_type(previous->node, prism::IfNode) || is_type(previous->node, prism::ElseIfNode))) {
+                                ifNode = previous;
+                            }
                         }
-                    }
 
-                    if (is_type(ifNode->node, prism::ElseIfNode)) {
-                        ifNode = std::get<prism::ElseIfNode>(ifNode->node).parentIf;
-                    }
+                        if (is_type(ifNode->node, prism::ElseIfNode)) {
+                            ifNode = std::get<prism::ElseIfNode>(ifNode->node).parentIf;
+                        }
 
-                    current = ifNode->parent;
-
-                    auto newNode = std::make_shared<prism::Node>(
-                        prism::ElseNode{ std::make_shared<std::vector<std::shared_ptr<prism::Node>>>() }, current);
-
-                    auto ifNodePtr = std::get<prism::IfNode>(ifNode->node);
-                    ifNodePtr.elseBody = newNode;
-                    ifNode->node = ifNodePtr;
-
-                    get_children(current)->push_back(newNode);
-                    current = get_children(current)->back();
-                    children = std::get<prism::ElseNode>(current->node).children;
-
-                    canBeOnTheSameLine = true;
-                    isOnTheSameLine = false;
-                    continue;
-                } else if (expr == "elseif") {
-                    auto ifNode = current;
-                    if (!is_type(ifNode->node, prism::IfNode) && !is_type(ifNode->node, prism::ElseIfNode) ) {
-                        auto previous = children->at(children->size() - 2);
-                        if (!(isOnTheSameLine && (is_type(previous->node, prism::IfNode) || is_type(previous->node, prism::ElseIfNode))) ) {
-                            throw prism::SyntaxError("Else without if");
-                        } else if (isOnTheSameLine && (is_type(previous->node, prism::IfNode) || is_type(previous->node, prism::ElseIfNode))) {
-                            ifNode = previous;
+                        current = ifNode->parent;
+
+                        auto newNode = make_node(
+                            prism::ElseNode{ std::make_shared<std::vector<std::shared_ptr<prism::Node>>>() }, current);
+
+                        auto ifNodePtr = std::get<prism::IfNode>(ifNode->node);
+                        ifNodePtr.elseBody = newNode;
+                        ifNode->node = ifNodePtr;
+
+                        get_children(current)->push_back(newNode);
+                        current = get_children(current)->back();
+                        children = std::get<prism::ElseNode>(current->node).children;
+
+                        canBeOnTheSameLine = true;
+                        isOnTheSameLine = false;
+                        continue;
+                    } else if (expr == "elseif") {
+                        auto ifNode = current;
+                        if (!is_type(ifNode->node, prism::IfNode) && !is_type(ifNode->node, prism::ElseIfNode) ) {
+                            auto previous = children->at(children->size() - 2);
+                            if (!(isOnTheSameLine && (is_type(previous->node, prism::IfNode) || is_type(previous->node, prism::ElseIfNode))) ) {
+                                throw prism::SyntaxError("Else without if");
+                            } else if (isOnTheSameLine && (is_type(previous->node, prism::IfNode) || is_type(previous->node, prism::ElseIfNode))) {
+                                ifNode = previous;
+                            }
                         }
-                    }
 
-                    if (is_type(ifNode->node, prism::ElseIfNode)) {
-                        ifNode = std::get<prism::ElseIfNode>(ifNode->node).parentIf;
-                    }
+                        if (is_type(ifNode->node, prism::ElseIfNode)) {
+                            ifNode = std::get<prism::ElseIfNode>(ifNode->node).parentIf;
+                        }
 
-                    current = ifNode->parent;
+                        current = ifNode->parent;
 
-                    auto ast = parse_parenthesis(c, input.end());
-                    previous = c;
+                        auto ast = parse_parenthesis(c, input.end(), *m_arena);
+                        previous = c;
 
-                    auto newNode = std::make_shared<prism::Node>(
-                        prism::ElseIfNode{ ast, std::make_shared<std::vector<std::shared_ptr<prism::Node>>>(), ifNode },
-                        current);
-                    auto ifNodePtr = std::get<prism::IfNode>(ifNode->node);
-                    ifNodePtr.elseIfs.push_back(newNode);
-                    ifNode->node = ifNodePtr;
-
-                    get_children(current)->push_back(newNode);
-                    current = get_children(current)->back();
-                    children = std::get<prism::ElseIfNode>(current->node).children;
-
-                    canBeOnTheSameLine = true;
-                    isOnTheSameLine = false;
-                    continue;
-                } else if (expr == "for") {
-                    auto ast = parse_parenthesis(c, input.end());
-                    previous = c;
+                        auto newNode = make_node(
+                            prism::ElseIfNode{ ast, std::make_shared<std::vector<std::shared_ptr<prism::Node>>>(), ifNode, {} },
+                            current);
+                        auto ifNodePtr = std::get<prism::IfNode>(ifNode->node);
+                        ifNodePtr.elseIfs.push_back(newNode);
+                        ifNode->node = ifNodePtr;
 
-                    children->push_back(std::make_shared<prism::Node>(
-                        prism::ForNode{ ast, std::make_shared<std::vector<std::shared_ptr<prism::Node>>>() }, current));
-                    current = children->back();
-                    children = std::get<prism::ForNode>(current->node).children;
-
-                    canBeOnTheSameLine = true;
-                    isOnTheSameLine = false;
-                    continue;
-                } else if (expr == "end") {
-                    if (current == root) {
-                        throw prism::SyntaxError("Unmatched end at " + input.substr(previous - input.begin()));
-                    }
-                    current = current->parent;
-                    children = get_children(current);
-                    previous = c;
-                } else if(expr == "include") {
-                    if(this->m_include_loader == nullptr) {
-                        throw RuntimeError("Include loader not set");
-                    }
-                    auto file = parse_parenthesis(c, input.end());
-                    previous = c;
-                    std::string path = std::get<std::string>(evaluate(file));
-                    auto res = this->m_include_loader(path);
-                    if(!res.has_value()){
-                        throw SyntaxError("Failed to load include from" + path);
-                    }
-                    auto buffer = parse_header(res.value());
-                    auto pos = c - input.begin();
-                    input.insert(c, buffer.begin(), buffer.end());
-                    c = input.begin() + pos;
-                    previous = c;
-                    end = input.end();
-                    continue;
-                } else if (expr == "setting") {
-                    if (c == input.end() || *c != '(') {
-                        children->push_back(
-                            std::make_shared<prism::Node>(prism::TextNode{ std::string("@setting") }, current));
+                        get_children(current)->push_back(newNode);
+                        current = get_children(current)->back();
+                        children = std::get<prism::ElseIfNode>(current->node).children;
+
+                        canBeOnTheSameLine = true;
+                        isOnTheSameLine = false;
+                        continue;
+                    } else if (expr == "for") {
+                        auto ast = parse_parenthesis(c, input.end(), *m_arena);
                         previous = c;
+
+                        auto in = std::get_if<prism::ast::InNode>(&ast->node);
+                        if (in == nullptr || !is_type(in->left->node, prism::ast::VariableNode)) {
+                            throw SyntaxError("Invalid IN operation");
+                        }
+                        children->push_back(make_node(
+                            prism::ForNode{ ast, std::make_shared<std::vector<std::shared_ptr<prism::Node>>>(), {}, 0, {} }, current));
+                        current = children->back();
+                        children = std::get<prism::ForNode>(current->node).children;
+
+                        canBeOnTheSameLine = true;
+                        isOnTheSameLine = false;
                         continue;
-                    }
-                    auto raw = get_parenthesis(c, input.end());
-                    previous = c;
-                    // Collect args first: `type` decides how `default`/`options`
-                    // are interpreted and may appear in any order.
-                    std::string aDefault, aOptions;
-                    SettingDecl decl{};
-                    decl.type = "float";
-                    for (const auto& [key, value] : parse_setting_args(raw.substr(1, raw.size() - 2))) {
-                        if (key == "var") {
-                            decl.var = value;
-                        } else if (key == "name") {
-                            decl.name = value;
-                        } else if (key == "type") {
-                            decl.type = value;
-                        } else if (key == "default") {
-                            aDefault = value;
-                        } else if (key == "options") {
-                            aOptions = value;
-                        } else if (key == "min") {
-                            decl.min = std::stof(value);
-                        } else if (key == "max") {
-                            decl.max = std::stof(value);
-                        } else if (key == "step") {
-                            decl.step = std::stof(value);
-                        } else {
-                            throw SyntaxError("@setting: unknown argument '" + key + "'");
+                    } else if (expr == "end") {
+                        if (current == root) {
+                            throw prism::SyntaxError("Unmatched end");
                         }
-                    }
-                    if (decl.var.empty()) {
-                        throw SyntaxError("@setting: missing var=");
-                    }
-                    if (decl.name.empty()) {
-                        decl.name = decl.var;
-                    }
-                    if (decl.type == "enum") {
-                        // options='Label A:0|Label B:1|Label C:2'
-                        std::string item;
-                        std::stringstream ss(aOptions);
-                        while (std::getline(ss, item, '|')) {
-                            auto colon = item.rfind(':');
-                            if (colon == std::string::npos) {
-                                throw SyntaxError("@setting: enum option missing ':value' in '" + item + "'");
+                        current = current->parent;
+                        children = get_children(current);
+                        previous = c;
+                    } else if (expr == "include" || expr == "include_once") {
+                        // Resolved when linking, so the parsed file can be reused
+                        auto file = parse_parenthesis(c, input.end(), *m_arena);
+                        previous = c;
+                        children->push_back(
+                            make_node(prism::IncludeNode{ file, expr == "include_once" }, current));
+                        continue;
+                    } else if (expr == "setting") {
+                        if (c == input.end() || *c != '(') {
+                            children->push_back(
+                                make_node(prism::TextNode{ std::string_view("@setting") }, current));
+                            previous = c;
+                            continue;
+                        }
+                        auto raw = get_parenthesis(c, input.end());
+                        previous = c;
+                        // Collect args first: `type` decides how `default`/`options`
+                        // are interpreted and may appear in any order.
+                        std::string aDefault, aOptions;
+                        SettingDecl decl{};
+                        decl.type = "float";
+                        for (const auto& [key, value] : parse_setting_args(std::string(raw.substr(1, raw.size() - 2)))) {
+                            if (key == "var") {
+                                decl.var = value;
+                            } else if (key == "name") {
+                                decl.name = value;
+                            } else if (key == "type") {
+                                decl.type = value;
+                            } else if (key == "default") {
+                                aDefault = value;
+                            } else if (key == "options") {
+                                aOptions = value;
+                            } else if (key == "min") {
+                                decl.min = std::stof(value);
+                            } else if (key == "max") {
+                                decl.max = std::stof(value);
+                            } else if (key == "step") {
+                                decl.step = std::stof(value);
+                            } else {
+                                throw SyntaxError("@setting: unknown argument '" + key + "'");
                             }
-                            decl.optionLabels.push_back(gv::trim(item.substr(0, colon)));
-                            decl.optionValues.push_back(std::stof(item.substr(colon + 1)));
                         }
-                        if (decl.optionValues.empty()) {
-                            throw SyntaxError("@setting: enum requires options=");
+                        if (decl.var.empty()) {
+                            throw SyntaxError("@setting: missing var=");
                         }
-                    }
-                    if (decl.type == "color") {
-                        // default='r, g, b' (0..1 components)
-                        std::string comp;
-                        std::stringstream ss(aDefault);
-                        int i = 0;
-                        while (std::getline(ss, comp, ',') && i < 3) {
-                            decl.defColor[i++] = std::stof(comp);
+                        if (decl.name.empty()) {
+                            decl.name = decl.var;
                         }
-                    } else if (!aDefault.empty()) {
-                        decl.def = std::stof(aDefault);
-                    }
-                    m_settings.push_back(decl);
-                    if (!CONTAINS(m_items, decl.var)) {
-                        if (decl.type == "toggle") {
-                            // @if(VAR) requires an int that equals exactly 1
-                            m_items[decl.var] = ContextTypes{ decl.def != 0.0f ? 1 : 0 };
-                        } else if (decl.type == "int" || decl.type == "enum") {
-                            // ints emit without a decimal and support @if(VAR == n)
-                            m_items[decl.var] = ContextTypes{ (int)decl.def };
-                        } else if (decl.type == "color") {
-                            // Component list; templates wrap it: vec3(@{VAR})
-                            m_items[decl.var] =
-                                ContextTypes{ format_float_literal(decl.defColor[0]) + ", " +
-                                              format_float_literal(decl.defColor[1]) + ", " +
-                                              format_float_literal(decl.defColor[2]) };
-                        } else {
-                            // Pre-formatted so @{VAR} emits a valid GLSL float
-                            // literal; the float path drops the ".0"
-                            m_items[decl.var] = ContextTypes{ format_float_literal(decl.def) };
+                        if (decl.type == "enum") {
+                            // options='Label A:0|Label B:1|Label C:2'
+                            std::string item;
+                            std::stringstream ss(aOptions);
+                            while (std::getline(ss, item, '|')) {
+                                auto colon = item.rfind(':');
+                                if (colon == std::string::npos) {
+                                    throw SyntaxError("@setting: enum option missing ':value' in '" + item + "'");
+                                }
+                                decl.optionLabels.push_back(gv::trim(item.substr(0, colon)));
+                                decl.optionValues.push_back(std::stof(item.substr(colon + 1)));
+                            }
+                            if (decl.optionValues.empty()) {
+                                throw SyntaxError("@setting: enum requires options=");
+                            }
+                        }
+                        if (decl.type == "color") {
+                            // default='r, g, b' (0..1 components)
+                            std::string comp;
+                            std::stringstream ss(aDefault);
+                            int i = 0;
+                            while (std::getline(ss, comp, ',') && i < 3) {
+                                decl.defColor[i++] = std::stof(comp);
+                            }
+                        } else if (!aDefault.empty()) {
+                            decl.def = std::stof(aDefault);
                         }
+                        children->push_back(make_node(prism::SettingNode{ std::move(decl) }, current));
+                        continue;
                     }
-                    continue;
                 }
             }
+            c++;
         }
-        c++;
+    } catch (const SyntaxError& e) {
+        throw SyntaxError(locate().to_string() + ": " + e.what());
     }
-
-    children->push_back(std::make_shared<prism::Node>(prism::TextNode{ std::string(previous, c) }, current));
+    children->push_back(make_node(text(previous, c), current));
 
     if (current != root) {
-        throw prism::SyntaxError("Unterminated block");
+        throw prism::SyntaxError(current->location.to_string() + ": Unterminated block");
     }
     return *root;
 }
 
-void prism::Processor::evaluate_node(std::shared_ptr<std::vector<std::shared_ptr<prism::Node>>>& children) {
-    for (const auto& child : *children) {
-        if (is_type(child->node, prism::TextNode)) {
-            auto result = std::get<prism::TextNode>(child->node).text;
-            m_output << result;
-        } else if (is_type(child->node, prism::VariableNode)) {
-            auto var = std::get<prism::VariableNode>(child->node);
-            auto value = evaluate(var.name);
-            if (is_type(value, int)) {
-                m_output << std::get<int>(value);
-            } else if (is_type(value, float)) {
-                m_output << std::get<float>(value);
-            } else if (is_type(value, std::string)) {
-                m_output << std::get<std::string>(value);
-            } else if (is_type(value, Void)) {
-                continue;
-            } else {
-                throw prism::SyntaxError("Unsupported type");
-            }
-        } else if (is_type(child->node, prism::IfNode)) {
-            auto ifNode = std::get<prism::IfNode>(child->node);
-            auto condition = evaluate(ifNode.condition);
-            if ((is_type(condition, int) && std::get<int>(condition) == 1)) {
-                evaluate_node(ifNode.children);
-                continue;
-            } else if (!ifNode.elseIfs.empty()) {
-                for (const auto& node : ifNode.elseIfs) {
-                    auto elseIf = std::get<prism::ElseIfNode>(node->node);
-                    condition = evaluate(elseIf.condition);
-                    if ((is_type(condition, int) && std::get<int>(condition) == 1)) {
-                        evaluate_node(elseIf.children);
-                        return;
-                    }
-                }
-            }
-
-            if (ifNode.elseBody != nullptr) {
-                auto elseNode = std::get<prism::ElseNode>(ifNode.elseBody->node);
-                evaluate_node(elseNode.children);
-            }
-
-        } else if (is_type(child->node, prism::ForNode)) {
-            auto forNode = std::get<prism::ForNode>(child->node);
-            auto context = std::get<prism::ForContext>(evaluate(forNode.condition));
-
-            if (is_type(context.iterator, GeneratedRange)) {
-                auto range = std::get<GeneratedRange>(context.iterator);
-                auto var = context.name;
-                for (auto i = range.start; i < range.end; i++) {
-                    m_items[var] = ContextTypes{ (int) i };
-                    evaluate_node(forNode.children);
-                }
-                m_items.erase(var);
-            } else if (is_type(context.iterator, MTDArray<bool>)) {
-                array_iterate<bool>(forNode, context);
-            } else if (is_type(context.iterator, MTDArray<int>)) {
-                array_iterate<int>(forNode, context);
-            } else if (is_type(context.iterator, MTDArray<float>)) {
-                array_iterate<float>(forNode, context);
-            }
-        }
-    }
-}
-
 void print_node(const prism::Node& node, int depth = 0) {
     for (int i = 0; i < depth; i++) {
         std::cout << ">";
@@ -935,32 +625,423 @@ void print_node(const prism::Node& node, int depth = 0) {
     } else if (std::holds_alternative<prism::VariableNode>(node.node)) {
         std::cout << "Variable" << std::endl;
         print_ast_node(std::get<prism::VariableNode>(node.node).name, depth + 1);
+    } else if (std::holds_alternative<prism::DecisionNode>(node.node)) {
+        const auto& decision = std::get<prism::DecisionNode>(node.node);
+        std::cout << "Decision " << decision.program->atoms.size() << " atoms, " << decision.program->segments.size()
+                  << " segments" << std::endl;
+        for (const auto& child : *decision.children) {
+            print_node(*child, depth + 1);
+        }
+        for (int i = 0; i < depth; i++) {
+            std::cout << ">";
+        }
+        std::cout << "End" << std::endl;
+    } else if (std::holds_alternative<prism::HoistNode>(node.node)) {
+        const auto& hoist = std::get<prism::HoistNode>(node.node);
+        std::cout << "Hoist " << hoist.index << std::endl;
+        for (const auto& child : *hoist.children) {
+            print_node(*child, depth + 1);
+        }
+        for (int i = 0; i < depth; i++) {
+            std::cout << ">";
+        }
+        std::cout << "End" << std::endl;
     }
 }
 
-std::string prism::Processor::process() {
+// Expression errors found while linking point at their directive
+prism::bytecode::Program compile_at(const prism::ast::ASTNode* ast, prism::bytecode::SlotTable& slots,
+                                    const prism::Node& node) {
+    try {
+        return prism::bytecode::compile(ast, slots);
+    } catch (const prism::SyntaxError& e) {
+        throw prism::SyntaxError(node.location.to_string() + ": " + e.what());
+    }
+}
+
+void prism::Processor::link(const NodeList& nodes, const std::shared_ptr<Node>& parent, NodeList& out,
+                            NodeMap& owners) {
+    // Linked nodes keep the location of the node they were made from
+    const std::shared_ptr<prism::Node>* from = nullptr;
+    auto make_node = [&from](prism::NodeType type, const std::shared_ptr<prism::Node>& parent) {
+        auto linked = std::make_shared<prism::Node>(std::move(type), parent);
+        linked->location = (*from)->location;
+        return linked;
+    };
+    // Only one branch of an if renders, files a branch includes once are
+    // still missing from the others
+    auto link_branch = [this, &owners](const NodeList& children, const std::shared_ptr<Node>& linked,
+                                       NodeList& linkedChildren) {
+        auto included = m_included;
+        link(children, linked, linkedChildren, owners);
+        m_included = std::move(included);
+    };
+    for (const auto& node : nodes) {
+        from = &node;
+        if (is_type(node->node, prism::TextNode)) {
+            out.push_back(make_node(node->node, parent));
+        } else if (is_type(node->node, prism::VariableNode)) {
+            auto name = std::get<prism::VariableNode>(node->node).name;
+            out.push_back(
+                make_node(prism::VariableNode{ name, compile_at(name, m_slot_table, *node) }, parent));
+        } else if (is_type(node->node, prism::IfNode)) {
+            const auto& ifNode = std::get<prism::IfNode>(node->node);
+            auto linked = make_node(
+                prism::IfNode{ ifNode.condition, std::make_shared<NodeList>(), nullptr, {},
+                               compile_at(ifNode.condition, m_slot_table, *node) },
+                parent);
+            for (const auto& elseIf : ifNode.elseIfs) {
+                owners[elseIf.get()] = linked;
+            }
+            if (ifNode.elseBody != nullptr) {
+                owners[ifNode.elseBody.get()] = linked;
+            }
+            out.push_back(linked);
+            link_branch(*ifNode.children, linked, *std::get<prism::IfNode>(linked->node).children);
+        } else if (is_type(node->node, prism::ElseIfNode)) {
+            // Else and elseif nodes sit next to their if, which was linked already
+            const auto& elseIf = std::get<prism::ElseIfNode>(node->node);
+            auto owner = owners.at(node.get());
+            auto linked = make_node(
+                prism::ElseIfNode{ elseIf.condition, std::make_shared<NodeList>(), owner,
+                                   compile_at(elseIf.condition, m_slot_table, *node) },
+                parent);
+            std::get<prism::IfNode>(owner->node).elseIfs.push_back(linked);
+            out.push_back(linked);
+            link_branch(*elseIf.children, linked, *std::get<prism::ElseIfNode>(linked->node).children);
+        } else if (is_type(node->node, prism::ElseNode)) {
+            auto owner = owners.at(node.get());
+            auto linked = make_node(prism::ElseNode{ std::make_shared<NodeList>() }, parent);
+            std::get<prism::IfNode>(owner->node).elseBody = linked;
+            out.push_back(linked);
+            link_branch(*std::get<prism::ElseNode>(node->node).children, linked,
+                        *std::get<prism::ElseNode>(linked->node).children);
+        } else if (is_type(node->node, prism::ForNode)) {
+            const auto& forNode = std::get<prism::ForNode>(node->node);
+            const auto& in = std::get<prism::ast::InNode>(forNode.condition->node);
+            // The iterable is resolved outside of the loop scope
+            auto iterable = compile_at(in.right, m_slot_table, *node);
+            auto slot = m_slot_table.open_loop(std::string(std::get<prism::ast::VariableNode>(in.left->node).name));
+            auto linked =
+                make_node(prism::ForNode{ forNode.condition, std::make_shared<NodeList>(), std::move(iterable), slot, {} },
+                          parent);
+            out.push_back(linked);
+            link(*forNode.children, linked, *std::get<prism::ForNode>(linked->node).children, owners);
+            m_slot_table.close_loop();
+        } else if (is_type(node->node, prism::IncludeNode)) {
+            const auto& include = std::get<prism::IncludeNode>(node->node);
+            if (m_include_loader == nullptr && m_include_mapper == nullptr) {
+                throw RuntimeError("Include loader not set");
+            }
+            std::string path;
+            try {
+                bytecode::SlotTable slots;
+                auto program = bytecode::compile(include.path, slots);
+                record_include_inputs(program, slots);
+                auto value = Renderer::evaluate(program, slots, m_items);
+                if (!is_type(value, std::string)) {
+                    throw SyntaxError("Include path is not a string");
+                }
+                path = std::get<std::string>(value);
+            } catch (const SyntaxError& e) {
+                throw SyntaxError(node->location.to_string() + ": " + e.what());
+            }
+            if (include.once && CONTAINS(m_included, path)) {
+                continue;
+            }
+            if (std::find(m_include_stack.begin(), m_include_stack.end(), path) != m_include_stack.end()) {
+                throw SyntaxError(node->location.to_string() + ": Recursive include of " + path);
+            }
+            // Errors inside the file carry its own locations
+            auto unit = load_include(path);
+            if (unit == nullptr) {
+                throw SyntaxError(node->location.to_string() + ": Failed to load include from " + path);
+            }
+            m_included.insert(path);
+            m_includes.push_back({ path, unit->hash });
+            m_units.push_back(unit);
+            m_include_stack.push_back(path);
+            link(*std::get<prism::RootNode>(unit->root->node).children, parent, out, owners);
+            m_include_stack.pop_back();
+        } else if (is_type(node->node, prism::SettingNode)) {
+            m_settings.push_back(std::get<prism::SettingNode>(node->node).decl);
+        }
+    }
+}
+
+std::string_view prism::Processor::read_include(const std::string& path, std::shared_ptr<const void>& owner) {
+    PRISM_TRACE_SCOPE_DETAIL("read_include", "io", path);
+    if (m_include_mapper != nullptr) {
+        auto file = m_include_mapper(path);
+        if (file == nullptr) {
+            return {};
+        }
+        if (m_copy_sources) {
+            auto copy = std::make_shared<const std::string>(file->view());
+            owner = copy;
+            return *copy;
+        }
+        auto data = file->view();
+        owner = std::move(file);
+        return data;
+    }
+    auto data = m_include_loader != nullptr ? m_include_loader(path) : std::nullopt;
+    if (!data.has_value()) {
+        return {};
+    }
+    auto copy = std::make_shared<const std::string>(std::move(data.value()));
+    owner = copy;
+    return *copy;
+}
+
+void prism::Processor::record_include_inputs(const bytecode::Program& program, const bytecode::SlotTable& slots) {
+    for (const auto& ins : program.code) {
+        if (ins.op == bytecode::OpCode::Call) {
+            m_storable = false;
+        }
+        if (ins.op != bytecode::OpCode::Load && ins.op != bytecode::OpCode::Index) {
+            continue;
+        }
+        const auto& name = slots.names[ins.arg];
+        auto recorded = std::find_if(m_include_inputs.begin(), m_include_inputs.end(),
+                                     [&name](const IncludeInput& input) { return input.name == name; });
+        if (recorded != m_include_inputs.end()) {
+            continue;
+        }
+        auto item = m_items.find(name);
+        IncludeInput input{ name, {} };
+        encode_read({ name, {} }, item != m_items.end() ? &item->second : nullptr, input.value);
+        m_include_inputs.push_back(std::move(input));
+    }
+}
+
+bool prism::includes_linked_for(const CompiledTemplate& compiled, const ContextItems& items) {
+    std::string value;
+    for (const auto& input : compiled.includeInputs) {
+        auto item = items.find(input.name);
+        value.clear();
+        encode_read({ input.name, {} }, item != items.end() ? &item->second : nullptr, value);
+        if (value != input.value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool prism::Processor::includes_unchanged(const CompiledTemplate& compiled) {
+    // Paths computed from the context could point elsewhere now
+    if (!includes_linked_for(compiled, m_items)) {
+        return false;
+    }
+    for (const auto& include : compiled.includes) {
+        std::shared_ptr<const void> owner;
+        auto data = read_include(include.path, owner);
+        if (owner == nullptr || hash::fnv1a(data) != include.hash) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<const prism::IncludeUnit> prism::Processor::load_include(const std::string& path) {
+    if (m_include_cache == nullptr) {
+        m_include_cache = std::make_shared<IncludeCache>();
+    }
+
+    PRISM_TRACE_SCOPE_DETAIL("load_include", "load", path);
+    std::shared_ptr<const void> owner;
+    auto data = read_include(path, owner);
+    if (owner == nullptr) {
+        return nullptr;
+    }
+    // The file may have changed since it was cached, what is saved is the parse
+    auto contentHash = hash::fnv1a(data);
+    if (auto unit = m_include_cache->find(path); unit != nullptr && unit->hash == contentHash) {
+        return unit;
+    }
+    if (auto unit = m_include_cache->find_content(contentHash)) {
+        m_include_cache->insert(path, unit);
+        return unit;
+    }
+
+    auto unit = std::make_shared<IncludeUnit>();
+    unit->hash = contentHash;
+    unit->source = read_source(path, data, std::move(owner));
+    // Parsed into an arena of its own, the unit outlives the template
+    auto arena = std::exchange(m_arena, std::make_unique<ast::Arena>());
+    try {
+        unit->root = std::make_shared<prism::Node>(parse(unit->source));
+    } catch (...) {
+        m_arena = std::move(arena);
+        throw;
+    }
+    unit->arena = std::exchange(m_arena, std::move(arena));
+    m_include_cache->insert(path, unit);
+    return unit;
+}
+
+namespace {
+typedef std::vector<std::shared_ptr<prism::Node>> NodeList;
+
+// Views of the tree that get pointed into the pool
+void collect_text(const NodeList& nodes, std::vector<std::string_view*>& views) {
+    for (const auto& node : nodes) {
+        if (auto text = std::get_if<prism::TextNode>(&node->node)) {
+            views.push_back(&text->text);
+        } else if (auto ifNode = std::get_if<prism::IfNode>(&node->node)) {
+            collect_text(*ifNode->children, views);
+        } else if (auto elseIf = std::get_if<prism::ElseIfNode>(&node->node)) {
+            collect_text(*elseIf->children, views);
+        } else if (auto elseNode = std::get_if<prism::ElseNode>(&node->node)) {
+            collect_text(*elseNode->children, views);
+        } else if (auto forNode = std::get_if<prism::ForNode>(&node->node)) {
+            collect_text(*forNode->children, views);
+        } else if (auto decision = std::get_if<prism::DecisionNode>(&node->node)) {
+            for (auto& segment : decision->program->segments) {
+                if (segment.node == nullptr) {
+                    views.push_back(&segment.text);
+                }
+            }
+            collect_text(*decision->children, views);
+        } else if (auto hoist = std::get_if<prism::HoistNode>(&node->node)) {
+            collect_text(*hoist->children, views);
+        }
+    }
+}
+} // namespace
+
+void prism::pool_text(CompiledTemplate& compiled) {
+    std::vector<std::string_view*> views;
+    collect_text(*std::get<RootNode>(compiled.root->node).children, views);
+
+    // Offsets first, the pool must not grow once it is pointed at
+    std::unordered_map<std::string_view, size_t> offsets;
+    std::vector<size_t> placed(views.size());
+    std::string pool;
+    for (size_t i = 0; i < views.size(); i++) {
+        auto [found, added] = offsets.try_emplace(*views[i], pool.size());
+        if (added) {
+            pool.append(*views[i]);
+        }
+        placed[i] = found->second;
+    }
+    compiled.poolStorage = std::move(pool);
+    compiled.pool = compiled.poolStorage;
+    for (size_t i = 0; i < views.size(); i++) {
+        *views[i] = compiled.pool.substr(placed[i], views[i]->size());
+    }
+    compiled.text.clear();
+}
+
+std::shared_ptr<prism::CompiledTemplate> prism::Processor::compile(const std::string& input, uint32_t firstLine) {
+    SourceBuffer source{ "", {}, firstLine, nullptr };
+    source.assign(input);
+    return compile(std::move(source));
+}
+
+std::shared_ptr<prism::CompiledTemplate> prism::Processor::compile(SourceBuffer source) {
+    PRISM_TRACE_SCOPE("compile", "compile");
+    auto compiled = std::make_shared<CompiledTemplate>();
+    compiled->source = std::move(source);
     m_settings.clear();
-    auto node = parse(m_input);
+    m_includes.clear();
+    m_include_inputs.clear();
+    m_storable = true;
+    m_units.clear();
+    m_include_stack.clear();
+    m_included.clear();
+    m_slot_table = bytecode::SlotTable{};
+    m_arena = std::make_unique<ast::Arena>();
+    auto parsed = std::make_shared<prism::Node>(parse(compiled->source));
+    compiled->root = std::make_shared<prism::Node>(prism::RootNode{ std::make_shared<NodeList>() }, nullptr);
+    NodeMap owners;
+    try {
+        PRISM_TRACE_SCOPE("link", "compile");
+        link(*std::get<prism::RootNode>(parsed->node).children, compiled->root,
+             *std::get<prism::RootNode>(compiled->root->node).children, owners);
+    } catch (...) {
+        delete_node(parsed);
+        throw;
+    }
+    delete_node(parsed);
+    {
+        PRISM_TRACE_SCOPE("optimize", "compile");
+        decision::compile(*compiled);
+        hoist::compile(*compiled);
+        pool_text(*compiled);
+    }
+    compiled->arena = std::move(m_arena);
+    compiled->settings = std::move(m_settings);
+    compiled->includes = std::move(m_includes);
+    compiled->includeInputs = std::move(m_include_inputs);
+    compiled->storable = m_storable;
+    compiled->units = std::move(m_units);
+    compiled->slots = std::move(m_slot_table);
+    m_settings.clear();
+    m_includes.clear();
+    m_include_inputs.clear();
+    m_units.clear();
+    m_slot_table = bytecode::SlotTable{};
+    compiled->hash = hash::fnv1a(compiled->source.text);
+    for (const auto& include : compiled->includes) {
+        compiled->hash = hash::fnv1a(include.path, compiled->hash);
+        compiled->hash = hash::mix(compiled->hash, include.hash);
+    }
 #ifdef DEBUG_PARSE
-    for (const auto& child : *std::get<prism::RootNode>(node.node).children) {
+    for (const auto& child : *std::get<prism::RootNode>(compiled->root->node).children) {
         print_node(*child);
     }
 #endif
-    evaluate_node(std::get<prism::RootNode>(node.node).children);
-    for (const auto& child : *std::get<prism::RootNode>(node.node).children) {
-        delete_node((std::shared_ptr<prism::Node>&) child);
-    }
+    return compiled;
+}
 
-    std::stringstream result;
-    auto lines = gv::new_line_split(m_output.str());
-    for (const auto& line : lines) {
-        auto trimmed = gv::trim(line);
-        if (trimmed.empty()) {
-            continue;
-        }
-        result << trimmed << std::endl;
+prism::CompiledTemplate::~CompiledTemplate() {
+    // Nodes keep a strong reference to their parent, break the cycles
+    delete_node(root);
+}
+
+void prism::Processor::render(const ContextItems& items, OutputSink& sink) {
+    populate(items);
+    process(sink);
+}
+
+std::string prism::Processor::render(const ContextItems& items) {
+    populate(items);
+    return process();
+}
+
+std::string prism::Processor::process() {
+    StringSink result;
+    process(result);
+    return std::move(result.str());
+}
+
+void prism::Processor::relink() {
+    PRISM_TRACE_SCOPE("relink", "load");
+    // The text may be a view into a store or a file that was mapped, the
+    // parser needs a copy it can read past the end of
+    auto source = m_template->source;
+    source.assign(std::string(source.text));
+    m_template = compile(std::move(source));
+}
+
+void prism::Processor::process(OutputSink& sink) {
+    // Include paths calling a native cannot be checked, they are evaluated again
+    if (m_template != nullptr && (!m_template->storable || !includes_linked_for(*m_template, m_items))) {
+        relink();
+    }
+    RenderState state;
+    // Renders write defaults and assignments into their own items, hand
+    // ours over and take them back so getTypes() sees the result
+    state.items = std::move(m_items);
+    state.profiler = m_profiler.get();
+    try {
+        Renderer(m_template, m_cache, m_mode).render(state, sink);
+    } catch (...) {
+        m_items = std::move(state.items);
+        throw;
     }
-    return result.str();
+    m_items = std::move(state.items);
 }
 
 void prism::delete_node(std::shared_ptr<prism::Node>& node) {
@@ -998,5 +1079,15 @@ void prism::delete_node(std::shared_ptr<prism::Node>& node) {
             delete_node((std::shared_ptr<prism::Node>&) child);
         }
     }
+    if (is_type(node->node, prism::DecisionNode)) {
+        for (const auto& child : *std::get<prism::DecisionNode>(node->node).children) {
+            delete_node((std::shared_ptr<prism::Node>&) child);
+        }
+    }
+    if (is_type(node->node, prism::HoistNode)) {
+        for (const auto& child : *std::get<prism::HoistNode>(node->node).children) {
+            delete_node((std::shared_ptr<prism::Node>&) child);
+        }
+    }
     node.reset();
 }
@@ -1,17 +1,23 @@
 #pragma once
 
+#include <deque>
 #include <utility>
 #include <vector>
 #include <string>
 #include <variant>
 #include <sstream>
+#include <memory>
 #include <optional>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <cstdlib>
 
 #include "lexer.h"
 #include "ast.h"
-#include "utils/invoke.h"
+#include "bytecode.h"
+#include "decision.h"
+#include "sink.h"
 #include "utils/exceptions.h"
 
 #define is_type(var, type) std::holds_alternative<type>((var))
@@ -36,35 +42,35 @@ template <typename T> struct MTDArray {
     uintptr_t ptr = 0;
     std::vector<size_t> dimensions;
 
-    T& at(int x) {
+    T& at(int x) const {
         if (x >= dimensions[0]) {
             throw RuntimeError("Index out of bounds");
         }
         return ((T*) ptr)[x];
     }
 
-    T& at(int x, int y) {
+    T& at(int x, int y) const {
         if (x >= dimensions[0] || y >= dimensions[1]) {
             throw RuntimeError("Index out of bounds");
         }
         return get(x).at(y);
     }
 
-    T& at(int x, int y, int z) {
+    T& at(int x, int y, int z) const {
         if (x >= dimensions[0] || y >= dimensions[1] || z >= dimensions[2]) {
             throw RuntimeError("Index out of bounds");
         }
         return get(x, y).at(z);
     }
 
-    T& at(int x, int y, int z, int w) {
+    T& at(int x, int y, int z, int w) const {
         if (x >= dimensions[0] || y >= dimensions[1] || z >= dimensions[2] || w >= dimensions[3]) {
             throw RuntimeError("Index out of bounds");
         }
         return get(x, y, z).at(w);
     }
 
-    MTDArray<T> get(int x) {
+    MTDArray<T> get(int x) const {
         if (x >= dimensions[0]) {
             throw RuntimeError("Index out of bounds");
         }
@@ -78,14 +84,14 @@ template <typename T> struct MTDArray {
                             std::vector<size_t>{ dimensions.begin() + 1, dimensions.end() } };
     }
 
-    MTDArray<T> get(int x, int y) {
+    MTDArray<T> get(int x, int y) const {
         if (x >= dimensions[0] || y >= dimensions[1]) {
             throw RuntimeError("Index out of bounds");
         }
         return get(x).get(y);
     }
 
-    MTDArray<T> get(int x, int y, int z) {
+    MTDArray<T> get(int x, int y, int z) const {
         if (x >= dimensions[0] || y >= dimensions[1] || z >= dimensions[2]) {
             throw RuntimeError("Index out of bounds");
         }
@@ -115,6 +121,8 @@ struct SettingDecl {
 };
 
 std::string format_float_literal(float v);
+// Writes `v` the way printf's "%.<precision>g" does, returns the end
+char* format_float(char* first, char* last, float v, int precision);
 
 struct ForContext {
     std::string name;
@@ -126,46 +134,123 @@ struct Opaque {
     uintptr_t ptr;
 };
 
+struct NativeCall;
+// A host function callable from templates, made with make_native() (native.h).
+// `thunk` unpacks the arguments for `function`, which is stored type erased.
+struct Native {
+    typedef void (*Thunk)(const Native& self, NativeCall& call);
+    Thunk thunk = nullptr;
+    void (*function)() = nullptr;
+    // Handed to a pointer parameter of the function
+    void* data = nullptr;
+    // Takes the render's ContextItems, which it may read and write
+    bool context = false;
+};
+
 typedef std::variant<Void, int, float, MTDArray<bool>, MTDArray<int>, MTDArray<float>, GeneratedRange,
-                     std::string, ForContext, InvokeFunc, Opaque>
+                     std::string, ForContext, Native, Opaque>
     ContextTypes;
 typedef std::unordered_map<std::string, ContextTypes> ContextItems;
 
+
 enum class ScopeType { None, If, Else, ElseIf, For };
 
 enum class ExpressionType { None, Variable, If, Else, ElseIf, For, End };
 
+// Text of a template or of an included file. Nodes parsed from it point
+// into `text`, so it lives as long as they do.
+struct SourceBuffer {
+    // Empty for the template itself
+    std::string path;
+    // Held by `owner`, a mapped file or a copy. The parser reads the byte
+    // past the end, which has to be a '\0' as in a std::string.
+    std::string_view text;
+    // Line of the file `text` starts at, after the @prism header
+    uint32_t firstLine = 1;
+    std::shared_ptr<const void> owner;
+
+    // Points `text` at a copy of `str`
+    void assign(std::string str) {
+        auto copy = std::make_shared<const std::string>(std::move(str));
+        text = *copy;
+        owner = std::move(copy);
+    }
+};
+
+struct SourceLocation {
+    const SourceBuffer* source = nullptr;
+    uint32_t offset = 0;
+
+    // "path:line:column"
+    std::string to_string() const;
+};
+
 struct Node;
 struct RootNode {
     std::shared_ptr<std::vector<std::shared_ptr<Node>>> children;
 };
 struct TextNode {
-    std::string text;
+    std::string_view text;
 };
 struct VariableNode {
-    std::shared_ptr<ast::ASTNode> name;
+    ast::ASTNode* name;
+    bytecode::Program program;
 };
 struct ElseNode {
     std::shared_ptr<std::vector<std::shared_ptr<Node>>> children;
 };
 struct ElseIfNode {
-    std::shared_ptr<ast::ASTNode> condition;
+    ast::ASTNode* condition;
     std::shared_ptr<std::vector<std::shared_ptr<Node>>> children;
     std::shared_ptr<Node> parentIf;
+    bytecode::Program program;
 };
 struct IfNode {
-    std::shared_ptr<ast::ASTNode> condition;
+    ast::ASTNode* condition;
     std::shared_ptr<std::vector<std::shared_ptr<Node>>> children;
     std::shared_ptr<Node> elseBody;
     std::vector<std::shared_ptr<Node>> elseIfs;
+    bytecode::Program program;
 };
 struct ForNode {
-    std::shared_ptr<ast::ASTNode> condition;
+    ast::ASTNode* condition;
     std::shared_ptr<std::vector<std::shared_ptr<Node>>> children;
+    // Evaluates the iterable, the loop variable lives in `slot`
+    bytecode::Program program;
+    uint32_t slot = 0;
+    // Values and blocks of the body cached until the next time the loop is entered
+    std::vector<uint32_t> hoisted;
 };
 struct EndNode {};
+// Only in parsed trees, linking replaces it with the included file's nodes
+struct IncludeNode {
+    ast::ASTNode* path;
+    // @include_once: skipped if the file is already part of the template
+    bool once = false;
+};
+// Kept in the tree so declarations stay in source order across includes,
+// linking moves them to CompiledTemplate::settings
+struct SettingNode {
+    SettingDecl decl;
+};
+
+// A run of sibling nodes flattened into guarded segments, see decision::compile.
+// `children` are the nodes it replaced, walked when an atom is not an int.
+struct DecisionNode {
+    std::shared_ptr<decision::Program> program;
+    std::shared_ptr<std::vector<std::shared_ptr<Node>>> children;
+};
 
-typedef std::variant<RootNode, TextNode, VariableNode, IfNode, ElseIfNode, ElseNode, ForNode, EndNode> NodeType;
+// Nodes inside a loop whose output does not depend on it, see hoist::compile.
+// Rendered once per entry of the loop owning `index`, replayed afterwards.
+struct HoistNode {
+    std::shared_ptr<std::vector<std::shared_ptr<Node>>> children;
+    uint32_t index;
+};
+
+typedef std::variant<RootNode, TextNode, VariableNode, IfNode, ElseIfNode, ElseNode, ForNode, EndNode, IncludeNode,
+                     SettingNode, DecisionNode, HoistNode>
+    NodeType;
 
 void delete_node(std::shared_ptr<prism::Node>& node);
 
@@ -176,6 +261,8 @@ class Node {
     NodeType node;
     std::shared_ptr<Node> parent;
     int depth = 0;
+    // Start of the directive the node was parsed from
+    SourceLocation location;
 };
 
 struct RuntimeContext {
@@ -183,45 +270,202 @@ struct RuntimeContext {
     bool skipUntilEnd = false;
 };
 
+class MappedFile;
 typedef std::optional<std::string> (*IncludeFunc)(const std::string&);
+// Loads an include without copying it, nullptr if it cannot be found
+typedef std::shared_ptr<const MappedFile> (*IncludeMapFunc)(const std::string&);
+
+struct IncludeDependency {
+    std::string path;
+    uint64_t hash;
+};
+
+// A context entry an @include path was computed from, with encode_read() of
+// the value it had when the template was linked
+struct IncludeInput {
+    std::string name;
+    std::string value;
+};
+
+// A context entry read while rendering. Empty indices mean the whole value
+// (for arrays, every cell), otherwise the cell or sub array at the indices.
+struct ReadRecord {
+    std::string name;
+    std::vector<int> indices;
+
+    bool operator==(const ReadRecord& other) const {
+        return name == other.name && indices == other.indices;
+    }
+};
+typedef std::vector<ReadRecord> ReadSet;
+
+class OutputCache;
+class Profiler;
+class IncludeCache;
+class TemplateStore;
+struct IncludeUnit;
+
+// Result of parsing a template once: the node tree with every embedded
+// expression already lexed and parsed, plus the @setting declarations.
+// Rendering only walks this tree, so it can be reused for any number of
+// contexts and shared between threads, see Renderer.
+struct CompiledTemplate {
+    SourceBuffer source;
+    std::shared_ptr<Node> root;
+    std::vector<SettingDecl> settings;
+    std::vector<IncludeDependency> includes;
+    // The template links the same includes for any context holding these values
+    std::vector<IncludeInput> includeInputs;
+    // False when an @include path calls a native, which the inputs cannot cover
+    bool storable = true;
+    // Keep the expression nodes of included files alive
+    std::vector<std::shared_ptr<const IncludeUnit>> units;
+    bytecode::SlotTable slots;
+    // Owns every expression node referenced by the tree
+    std::unique_ptr<ast::Arena> arena;
+    // Covers the source and the contents of every include
+    uint64_t hash = 0;
+    // Set on a specialized template, whose tree points into this one
+    std::shared_ptr<const CompiledTemplate> base;
+    // Text folded while compiling, only until pool_text() moves it to `pool`
+    std::deque<std::string> text;
+    // Every piece of literal text of the tree, in render order. Points into
+    // `poolStorage`, or into `mapping` for a template read from a store.
+    std::string_view pool;
+    std::string poolStorage;
+    std::shared_ptr<const MappedFile> mapping;
+    // Values and blocks cached per loop entry while rendering
+    uint32_t hoisted = 0;
+
+    ~CompiledTemplate();
+};
+
+// Copies the literal text of the tree into compiled.pool and points text
+// nodes and decision segments at it, so a render reads its text from one
+// block and sinks can tell it apart from computed output
+void pool_text(CompiledTemplate& compiled);
+// Whether `items` hold the values the @include paths of `compiled` were
+// computed from, so that linking against them expands the same files
+bool includes_linked_for(const CompiledTemplate& compiled, const ContextItems& items);
 
 class Processor {
   public:
     void populate(const ContextItems& items);
+    // Parses the header and compiles the body; includes are resolved here,
+    // so the include loader has to be bound before calling it.
     void load(const std::string& input);
-    std::string parse_header(const std::string& data);
-    prism::Node parse(std::string input);
-    ContextTypes evaluate(const std::shared_ptr<prism::ast::ASTNode>& node);
-    void evaluate_node(std::shared_ptr<std::vector<std::shared_ptr<prism::Node>>>& children);
+    // Same, the template keeps pointing into the mapping instead of a copy of the body
+    void load(std::shared_ptr<const MappedFile> file);
+    // Returns the body, a view into `data`; `headerLines` receives how many lines were stripped
+    std::string_view parse_header(std::string_view data, uint32_t* headerLines = nullptr);
+    // The tree points into `source`, which has to outlive it
+    prism::Node parse(const SourceBuffer& source);
+    // `firstLine` is the line the body starts at in its file, for error locations
+    std::shared_ptr<CompiledTemplate> compile(const std::string& input, uint32_t firstLine = 1);
+    std::shared_ptr<CompiledTemplate> compile(SourceBuffer source);
+    // Renders the loaded template against the populated items, linking it
+    // again first if its @include paths now read other values. Lines are
+    // trimmed and blank ones dropped as the output streams into `sink`, or
+    // it is minified, see set_output_mode().
+    void process(OutputSink& sink);
     std::string process();
+    // Renders the loaded template against `items` without parsing again.
+    void render(const ContextItems& items, OutputSink& sink);
+    std::string render(const ContextItems& items);
     ContextItems getTypes() {
         return this->m_items;
     }
 
+    // Hand this to a Renderer per thread to render it concurrently
+    const std::shared_ptr<const CompiledTemplate>& compiled() const {
+        return m_template;
+    }
+
     const std::vector<SettingDecl>& settings() const {
-        return m_settings;
+        static const std::vector<SettingDecl> empty;
+        return m_template ? m_template->settings : empty;
     }
     void bind_include_loader(IncludeFunc func){
         m_include_loader = func;
     }
-
-    template <typename T> void array_iterate(prism::ForNode& node, prism::ForContext& context) {
-        auto var = context.name;
-        auto array = std::get<prism::MTDArray<T>>(context.iterator);
-        for (size_t i = 0; i < array.dimensions[0]; i++) {
-            m_items[var] = prism::ContextTypes{ array.at(i) };
-            evaluate_node(node.children);
-        }
-        m_items.erase(var);
+    // Takes precedence over a loader returning copies
+    void bind_include_loader(IncludeMapFunc func) {
+        m_include_mapper = func;
+    }
+    // Parsed includes are kept in `cache`, which may be shared between
+    // processors; one is created on the first include otherwise.
+    void bind_include_cache(std::shared_ptr<IncludeCache> cache) {
+        m_include_cache = std::move(cache);
+    }
+    // Renders are looked up in and stored to `cache`, which may be shared
+    // between processors. Pass nullptr to disable caching.
+    void bind_cache(std::shared_ptr<OutputCache> cache) {
+        m_cache = std::move(cache);
+    }
+    // Compiled templates are read from and written to `store`, so loading a
+    // template compiled by an earlier run skips parsing. Pass nullptr to disable.
+    void bind_template_store(std::shared_ptr<TemplateStore> store) {
+        m_store = std::move(store);
+    }
+    // Directives of every render are timed into `profiler` until it is
+    // unbound with nullptr; profiled renders skip the output cache
+    void bind_profiler(std::shared_ptr<Profiler> profiler) {
+        m_profiler = std::move(profiler);
+    }
+    void set_output_mode(OutputMode mode) {
+        m_mode = mode;
+    }
+    // Mapped templates and includes are copied instead of referenced in
+    // place, for files that may be edited while the template is loaded. A
+    // file shrunk under its mapping faults on the next read.
+    void set_copy_sources(bool copy) {
+        m_copy_sources = copy;
     }
 
   private:
+    typedef std::vector<std::shared_ptr<Node>> NodeList;
+    typedef std::unordered_map<const Node*, std::shared_ptr<Node>> NodeMap;
+    // Copies a parsed tree into `out`, binding expressions to slots and
+    // expanding includes. `owners` maps else and elseif nodes to their linked if.
+    void link(const NodeList& nodes, const std::shared_ptr<Node>& parent, NodeList& out, NodeMap& owners);
+    // `owner` holds `data` if it can be referenced in place, it is copied otherwise
+    void load(std::string_view data, std::shared_ptr<const void> owner);
+    // The header stripped off `data`, referenced in place when `owner` is set
+    SourceBuffer read_source(std::string path, std::string_view data, std::shared_ptr<const void> owner);
+    // Contents of an include through whichever loader is bound, held by
+    // `owner`; `owner` is left empty if it cannot be found
+    std::string_view read_include(const std::string& path, std::shared_ptr<const void>& owner);
+    // nullptr if the loader cannot find the file
+    std::shared_ptr<const IncludeUnit> load_include(const std::string& path);
+    // Notes the context entries an @include path reads for includes_unchanged()
+    void record_include_inputs(const bytecode::Program& program, const bytecode::SlotTable& slots);
+    // Whether a stored template would link the same includes with the same
+    // contents for the current context
+    bool includes_unchanged(const CompiledTemplate& compiled);
+    // Compiles the loaded template again against the current items
+    void relink();
+
     ContextItems m_items;
     std::vector<SettingDecl> m_settings;
     RuntimeContext m_context;
-    std::stringstream m_output;
-    std::string m_input;
-    std::shared_ptr<prism::Node> m_root;
+    std::shared_ptr<const CompiledTemplate> m_template;
+    std::vector<IncludeDependency> m_includes;
+    std::vector<IncludeInput> m_include_inputs;
+    bool m_storable = true;
+    // Slots and expression nodes of the current parse
+    bytecode::SlotTable m_slot_table;
+    std::unique_ptr<ast::Arena> m_arena;
     IncludeFunc m_include_loader = nullptr;
+    IncludeMapFunc m_include_mapper = nullptr;
+    std::shared_ptr<IncludeCache> m_include_cache;
+    OutputMode m_mode = OutputMode::Trim;
+    bool m_copy_sources = false;
+    // Includes of the current link: units in use, files being expanded and every file seen
+    std::vector<std::shared_ptr<const IncludeUnit>> m_units;
+    std::vector<std::string> m_include_stack;
+    std::unordered_set<std::string> m_included;
+    std::shared_ptr<OutputCache> m_cache;
+    std::shared_ptr<TemplateStore> m_store;
+    std::shared_ptr<Profiler> m_profiler;
 };
 } // namespace prism
\ No newline at end of file
@@ -0,0 +1,119 @@
+#include "profile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include "utils/gv.h"
+
+namespace {
+const char* name_of(prism::DirectiveKind kind) {
+    switch (kind) {
+        case prism::DirectiveKind::If:
+            return "if";
+        case prism::DirectiveKind::ElseIf:
+            return "elseif";
+        case prism::DirectiveKind::For:
+            return "for";
+        default:
+            return "expression";
+    }
+}
+
+// The line of source the directive starts, cut short
+std::string snippet(const prism::Node& node) {
+    const auto* source = node.location.source;
+    if (source == nullptr || node.location.offset >= source->text.size()) {
+        return "";
+    }
+    auto line = source->text.substr(node.location.offset, 60);
+    return std::string(line.substr(0, line.find('\n')));
+}
+
+double microseconds(std::chrono::nanoseconds time) {
+    return (double) time.count() / 1000.0;
+}
+} // namespace
+
+void prism::Profiler::enter(const Node& node, DirectiveKind kind) {
+    m_stack.push_back({ &node, kind, Clock::now(), m_bytes });
+}
+
+void prism::Profiler::leave() {
+    auto frame = m_stack.back();
+    m_stack.pop_back();
+    auto total = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - frame.start);
+    auto& entry = m_directives[frame.node];
+    entry.node = frame.node;
+    entry.kind = frame.kind;
+    entry.hits++;
+    entry.total += total;
+    entry.self += total - frame.nested;
+    entry.bytes += m_bytes - frame.bytes;
+    if (!m_stack.empty()) {
+        m_stack.back().nested += total;
+    }
+}
+
+void prism::Profiler::clear() {
+    m_directives.clear();
+    m_stack.clear();
+}
+
+std::vector<prism::DirectiveProfile> prism::Profiler::report() const {
+    std::vector<DirectiveProfile> result;
+    result.reserve(m_directives.size());
+    for (const auto& [node, entry] : m_directives) {
+        result.push_back(entry);
+    }
+    std::sort(result.begin(), result.end(), [](const DirectiveProfile& a, const DirectiveProfile& b) {
+        if (a.self != b.self) {
+            return a.self > b.self;
+        }
+        return a.node->location.offset < b.node->location.offset;
+    });
+    return result;
+}
+
+std::string prism::Profiler::to_text() const {
+    std::string out;
+    char line[160];
+    std::snprintf(line, sizeof(line), "%12s %12s %10s %10s  %-10s %s\n", "self us", "total us", "hits", "bytes", "kind",
+                  "location");
+    out += line;
+    for (const auto& entry : report()) {
+        std::snprintf(line, sizeof(line), "%12.2f %12.2f %10llu %10llu  %-10s ", microseconds(entry.self),
+                      microseconds(entry.total), (unsigned long long) entry.hits, (unsigned long long) entry.bytes,
+                      name_of(entry.kind));
+        out += line;
+        out += entry.node->location.to_string();
+        out += "  ";
+        out += snippet(*entry.node);
+        out += '\n';
+    }
+    return out;
+}
+
+std::string prism::Profiler::to_json() const {
+    std::string out = "[";
+    char number[64];
+    bool first = true;
+    for (const auto& entry : report()) {
+        out += first ? "\n  {" : ",\n  {";
+        first = false;
+        out += "\"location\": ";
+        gv::append_json(out, entry.node->location.to_string());
+        out += ", \"kind\": ";
+        gv::append_json(out, name_of(entry.kind));
+        out += ", \"directive\": ";
+        gv::append_json(out, snippet(*entry.node));
+        std::snprintf(number, sizeof(number), ", \"hits\": %llu", (unsigned long long) entry.hits);
+        out += number;
+        std::snprintf(number, sizeof(number), ", \"total_us\": %.3f", microseconds(entry.total));
+        out += number;
+        std::snprintf(number, sizeof(number), ", \"self_us\": %.3f", microseconds(entry.self));
+        out += number;
+        std::snprintf(number, sizeof(number), ", \"bytes\": %llu}", (unsigned long long) entry.bytes);
+        out += number;
+    }
+    out += first ? "]\n" : "\n]\n";
+    return out;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include "processor.h"
+#include "sink.h"
+
+namespace prism {
+enum class DirectiveKind : uint8_t { If, ElseIf, For, Expression };
+
+// What the renders a Profiler watched spent in one directive
+struct DirectiveProfile {
+    // Points into the template, valid as long as it is
+    const Node* node = nullptr;
+    DirectiveKind kind = DirectiveKind::Expression;
+    uint64_t hits = 0;
+    // Including the directives nested in it
+    std::chrono::nanoseconds total{ 0 };
+    std::chrono::nanoseconds self{ 0 };
+    // Before lines are trimmed or minified, including nested directives
+    uint64_t bytes = 0;
+};
+
+// Times every @if, @elseif, @for and @{} of the renders it is bound to,
+// see Processor::bind_profiler() and RenderState::profiler. Profiled renders
+// skip the output cache, and @if chains the compiler flattened are walked as
+// written so each of their directives shows up. One profiler per thread.
+class Profiler {
+  public:
+    // Every directive that ran, most self time first
+    std::vector<DirectiveProfile> report() const;
+    // report() as a table, one directive per line
+    std::string to_text() const;
+    // report() as a JSON array of objects
+    std::string to_json() const;
+    void clear();
+
+    // Called by the renderer around every directive it runs
+    void enter(const Node& node, DirectiveKind kind);
+    void leave();
+    // Output written while a profiled render runs
+    void count(size_t bytes) {
+        m_bytes += bytes;
+    }
+    // Output replayed from a capture whose bytes were already counted
+    void uncount(size_t bytes) {
+        m_bytes -= bytes;
+    }
+
+  private:
+    typedef std::chrono::steady_clock Clock;
+    struct Frame {
+        const Node* node;
+        DirectiveKind kind;
+        Clock::time_point start;
+        uint64_t bytes;
+        // Spent in the directives nested in this one
+        std::chrono::nanoseconds nested{ 0 };
+    };
+
+    std::unordered_map<const Node*, DirectiveProfile> m_directives;
+    std::vector<Frame> m_stack;
+    // Wraps around on uncount(), only differences are used
+    uint64_t m_bytes = 0;
+};
+
+// Counts what a profiled render writes into `target`
+class ProfileSink : public OutputSink {
+  public:
+    ProfileSink(OutputSink& target, Profiler& profiler) : m_target(target), m_profiler(profiler) {
+    }
+    void write(const char* data, size_t size) override {
+        m_profiler.count(size);
+        m_target.write(data, size);
+    }
+    using OutputSink::write;
+    void flush() override {
+        m_target.flush();
+    }
+
+  private:
+    OutputSink& m_target;
+    Profiler& m_profiler;
+};
+} // namespace prism
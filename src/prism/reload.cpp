@@ -0,0 +1,65 @@
+#include "reload.h"
+
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <unordered_set>
+#include "cache.h"
+#include "include_cache.h"
+#include "render.h"
+#include "utils/mapped_file.h"
+
+prism::HotReloader::HotReloader(std::shared_ptr<OutputCache> cache)
+    : m_includes(std::make_shared<IncludeCache>()), m_cache(std::move(cache)) {
+}
+
+void prism::HotReloader::add(Processor& processor, const std::string& path) {
+    processor.bind_include_cache(m_includes);
+    processor.set_copy_sources(true);
+    processor.load(MappedFile::open(path));
+    m_entries.push_back({ &processor, path });
+    watch(m_entries.back());
+}
+
+void prism::HotReloader::watch(const Entry& entry) {
+    m_watcher.add(entry.path);
+    for (const auto& include : entry.processor->compiled()->includes) {
+        m_watcher.add(include.path);
+    }
+}
+
+std::vector<std::string> prism::HotReloader::poll(std::chrono::milliseconds timeout) {
+    auto changed = m_watcher.wait(timeout);
+    if (changed.empty()) {
+        return {};
+    }
+    std::unordered_set<std::string> paths(changed.begin(), changed.end());
+    // Parsed again on their next include, every other unit stays cached
+    for (const auto& path : changed) {
+        m_includes->invalidate(path);
+    }
+
+    std::vector<std::string> reloaded;
+    for (const auto& entry : m_entries) {
+        auto previous = entry.processor->compiled();
+        bool affected = CONTAINS(paths, entry.path) ||
+                        std::any_of(previous->includes.begin(), previous->includes.end(),
+                                    [&paths](const IncludeDependency& include) { return CONTAINS(paths, include.path); });
+        if (!affected) {
+            continue;
+        }
+        try {
+            entry.processor->load(MappedFile::open(entry.path));
+        } catch (const std::exception& e) {
+            SPDLOG_ERROR("Failed to reload {}: {}", entry.path, e.what());
+            continue;
+        }
+        if (m_cache != nullptr && entry.processor->compiled()->hash != previous->hash) {
+            for (auto mode : { OutputMode::Trim, OutputMode::Minify }) {
+                m_cache->invalidate(Renderer::cache_key(*previous, mode));
+            }
+        }
+        watch(entry);
+        reloaded.push_back(entry.path);
+    }
+    return reloaded;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "processor.h"
+#include "utils/file_watcher.h"
+
+namespace prism {
+// Keeps processors in sync with their template files and everything those
+// include. Only templates that depend on a changed file are compiled again.
+// Includes share one cache, so unchanged ones keep their parse. Only the
+// renders of reloaded templates are dropped from the output cache.
+class HotReloader {
+  public:
+    // `cache` is the output cache the processors are bound to, if any
+    explicit HotReloader(std::shared_ptr<OutputCache> cache = nullptr);
+
+    // Binds the reloader's include cache to `processor` and loads it from
+    // `path`; errors are thrown as by Processor::load. Its sources are
+    // copied, the files get edited in place. The processor has to outlive
+    // the reloader.
+    void add(Processor& processor, const std::string& path);
+    // Waits up to `timeout` for a change and reloads the templates it
+    // affects, returns the paths of those that compiled. The others keep
+    // their previous template, the error is logged.
+    std::vector<std::string> poll(std::chrono::milliseconds timeout);
+
+  private:
+    struct Entry {
+        Processor* processor;
+        std::string path;
+    };
+    // Watches the template and every file it was compiled with
+    void watch(const Entry& entry);
+
+    FileWatcher m_watcher;
+    std::shared_ptr<IncludeCache> m_includes;
+    std::shared_ptr<OutputCache> m_cache;
+    std::vector<Entry> m_entries;
+};
+} // namespace prism
@@ -0,0 +1,769 @@
+#include "render.h"
+
+#include <bit>
+#include <charconv>
+#include <optional>
+#include "cache.h"
+#include "profile.h"
+#include "utils/exceptions.h"
+#include "utils/hash.h"
+#include "utils/trace.h"
+
+prism::Renderer::Renderer(std::shared_ptr<const CompiledTemplate> compiled, std::shared_ptr<OutputCache> cache,
+                          OutputMode mode)
+    : m_compiled(std::move(compiled)), m_cache(std::move(cache)), m_mode(mode) {
+    if (m_compiled == nullptr) {
+        throw RuntimeError("No template loaded");
+    }
+    m_key = cache_key(*m_compiled, m_mode);
+}
+
+uint64_t prism::Renderer::cache_key(const CompiledTemplate& compiled, OutputMode mode) {
+    return mode == OutputMode::Trim ? compiled.hash : hash::mix(compiled.hash, mode);
+}
+
+namespace {
+// Times a directive while a profiler is bound
+class ProfileScope {
+  public:
+    ProfileScope(prism::Profiler* profiler, const prism::Node& node, prism::DirectiveKind kind)
+        : m_profiler(profiler) {
+        if (m_profiler != nullptr) {
+            m_profiler->enter(node, kind);
+        }
+    }
+    ~ProfileScope() {
+        if (m_profiler != nullptr) {
+            m_profiler->leave();
+        }
+    }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+  private:
+    prism::Profiler* m_profiler;
+};
+} // namespace
+
+template <typename T>
+prism::ContextTypes read_array(const prism::MTDArray<T>& arrayVar, std::span<const int> indices) {
+    auto length = indices.size();
+
+    if (arrayVar.dimensions.size() != length) {
+        switch (length) {
+            case 1:
+                return arrayVar.get(indices[0]);
+            case 2:
+                return arrayVar.get(indices[0], indices[1]);
+            case 3:
+                return arrayVar.get(indices[0], indices[1], indices[2]);
+            default:
+                throw prism::SyntaxError("We dont support array indexes bigger than 3");
+        }
+    }
+
+    switch (length) {
+        case 1:
+            return arrayVar.at(indices[0]);
+        case 2:
+            return arrayVar.at(indices[0], indices[1]);
+        case 3:
+            return arrayVar.at(indices[0], indices[1], indices[2]);
+        case 4:
+            return arrayVar.at(indices[0], indices[1], indices[2], indices[3]);
+    }
+    throw prism::SyntaxError("We dont support array indexes bigger than 4");
+}
+
+enum SlotState : uint8_t { SLOT_READ = 1, SLOT_WRITTEN = 2 };
+
+const prism::ContextTypes* prism::RenderState::find(const std::string& name) const {
+    if (shared == nullptr) {
+        auto item = items.find(name);
+        return item != items.end() ? &item->second : nullptr;
+    }
+    if (auto item = shared->find(name); item != shared->end()) {
+        return &item->second;
+    }
+    auto item = defaults.find(name);
+    return item != defaults.end() ? &item->second : nullptr;
+}
+
+prism::ContextItems& prism::RenderState::writable() {
+    if (shared != nullptr) {
+        // Slots keep pointing into `shared` and `defaults`, which hold the same values
+        items = *shared;
+        items.insert(defaults.begin(), defaults.end());
+        shared = nullptr;
+    }
+    return items;
+}
+
+void prism::Renderer::bind_slots(RenderState& state, const bytecode::SlotTable& table) {
+    state.bound = &table;
+    state.values.reset();
+    state.slots.assign(table.size(), Value{});
+    state.slotState.assign(table.size(), 0);
+    load_slots(state);
+}
+
+void prism::Renderer::load_slots(RenderState& state) {
+    const auto& table = *state.bound;
+    state.contextNatives = false;
+    for (size_t i = 0; i < table.size(); i++) {
+        if (table.loop[i]) {
+            continue;
+        }
+        // Arrays and natives are pointed at where they are in the context
+        auto item = state.find(table.names[i]);
+        if (item == nullptr) {
+            state.slots[i] = Value{};
+            continue;
+        }
+        state.slots[i] = state.values.make(*item);
+        auto native = std::get_if<Native>(item);
+        state.contextNatives |= native != nullptr && native->context;
+    }
+}
+
+bool prism::Renderer::calls_context(const RenderState& state, const bytecode::Program& program) {
+    for (const auto& ins : program.code) {
+        if (ins.op != bytecode::OpCode::Call) {
+            continue;
+        }
+        const auto& value = state.slots[ins.arg];
+        if (value.type == Value::Boxed && is_type(*value.boxed, Native) && std::get<Native>(*value.boxed).context) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void prism::Renderer::track_read(RenderState& state, uint32_t slot, std::span<const int> indices, const Value& value) {
+    // Loop variables and values written by the template itself are not part of the input
+    if (!state.tracking || state.bound->loop[slot] || (state.slotState[slot] & SLOT_WRITTEN)) {
+        return;
+    }
+    const auto& name = state.bound->names[slot];
+    if (indices.empty()) {
+        if (state.slotState[slot] & SLOT_READ) {
+            return;
+        }
+        state.slotState[slot] |= SLOT_READ;
+    } else {
+        auto id = hash::fnv1a(name);
+        id = hash::fnv1a(indices.data(), indices.size() * sizeof(int), id);
+        if (!state.seenReads.insert(id).second) {
+            return;
+        }
+    }
+    ReadRecord record{ name, std::vector<int>(indices.begin(), indices.end()) };
+    if (value.type == Value::Array || value.type == Value::Boxed) {
+        encode_read(record, value.boxed, state.readValues);
+    } else {
+        auto copy = to_context(value);
+        encode_read(record, &copy, state.readValues);
+    }
+    state.reads.push_back(std::move(record));
+}
+
+void prism::Renderer::track_write(RenderState& state, uint32_t slot) {
+    state.slotState[slot] |= SLOT_WRITTEN;
+}
+
+prism::Value arithmetic(prism::RenderState& state, prism::bytecode::OpCode op, const prism::Value& left,
+                        const prism::Value& right) {
+    using prism::Value;
+    using prism::bytecode::OpCode;
+    if (op == OpCode::Add && left.type == Value::String && right.type == Value::String) {
+        return Value::of(state.values.intern(*left.str + *right.str));
+    }
+
+    if (left.type == Value::Int && right.type == Value::Int) {
+        auto a = left.i;
+        auto b = right.i;
+        switch (op) {
+            case OpCode::Add:
+                return Value::of(a + b);
+            case OpCode::Sub:
+                return Value::of(a - b);
+            case OpCode::Mul:
+                return Value::of(a * b);
+            default:
+                return Value::of(a / b);
+        }
+    }
+
+    if ((left.type == Value::Int || left.type == Value::Float) && (right.type == Value::Int || right.type == Value::Float)) {
+        float a = left.type == Value::Int ? (float) left.i : left.f;
+        float b = right.type == Value::Int ? (float) right.i : right.f;
+        switch (op) {
+            case OpCode::Add:
+                return Value::of(a + b);
+            case OpCode::Sub:
+                return Value::of(a - b);
+            case OpCode::Mul:
+                return Value::of(a * b);
+            default:
+                return Value::of(a / b);
+        }
+    }
+
+    switch (op) {
+        case OpCode::Add:
+            throw prism::SyntaxError("Invalid ADD operation");
+        case OpCode::Sub:
+            throw prism::SyntaxError("Invalid SUB operation");
+        case OpCode::Mul:
+            throw prism::SyntaxError("Invalid MUL operation");
+        default:
+            throw prism::SyntaxError("Invalid DIV operation");
+    }
+}
+
+prism::Value prism::Renderer::execute(RenderState& state, const bytecode::Program& program) {
+    using bytecode::OpCode;
+    auto& stack = state.stack;
+    stack.clear();
+
+    const auto* code = program.code.data();
+    const auto size = program.code.size();
+    size_t pc = 0;
+    while (pc < size) {
+        const auto& ins = code[pc++];
+        switch (ins.op) {
+            case OpCode::PushInt:
+                stack.push_back(Value::of((int) ins.arg));
+                break;
+            case OpCode::PushFloat:
+                stack.push_back(Value::of(std::bit_cast<float>(ins.arg)));
+                break;
+            case OpCode::PushString:
+                stack.push_back(Value::of(state.values.intern(program.strings[ins.arg])));
+                break;
+            case OpCode::Load: {
+                const auto& value = state.slots[ins.arg];
+                if (value.type == Value::Void) {
+                    throw SyntaxError("Unknown variable " + state.bound->names[ins.arg]);
+                }
+                if (value.type != Value::Int && value.type != Value::Float && value.type != Value::String &&
+                    value.type != Value::Array) {
+                    throw SyntaxError("Unsupported type");
+                }
+                track_read(state, ins.arg, {}, value);
+                stack.push_back(value);
+                break;
+            }
+            case OpCode::Index: {
+                const auto& var = state.slots[ins.arg];
+                if (var.type == Value::Void) {
+                    throw SyntaxError("Unknown variable " + state.bound->names[ins.arg]);
+                }
+                if (var.type != Value::Array) {
+                    throw SyntaxError(state.bound->names[ins.arg] + " is not an array");
+                }
+                // The compiler allows at most 4 indices
+                int indices[4];
+                for (size_t i = 0; i < ins.count; i++) {
+                    const auto& index = stack[stack.size() - ins.count + i];
+                    if (index.type != Value::Int) {
+                        throw SyntaxError("Array index is not an int");
+                    }
+                    indices[i] = index.i;
+                }
+                stack.resize(stack.size() - ins.count);
+                std::span<const int> at(indices, ins.count);
+                track_read(state, ins.arg, at, var);
+                const auto& array = *var.boxed;
+                if (is_type(array, MTDArray<bool>)) {
+                    stack.push_back(state.values.make(read_array(std::get<MTDArray<bool>>(array), at)));
+                } else if (is_type(array, MTDArray<int>)) {
+                    stack.push_back(state.values.make(read_array(std::get<MTDArray<int>>(array), at)));
+                } else {
+                    stack.push_back(state.values.make(read_array(std::get<MTDArray<float>>(array), at)));
+                }
+                break;
+            }
+            case OpCode::Call: {
+                const auto& value = state.slots[ins.arg];
+                if (value.type != Value::Boxed || !is_type(*value.boxed, Native)) {
+                    throw SyntaxError("Unsupported function call " + state.bound->names[ins.arg]);
+                }
+                track_read(state, ins.arg, {}, value);
+                // The native reads its arguments in place
+                const auto& native = std::get<Native>(*value.boxed);
+                bool context = native.context;
+                // Only a native taking the context gets to see `items`
+                auto& items = context ? state.writable() : state.items;
+                NativeCall call{ items, std::span<const Value>(stack).last(ins.count), Void{} };
+                {
+                    PRISM_TRACE_SCOPE_DETAIL("native", "render", state.bound->names[ins.arg]);
+                    native.thunk(native, call);
+                }
+                stack.resize(stack.size() - ins.count);
+                stack.push_back(state.values.make(std::move(call.result)));
+                if (context) {
+                    // What it reads is not tracked, the render cannot be cached
+                    state.tracking = false;
+                    // The native may have written any entry, the directives after it see the change
+                    load_slots(state);
+                    for (auto& hoisted : state.hoisted) {
+                        hoisted.valid = false;
+                    }
+                }
+                break;
+            }
+            case OpCode::Assign: {
+                auto& value = stack.back();
+                if (value.type == Value::Range || value.type == Value::String ||
+                    (value.type == Value::Boxed && is_type(*value.boxed, ForContext))) {
+                    throw SyntaxError("Invalid assign operation");
+                }
+                track_write(state, ins.arg);
+                state.slots[ins.arg] = value;
+                if (!state.bound->loop[ins.arg]) {
+                    // Keep the context in sync for natives and getTypes()
+                    auto& item = state.writable()[state.bound->names[ins.arg]];
+                    item = to_context(value);
+                    // An array points at the entry it came from, which may be reassigned
+                    if (value.type == Value::Array || value.type == Value::Boxed) {
+                        state.slots[ins.arg] = Value::box(&item);
+                    }
+                }
+                value = Value{};
+                break;
+            }
+            case OpCode::In: {
+                const auto& name = state.bound->names[ins.arg];
+                auto& value = stack.back();
+                if (value.type == Value::Range) {
+                    value = state.values.make(ForContext{ name, GeneratedRange{ value.range.start, value.range.end } });
+                } else if (value.type == Value::Array && is_type(*value.boxed, MTDArray<int>)) {
+                    value = state.values.make(ForContext{ name, std::get<MTDArray<int>>(*value.boxed) });
+                } else if (value.type == Value::Array && is_type(*value.boxed, MTDArray<float>)) {
+                    value = state.values.make(ForContext{ name, std::get<MTDArray<float>>(*value.boxed) });
+                } else if (value.type == Value::Array) {
+                    value = state.values.make(ForContext{ name, std::get<MTDArray<bool>>(*value.boxed) });
+                } else {
+                    throw SyntaxError("Invalid IN operation");
+                }
+                break;
+            }
+            case OpCode::Not: {
+                auto& value = stack.back();
+                if (value.type != Value::Int) {
+                    throw SyntaxError("Invalid NOT operation");
+                }
+                value = Value::of(value.i == 0 ? 1 : 0);
+                break;
+            }
+            case OpCode::Or:
+            case OpCode::And: {
+                auto& left = stack.back();
+                if (left.type == Value::Float) {
+                    throw SyntaxError(ins.op == OpCode::Or ? "Invalid OR operation, float are not supported"
+                                                           : "Invalid AND operation, float are not supported");
+                }
+                bool result = left.is_true();
+                if (result == (ins.op == OpCode::Or)) {
+                    left = Value::of(result);
+                    pc = ins.arg;
+                } else {
+                    stack.pop_back();
+                }
+                break;
+            }
+            case OpCode::Truth: {
+                auto& right = stack.back();
+                if (right.type == Value::Float) {
+                    throw SyntaxError((OpCode) ins.arg == OpCode::Or ? "Invalid OR operation, float are not supported"
+                                                                     : "Invalid AND operation, float are not supported");
+                }
+                right = Value::of(right.is_true());
+                break;
+            }
+            case OpCode::Equal: {
+                const auto& left = stack[stack.size() - 2];
+                const auto& right = stack.back();
+                bool result;
+                if (left.type == Value::Int && right.type == Value::Int) {
+                    result = left.i == right.i;
+                } else if (left.type == Value::Float && right.type == Value::Float) {
+                    result = left.f == right.f;
+                } else if (left.type == Value::String && right.type == Value::String) {
+                    // Interned, equal strings share their handle
+                    result = left.str == right.str;
+                } else {
+                    throw SyntaxError("Invalid EQUAL operation");
+                }
+                stack.pop_back();
+                stack.back() = Value::of(result ? 1 : 0);
+                break;
+            }
+            case OpCode::Add:
+            case OpCode::Sub:
+            case OpCode::Mul:
+            case OpCode::Div: {
+                auto result = arithmetic(state, ins.op, stack[stack.size() - 2], stack.back());
+                stack.pop_back();
+                stack.back() = result;
+                break;
+            }
+            case OpCode::Range: {
+                const auto& start = stack[stack.size() - 2];
+                const auto& end = stack.back();
+                if (start.type != Value::Int || end.type != Value::Int) {
+                    throw SyntaxError("Invalid range");
+                }
+                auto range = Value::of((uint32_t) start.i, (uint32_t) end.i);
+                stack.pop_back();
+                stack.back() = range;
+                break;
+            }
+            case OpCode::Jump:
+                pc = ins.arg;
+                break;
+            case OpCode::JumpIfFalse: {
+                bool condition = stack.back().is_true();
+                stack.pop_back();
+                if (!condition) {
+                    pc = ins.arg;
+                }
+                break;
+            }
+        }
+    }
+
+    auto result = stack.back();
+    stack.pop_back();
+    return result;
+}
+
+prism::Value prism::Renderer::execute_at(RenderState& state, const bytecode::Program& program, const Node& node) {
+    try {
+        if (program.hoisted != bytecode::NOT_HOISTED) {
+            auto& hoisted = state.hoisted[program.hoisted];
+            if (!hoisted.valid) {
+                hoisted.value = execute(state, program);
+                hoisted.valid = true;
+            }
+            return hoisted.value;
+        }
+        return execute(state, program);
+    } catch (const SyntaxError& e) {
+        throw SyntaxError(node.location.to_string() + ": " + e.what());
+    }
+}
+
+void prism::Renderer::write_value(OutputSink& sink, const ContextTypes& value) {
+    if (is_type(value, int)) {
+        char buffer[16];
+        auto end = std::to_chars(buffer, buffer + sizeof(buffer), std::get<int>(value)).ptr;
+        sink.write(buffer, end - buffer);
+    } else if (is_type(value, float)) {
+        // Same as streaming the float, "%g" is the iostream default
+        char buffer[32];
+        auto end = format_float(buffer, buffer + sizeof(buffer), std::get<float>(value), 6);
+        sink.write(buffer, end - buffer);
+    } else if (is_type(value, std::string)) {
+        sink.write(std::get<std::string>(value));
+    } else if (!is_type(value, Void)) {
+        throw prism::SyntaxError("Unsupported type");
+    }
+}
+
+void prism::Renderer::write_value(OutputSink& sink, const Value& value) {
+    if (value.type == Value::Int) {
+        char buffer[16];
+        auto end = std::to_chars(buffer, buffer + sizeof(buffer), value.i).ptr;
+        sink.write(buffer, end - buffer);
+    } else if (value.type == Value::Float) {
+        char buffer[32];
+        auto end = format_float(buffer, buffer + sizeof(buffer), value.f, 6);
+        sink.write(buffer, end - buffer);
+    } else if (value.type == Value::String) {
+        sink.write(*value.str);
+    } else if (value.type != Value::Void) {
+        throw prism::SyntaxError("Unsupported type");
+    }
+}
+
+void prism::Renderer::evaluate_node(RenderState& state, const std::shared_ptr<std::vector<std::shared_ptr<prism::Node>>>& children) const {
+    for (const auto& child : *children) {
+        if (is_type(child->node, prism::TextNode)) {
+            state.output->write(std::get<prism::TextNode>(child->node).text);
+        } else if (is_type(child->node, prism::VariableNode)) {
+            ProfileScope scope(state.profiler, *child, DirectiveKind::Expression);
+            const auto& var = std::get<prism::VariableNode>(child->node);
+            write_value(*state.output, execute_at(state, var.program, *child));
+        } else if (is_type(child->node, prism::IfNode)) {
+            ProfileScope scope(state.profiler, *child, DirectiveKind::If);
+            const auto& ifNode = std::get<prism::IfNode>(child->node);
+            if (execute_at(state, ifNode.program, *child).is_true()) {
+                evaluate_node(state, ifNode.children);
+                continue;
+            }
+            bool taken = false;
+            for (const auto& node : ifNode.elseIfs) {
+                ProfileScope branch(state.profiler, *node, DirectiveKind::ElseIf);
+                const auto& elseIf = std::get<prism::ElseIfNode>(node->node);
+                if (execute_at(state, elseIf.program, *node).is_true()) {
+                    evaluate_node(state, elseIf.children);
+                    taken = true;
+                    break;
+                }
+            }
+
+            if (!taken && ifNode.elseBody != nullptr) {
+                const auto& elseNode = std::get<prism::ElseNode>(ifNode.elseBody->node);
+                evaluate_node(state, elseNode.children);
+            }
+
+        } else if (is_type(child->node, prism::ForNode)) {
+            ProfileScope scope(state.profiler, *child, DirectiveKind::For);
+            const auto& forNode = std::get<prism::ForNode>(child->node);
+            auto iterable = execute_at(state, forNode.program, *child);
+            for (auto index : forNode.hoisted) {
+                state.hoisted[index].valid = false;
+            }
+
+            if (iterable.type == Value::Range) {
+                for (auto i = iterable.range.start; i < iterable.range.end; i++) {
+                    state.slots[forNode.slot] = Value::of((int) i);
+                    evaluate_node(state, forNode.children);
+                }
+                state.slots[forNode.slot] = Value{};
+            } else if (iterable.type == Value::Array && is_type(*iterable.boxed, MTDArray<bool>)) {
+                array_iterate(state, forNode, std::get<MTDArray<bool>>(*iterable.boxed));
+            } else if (iterable.type == Value::Array && is_type(*iterable.boxed, MTDArray<int>)) {
+                array_iterate(state, forNode, std::get<MTDArray<int>>(*iterable.boxed));
+            } else if (iterable.type == Value::Array) {
+                array_iterate(state, forNode, std::get<MTDArray<float>>(*iterable.boxed));
+            } else {
+                throw SyntaxError("Invalid IN operation");
+            }
+        } else if (is_type(child->node, prism::DecisionNode)) {
+            const auto& decision = std::get<prism::DecisionNode>(child->node);
+            // Profiled as written, the chains it flattened are directives of their own
+            if (state.profiler != nullptr || !select(state, *decision.program)) {
+                evaluate_node(state, decision.children);
+            }
+        } else if (is_type(child->node, prism::HoistNode)) {
+            const auto& hoist = std::get<prism::HoistNode>(child->node);
+            auto& cached = state.hoisted[hoist.index];
+            if (!cached.valid) {
+                cached.text.clear();
+                StringSink captured(cached.text);
+                // Counted as the directives inside write it, not again when it is replayed below
+                std::optional<ProfileSink> counted;
+                auto* output = state.output;
+                state.output = &captured;
+                if (state.profiler != nullptr) {
+                    state.output = &counted.emplace(captured, *state.profiler);
+                }
+                try {
+                    evaluate_node(state, hoist.children);
+                } catch (...) {
+                    state.output = output;
+                    throw;
+                }
+                state.output = output;
+                cached.valid = true;
+                if (state.profiler != nullptr) {
+                    state.profiler->uncount(cached.text.size());
+                }
+            }
+            state.output->write(cached.text);
+        }
+    }
+}
+
+bool prism::Renderer::select(RenderState& state, const decision::Program& program) {
+    if (state.contextNatives) {
+        // Such a native could change an atom once the mask is taken, the
+        // children test each condition when they get to it instead
+        for (const auto& segment : program.segments) {
+            if (segment.node != nullptr &&
+                calls_context(state, std::get<prism::VariableNode>(segment.node->node).program)) {
+                return false;
+            }
+        }
+    }
+    uint64_t mask = 0;
+    for (size_t i = 0; i < program.atoms.size(); i++) {
+        const auto& atom = program.atoms[i];
+        const auto& value = state.slots[atom.slot];
+        if (value.type != Value::Int) {
+            return false;
+        }
+        mask |= (uint64_t) (value.i == atom.value) << i;
+    }
+    if (state.tracking) {
+        for (const auto& atom : program.atoms) {
+            track_read(state, atom.slot, {}, state.slots[atom.slot]);
+        }
+    }
+
+    for (const auto& segment : program.segments) {
+        if (!program.holds(segment.guard, mask)) {
+            continue;
+        }
+        if (segment.node == nullptr) {
+            state.output->write(segment.text);
+        } else {
+            const auto& var = std::get<prism::VariableNode>(segment.node->node);
+            write_value(*state.output, execute_at(state, var.program, *segment.node));
+        }
+    }
+    return true;
+}
+
+void prism::Renderer::check_includes(const RenderState& state) const {
+    if (!includes_linked_for(*m_compiled, state.shared != nullptr ? *state.shared : state.items)) {
+        throw RuntimeError("Include paths of the template read other values in this context, load it again");
+    }
+}
+
+void prism::Renderer::apply_setting_defaults(RenderState& state) const {
+    state.defaults.clear();
+    // A shared context is left as it is
+    auto& items = state.shared != nullptr ? state.defaults : state.items;
+    for (const auto& decl : m_compiled->settings) {
+        if (state.find(decl.var) != nullptr) {
+            continue;
+        }
+        if (decl.type == "toggle") {
+            // @if(VAR) requires an int that equals exactly 1
+            items[decl.var] = ContextTypes{ decl.def != 0.0f ? 1 : 0 };
+        } else if (decl.type == "int" || decl.type == "enum") {
+            // ints emit without a decimal and support @if(VAR == n)
+            items[decl.var] = ContextTypes{ (int) decl.def };
+        } else if (decl.type == "color") {
+            // Component list; templates wrap it: vec3(@{VAR})
+            items[decl.var] =
+                ContextTypes{ format_float_literal(decl.defColor[0]) + ", " + format_float_literal(decl.defColor[1]) +
+                              ", " + format_float_literal(decl.defColor[2]) };
+        } else {
+            // Pre-formatted so @{VAR} emits a valid GLSL float
+            // literal; the float path drops the ".0"
+            items[decl.var] = ContextTypes{ format_float_literal(decl.def) };
+        }
+    }
+}
+
+void prism::Renderer::render(RenderState& state, OutputSink& sink) const {
+    PRISM_TRACE_SCOPE("render", "render");
+    check_includes(state);
+    apply_setting_defaults(state);
+
+    state.tracking = m_cache != nullptr && state.profiler == nullptr;
+    state.reads.clear();
+    state.readValues.clear();
+    state.seenReads.clear();
+    if (state.tracking) {
+        auto cached = m_cache->find(m_key, [&state](const std::string& name) { return state.find(name); });
+        if (cached.has_value()) {
+            state.tracking = false;
+            for (const auto& write : cached->writes) {
+                state.writable()[write.first] = write.second;
+            }
+            sink.write(cached->output);
+            sink.flush();
+            return;
+        }
+    }
+
+    // The cache keeps its own copy of the output, so only then is it
+    // captured before reaching the caller's sink. A native taking the
+    // context turns tracking off, the capture still has to be passed on.
+    StringSink captured;
+    bool capturing = state.tracking;
+    auto& target = capturing ? (OutputSink&) captured : sink;
+    LineTrimSink trimmed(target);
+    MinifySink minified(target);
+    auto& cleaned = m_mode == OutputMode::Minify ? (OutputSink&) minified : trimmed;
+    try {
+        walk(state, cleaned);
+    } catch (...) {
+        state.tracking = false;
+        throw;
+    }
+    // Trimming runs as the output streams, what is left is the tail and the
+    // copy out of the cache capture
+    PRISM_TRACE_SCOPE("output", "render");
+    cleaned.flush();
+
+    if (!capturing) {
+        return;
+    }
+    sink.write(captured.str());
+    sink.flush();
+    if (state.tracking) {
+        state.tracking = false;
+        // What the render assigned, replayed into the context on a hit
+        CachedRender render{ std::move(captured.str()), {} };
+        const auto& table = *state.bound;
+        for (size_t i = 0; i < table.size(); i++) {
+            if (!table.loop[i] && (state.slotState[i] & SLOT_WRITTEN)) {
+                render.writes.emplace_back(table.names[i], state.items[table.names[i]]);
+            }
+        }
+        m_cache->insert(m_key, std::move(state.reads), std::move(state.readValues), std::move(render));
+        state.reads.clear();
+    }
+}
+
+void prism::Renderer::render_raw(RenderState& state, OutputSink& sink) const {
+    check_includes(state);
+    apply_setting_defaults(state);
+    state.tracking = false;
+    walk(state, sink);
+    sink.flush();
+}
+
+void prism::Renderer::walk(RenderState& state, OutputSink& sink) const {
+    PRISM_TRACE_SCOPE("evaluate", "render");
+    bind_slots(state, m_compiled->slots);
+    state.hoisted.resize(m_compiled->hoisted);
+    for (auto& hoisted : state.hoisted) {
+        hoisted.valid = false;
+    }
+    state.output = &sink;
+    std::optional<ProfileSink> counted;
+    if (state.profiler != nullptr) {
+        state.output = &counted.emplace(sink, *state.profiler);
+    }
+    try {
+        evaluate_node(state, std::get<prism::RootNode>(m_compiled->root->node).children);
+    } catch (...) {
+        state.output = nullptr;
+        throw;
+    }
+    state.output = nullptr;
+}
+
+std::string prism::Renderer::render(const ContextItems& items) const {
+    StringSink result;
+    render(items, result);
+    return std::move(result.str());
+}
+
+void prism::Renderer::render(const ContextItems& items, OutputSink& sink) const {
+    RenderState state;
+    state.shared = &items;
+    render(state, sink);
+}
+
+prism::ContextTypes prism::Renderer::evaluate(const bytecode::Program& program, const bytecode::SlotTable& slots,
+                                              ContextItems& items) {
+    RenderState state;
+    state.items = std::move(items);
+    bind_slots(state, slots);
+    auto result = to_context(execute(state, program));
+    items = std::move(state.items);
+    return result;
+}
+
+prism::ContextTypes prism::Renderer::evaluate(const bytecode::Program& program, RenderState& state) {
+    return to_context(execute(state, program));
+}
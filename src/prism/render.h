@@ -0,0 +1,125 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_set>
+
+#include "processor.h"
+#include "value.h"
+
+namespace prism {
+class Profiler;
+
+// Value of an expression or output of a block that does not change while
+// its loop runs
+struct Hoisted {
+    bool valid = false;
+    Value value;
+    std::string text;
+};
+
+// Everything a single render mutates. Keeping one per thread and reusing it
+// across renders keeps its buffers warm.
+struct RenderState {
+    // The render's own copy of the context; @setting defaults, assignments
+    // and natives write here
+    ContextItems items;
+    // Set to render against the caller's context in place. `items` gets a
+    // copy of it on the first write, until then defaults go to `defaults`.
+    const ContextItems* shared = nullptr;
+    ContextItems defaults;
+    const bytecode::SlotTable* bound = nullptr;
+    std::vector<Value> slots;
+    std::vector<uint8_t> slotState;
+    std::vector<Value> stack;
+    // Strings and boxed values the slots and the stack point at
+    ValueStore values;
+    // Indexed by hoist::compile, reset when their loop is entered
+    std::vector<Hoisted> hoisted;
+    // Set when a slot holds a native that takes the context; a call of one
+    // reloads the slots and drops the hoisted values
+    bool contextNatives = false;
+    OutputSink* output = nullptr;
+
+    // Times the directives of renders while set, which then skip the cache
+    Profiler* profiler = nullptr;
+
+    // Reads of the render, recorded only while a cache is bound
+    bool tracking = false;
+    ReadSet reads;
+    std::string readValues;
+    std::unordered_set<uint64_t> seenReads;
+
+    // The entry `name` of the context, nullptr if there is none
+    const ContextTypes* find(const std::string& name) const;
+    // The context to write to, copied from `shared` if it is still set
+    ContextItems& writable();
+};
+
+// Renders a compiled template. The template is never written to, so any
+// number of threads can render the same one at once without locking, each
+// with its own RenderState. The cache, if any, synchronizes itself.
+class Renderer {
+  public:
+    explicit Renderer(std::shared_ptr<const CompiledTemplate> compiled, std::shared_ptr<OutputCache> cache = nullptr,
+                      OutputMode mode = OutputMode::Trim);
+
+    // `items` are copied only if the render writes to them
+    std::string render(const ContextItems& items) const;
+    void render(const ContextItems& items, OutputSink& sink) const;
+    // Renders against state.items, which keeps whatever the render wrote
+    void render(RenderState& state, OutputSink& sink) const;
+    // The bare tree walk: no cache and no clean up
+    void render_raw(RenderState& state, OutputSink& sink) const;
+
+    const std::shared_ptr<const CompiledTemplate>& compiled() const {
+        return m_compiled;
+    }
+    // What renders of a template are stored under in an OutputCache
+    static uint64_t cache_key(const CompiledTemplate& compiled, OutputMode mode);
+    // Runs a program compiled against `slots` outside of any template
+    static ContextTypes evaluate(const bytecode::Program& program, const bytecode::SlotTable& slots,
+                                 ContextItems& items);
+    // Runs a program against the slots already bound in `state`
+    static ContextTypes evaluate(const bytecode::Program& program, RenderState& state);
+    // Writes a directive's value the way a render does; Void writes nothing
+    static void write_value(OutputSink& sink, const ContextTypes& value);
+    static void write_value(OutputSink& sink, const Value& value);
+
+  private:
+    void walk(RenderState& state, OutputSink& sink) const;
+    static Value execute(RenderState& state, const bytecode::Program& program);
+    // Same, with errors pointing at the directive of `node`
+    static Value execute_at(RenderState& state, const bytecode::Program& program, const Node& node);
+    void evaluate_node(RenderState& state, const std::shared_ptr<std::vector<std::shared_ptr<Node>>>& children) const;
+    // Emits the segments of a decision node, false if an atom is not an int
+    // and the node has to be walked instead
+    static bool select(RenderState& state, const decision::Program& program);
+    // Throws if the includes were linked for other values of the context
+    void check_includes(const RenderState& state) const;
+    void apply_setting_defaults(RenderState& state) const;
+    static void bind_slots(RenderState& state, const bytecode::SlotTable& table);
+    // Points every slot but the loop variables at its context entry
+    static void load_slots(RenderState& state);
+    // Whether `program` calls a native that takes the context
+    static bool calls_context(const RenderState& state, const bytecode::Program& program);
+    static void track_read(RenderState& state, uint32_t slot, std::span<const int> indices, const Value& value);
+    static void track_write(RenderState& state, uint32_t slot);
+
+    template <typename T>
+    void array_iterate(RenderState& state, const ForNode& node, const MTDArray<T>& array) const {
+        for (size_t i = 0; i < array.dimensions[0]; i++) {
+            state.slots[node.slot] = Value::of(array.at(i));
+            evaluate_node(state, node.children);
+        }
+        state.slots[node.slot] = Value{};
+    }
+
+    std::shared_ptr<const CompiledTemplate> m_compiled;
+    std::shared_ptr<OutputCache> m_cache;
+    OutputMode m_mode;
+    // Key of the template's renders in the cache, which depend on the mode
+    uint64_t m_key;
+};
+} // namespace prism
@@ -0,0 +1,259 @@
+#include "sink.h"
+
+#include <cctype>
+#include <algorithm>
+#include <cstring>
+#include "utils/exceptions.h"
+
+void prism::BufferSink::write(const char* data, size_t size) {
+    if (size > m_capacity - m_size) {
+        throw RuntimeError("Output buffer too small");
+    }
+    std::memcpy(m_data + m_size, data, size);
+    m_size += size;
+}
+
+prism::CallbackSink::CallbackSink(ChunkFunc callback, size_t chunkSize)
+    : m_callback(std::move(callback)), m_chunkSize(chunkSize == 0 ? 1 : chunkSize) {
+    m_chunk.reserve(m_chunkSize);
+}
+
+prism::CallbackSink::~CallbackSink() {
+    if (!m_chunk.empty()) {
+        m_callback(m_chunk);
+    }
+}
+
+void prism::CallbackSink::write(const char* data, size_t size) {
+    while (size > 0) {
+        auto count = std::min(size, m_chunkSize - m_chunk.size());
+        m_chunk.append(data, count);
+        data += count;
+        size -= count;
+        if (m_chunk.size() == m_chunkSize) {
+            m_callback(m_chunk);
+            m_chunk.clear();
+        }
+    }
+}
+
+void prism::CallbackSink::flush() {
+    if (!m_chunk.empty()) {
+        m_callback(m_chunk);
+        m_chunk.clear();
+    }
+}
+
+namespace {
+// Characters of identifiers and numbers
+bool is_word(char ch) {
+    return std::isalnum((unsigned char) ch) || ch == '_' || ch == '.';
+}
+
+// Never part of a longer token
+bool is_separator(char ch) {
+    return ch == '{' || ch == '}' || ch == '(' || ch == ')' || ch == '[' || ch == ']' || ch == ';' || ch == ',';
+}
+} // namespace
+
+void prism::MinifySink::write(const char* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        auto ch = data[i];
+        switch (m_state) {
+            case State::Code:
+                code(ch);
+                break;
+            case State::Slash:
+                if (ch == '/') {
+                    m_state = State::LineComment;
+                } else if (ch == '*') {
+                    m_state = State::BlockComment;
+                } else {
+                    // A division after all
+                    m_state = State::Code;
+                    emit('/');
+                    code(ch);
+                }
+                break;
+            case State::LineComment:
+                if (ch == '\n') {
+                    m_state = State::Code;
+                    code(ch);
+                }
+                break;
+            case State::BlockComment:
+            case State::BlockStar:
+                if (m_state == State::BlockStar && ch == '/') {
+                    m_state = State::Code;
+                    m_space = true;
+                } else {
+                    m_state = ch == '*' ? State::BlockStar : State::BlockComment;
+                }
+                break;
+            case State::Directive:
+                if (ch == '\n' && m_last != '\\') {
+                    m_pending.clear();
+                    m_buffer.push_back('\n');
+                    m_last = '\n';
+                    m_lineStart = true;
+                    m_state = State::Code;
+                } else if (std::isspace((unsigned char) ch)) {
+                    m_pending.push_back(ch);
+                } else {
+                    m_buffer.append(m_pending);
+                    m_pending.clear();
+                    m_buffer.push_back(ch);
+                    m_last = ch;
+                }
+                break;
+        }
+    }
+    if (m_buffer.size() >= 4096) {
+        m_target.write(m_buffer.data(), m_buffer.size());
+        m_buffer.clear();
+    }
+}
+
+void prism::MinifySink::code(char ch) {
+    if (ch == '\n') {
+        m_space = true;
+        m_lineStart = true;
+    } else if (std::isspace((unsigned char) ch)) {
+        m_space = true;
+    } else if (ch == '/') {
+        m_state = State::Slash;
+        m_lineStart = false;
+    } else if (ch == '#' && m_lineStart) {
+        if (m_last != '\n') {
+            m_buffer.push_back('\n');
+        }
+        m_buffer.push_back('#');
+        m_last = '#';
+        m_space = false;
+        m_state = State::Directive;
+    } else {
+        emit(ch);
+        m_lineStart = false;
+    }
+}
+
+void prism::MinifySink::emit(char ch) {
+    // Words next to words and operators next to operators could merge
+    if (m_space && m_last != '\n' && !is_separator(m_last) && !is_separator(ch) && is_word(m_last) == is_word(ch)) {
+        m_buffer.push_back(' ');
+    }
+    m_buffer.push_back(ch);
+    m_last = ch;
+    m_space = false;
+}
+
+void prism::MinifySink::flush() {
+    if (m_state == State::Slash) {
+        emit('/');
+    }
+    if (m_last != '\n') {
+        m_buffer.push_back('\n');
+    }
+    m_target.write(m_buffer.data(), m_buffer.size());
+    m_buffer.clear();
+    m_pending.clear();
+    m_state = State::Code;
+    m_lineStart = true;
+    m_space = false;
+    m_last = '\n';
+    m_target.flush();
+}
+
+void prism::ScatterSink::write(const char* data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    m_size += size;
+    // Pointer comparison across objects is only defined through std::less
+    std::less<const char*> before;
+    if (!before(data, m_stable.data()) && !before(m_stable.data() + m_stable.size(), data + size)) {
+        size_t offset = data - m_stable.data();
+        if (!m_spans.empty() && !m_spans.back().owned && m_spans.back().offset + m_spans.back().size == offset) {
+            m_spans.back().size += size;
+        } else {
+            m_spans.push_back({ false, offset, size });
+        }
+        return;
+    }
+    if (!m_spans.empty() && m_spans.back().owned) {
+        m_spans.back().size += size;
+    } else {
+        m_spans.push_back({ true, m_buffer.size(), size });
+    }
+    m_buffer.append(data, size);
+}
+
+void prism::ScatterSink::flush() {
+    if (m_target == nullptr) {
+        return;
+    }
+    for (const auto& span : m_spans) {
+        m_target->write(piece(span));
+    }
+    m_target->flush();
+    clear();
+}
+
+void prism::ScatterSink::clear() {
+    m_buffer.clear();
+    m_spans.clear();
+    m_size = 0;
+}
+
+std::string prism::ScatterSink::str() const {
+    std::string result;
+    result.reserve(m_size);
+    for (const auto& span : m_spans) {
+        result.append(piece(span));
+    }
+    return result;
+}
+
+void prism::LineTrimSink::write(const char* data, size_t size) {
+    size_t i = 0;
+    while (i < size) {
+        auto ch = (unsigned char) data[i];
+        if (ch == '\n') {
+            if (m_started) {
+                m_target.write("\n", 1);
+                m_started = false;
+            }
+            m_pending.clear();
+            i++;
+            continue;
+        }
+        if (std::isspace(ch)) {
+            if (m_started) {
+                m_pending.push_back((char) ch);
+            }
+            i++;
+            continue;
+        }
+
+        // Forward the whole run of visible characters at once
+        auto start = i;
+        while (i < size && !std::isspace((unsigned char) data[i])) {
+            i++;
+        }
+        if (!m_pending.empty()) {
+            m_target.write(m_pending.data(), m_pending.size());
+            m_pending.clear();
+        }
+        m_target.write(data + start, i - start);
+        m_started = true;
+    }
+}
+
+void prism::LineTrimSink::flush() {
+    if (m_started) {
+        m_target.write("\n", 1);
+        m_started = false;
+    }
+    m_pending.clear();
+    m_target.flush();
+}
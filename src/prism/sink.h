@@ -0,0 +1,184 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <functional>
+#include <string_view>
+
+namespace prism {
+// Clean up a render applies to its output
+enum class OutputMode {
+    // Trim every line and drop the blank ones
+    Trim,
+    // Also strip comments and collapse whitespace, GLSL preprocessor lines are kept as they are
+    Minify,
+};
+
+// Destination of rendered output. Renders write many small pieces in order
+// and call flush() once when they are done.
+class OutputSink {
+  public:
+    virtual ~OutputSink() = default;
+    virtual void write(const char* data, size_t size) = 0;
+    virtual void flush() {
+    }
+    void write(std::string_view str) {
+        write(str.data(), str.size());
+    }
+};
+
+// Writes into a caller-provided buffer, throws once it is full
+class BufferSink : public OutputSink {
+  public:
+    BufferSink(char* data, size_t capacity) : m_data(data), m_capacity(capacity) {
+    }
+    void write(const char* data, size_t size) override;
+    using OutputSink::write;
+    size_t size() const {
+        return m_size;
+    }
+    std::string_view view() const {
+        return { m_data, m_size };
+    }
+
+  private:
+    char* m_data;
+    size_t m_capacity;
+    size_t m_size = 0;
+};
+
+// Appends to a growable string, its own or the caller's
+class StringSink : public OutputSink {
+  public:
+    StringSink() : m_target(m_own) {
+    }
+    explicit StringSink(std::string& target) : m_target(target) {
+    }
+    StringSink(const StringSink&) = delete;
+    StringSink& operator=(const StringSink&) = delete;
+    void write(const char* data, size_t size) override {
+        m_target.append(data, size);
+    }
+    using OutputSink::write;
+    std::string& str() {
+        return m_target;
+    }
+
+  private:
+    std::string m_own;
+    std::string& m_target;
+};
+
+// Hands the output to `callback` in chunks of up to `chunkSize` bytes
+class CallbackSink : public OutputSink {
+  public:
+    typedef std::function<void(std::string_view)> ChunkFunc;
+
+    explicit CallbackSink(ChunkFunc callback, size_t chunkSize = 4096);
+    ~CallbackSink() override;
+    void write(const char* data, size_t size) override;
+    using OutputSink::write;
+    void flush() override;
+
+  private:
+    ChunkFunc m_callback;
+    std::string m_chunk;
+    size_t m_chunkSize;
+};
+
+// Keeps the output as a list of spans instead of one string. Writes that
+// lie inside `stable`, usually a template's text pool, are referenced where
+// they are; everything else is copied to a buffer of the sink's own.
+// flush() hands the pieces to `target` in order, a writev() or a
+// glShaderSource() can also take them straight from spans().
+class ScatterSink : public OutputSink {
+  public:
+    struct Span {
+        // Into the sink's buffer rather than into `stable`
+        bool owned;
+        size_t offset;
+        size_t size;
+    };
+
+    explicit ScatterSink(std::string_view stable, OutputSink* target = nullptr)
+        : m_stable(stable), m_target(target) {
+    }
+    void write(const char* data, size_t size) override;
+    using OutputSink::write;
+    // Writes every piece to the target, if any, and starts over
+    void flush() override;
+    void clear();
+
+    const std::vector<Span>& spans() const {
+        return m_spans;
+    }
+    std::string_view piece(const Span& span) const {
+        return std::string_view(span.owned ? std::string_view(m_buffer) : m_stable).substr(span.offset, span.size);
+    }
+    size_t size() const {
+        return m_size;
+    }
+    // The pieces joined
+    std::string str() const;
+
+  private:
+    std::string_view m_stable;
+    OutputSink* m_target;
+    std::string m_buffer;
+    std::vector<Span> m_spans;
+    size_t m_size = 0;
+};
+
+// Trims every line and drops the blank ones on their way into `target`,
+// the streaming form of splitting the output on '\n' and trimming each line.
+class LineTrimSink : public OutputSink {
+  public:
+    explicit LineTrimSink(OutputSink& target) : m_target(target) {
+    }
+    void write(const char* data, size_t size) override;
+    using OutputSink::write;
+    // Terminates the last line and flushes the target
+    void flush() override;
+
+  private:
+    OutputSink& m_target;
+    // Whitespace after the last visible character of the line, written
+    // only if more visible characters follow
+    std::string m_pending;
+    bool m_started = false;
+};
+
+// Strips // and /* */ comments and collapses whitespace on the way into
+// `target`, for GLSL. Whitespace between two words or two operators becomes
+// one space, elsewhere it is dropped. Preprocessor directives stay on lines
+// of their own and are only trimmed.
+class MinifySink : public OutputSink {
+  public:
+    explicit MinifySink(OutputSink& target) : m_target(target) {
+    }
+    void write(const char* data, size_t size) override;
+    using OutputSink::write;
+    // Terminates the last line and flushes the target
+    void flush() override;
+
+  private:
+    enum class State { Code, Slash, LineComment, BlockComment, BlockStar, Directive };
+
+    void code(char ch);
+    void emit(char ch);
+
+    OutputSink& m_target;
+    State m_state = State::Code;
+    // Only whitespace since the last newline, a '#' starts a directive
+    bool m_lineStart = true;
+    // Whitespace or a comment since the last character emitted
+    bool m_space = false;
+    // Last character emitted, '\n' at the start of the output
+    char m_last = '\n';
+    // Whitespace of a directive, written only if more of it follows
+    std::string m_pending;
+    // Output is batched rather than written a character at a time
+    std::string m_buffer;
+};
+} // namespace prism
@@ -0,0 +1,381 @@
+#include "specialize.h"
+
+#include <bit>
+#include <functional>
+#include "cache.h"
+#include "hoist.h"
+#include "render.h"
+#include "utils/hash.h"
+
+namespace {
+using prism::bytecode::OpCode;
+typedef std::vector<std::shared_ptr<prism::Node>> NodeList;
+
+// Longest loop unrolled, longer ones are kept as loops
+constexpr size_t MAX_UNROLL = 64;
+
+void for_each_program(const NodeList& nodes, const std::function<void(const prism::bytecode::Program&)>& fn) {
+    for (const auto& node : nodes) {
+        if (auto var = std::get_if<prism::VariableNode>(&node->node)) {
+            fn(var->program);
+        } else if (auto ifNode = std::get_if<prism::IfNode>(&node->node)) {
+            fn(ifNode->program);
+            for_each_program(*ifNode->children, fn);
+        } else if (auto elseIf = std::get_if<prism::ElseIfNode>(&node->node)) {
+            fn(elseIf->program);
+            for_each_program(*elseIf->children, fn);
+        } else if (auto elseNode = std::get_if<prism::ElseNode>(&node->node)) {
+            for_each_program(*elseNode->children, fn);
+        } else if (auto forNode = std::get_if<prism::ForNode>(&node->node)) {
+            fn(forNode->program);
+            for_each_program(*forNode->children, fn);
+        } else if (auto decision = std::get_if<prism::DecisionNode>(&node->node)) {
+            for_each_program(*decision->children, fn);
+        } else if (auto hoist = std::get_if<prism::HoistNode>(&node->node)) {
+            for_each_program(*hoist->children, fn);
+        }
+    }
+}
+
+bool assigns(const NodeList& nodes) {
+    bool found = false;
+    for_each_program(nodes, [&found](const prism::bytecode::Program& program) {
+        for (const auto& ins : program.code) {
+            found |= ins.op == OpCode::Assign;
+        }
+    });
+    return found;
+}
+
+// Consecutive text of the residual tree, emitted as a single node
+struct TextRun {
+    std::string buffer;
+    // The only piece so far when it can be pointed at as is
+    std::string_view view;
+    size_t pieces = 0;
+    prism::SourceLocation location;
+};
+
+class Specializer {
+  public:
+    Specializer(prism::CompiledTemplate& out, const prism::ContextItems& statics) : m_out(out) {
+        const auto& slots = out.slots;
+        m_state.bound = &slots;
+        m_state.slots.assign(slots.size(), prism::Value{});
+        m_state.slotState.assign(slots.size(), 0);
+        m_known.assign(slots.size(), false);
+
+        std::vector<bool> assigned(slots.size(), false);
+        std::vector<uint32_t> called;
+        for_each_program(*std::get<prism::RootNode>(out.base->root->node).children,
+                         [&assigned, &called](const prism::bytecode::Program& program) {
+                             for (const auto& ins : program.code) {
+                                 if (ins.op == OpCode::Assign) {
+                                     assigned[ins.arg] = true;
+                                 } else if (ins.op == OpCode::Call) {
+                                     called.push_back(ins.arg);
+                                 }
+                             }
+                         });
+
+        out.hash = out.base->hash;
+        // A native taking the context may write any entry, so nothing is fixed
+        // unless every native called is among the statics and does not take it
+        for (auto slot : called) {
+            auto item = statics.find(slots.names[slot]);
+            auto native = item != statics.end() ? std::get_if<prism::Native>(&item->second) : nullptr;
+            if (native == nullptr || native->context) {
+                return;
+            }
+        }
+        for (size_t i = 0; i < slots.size(); i++) {
+            auto item = statics.find(slots.names[i]);
+            if (slots.loop[i] || assigned[i] || item == statics.end()) {
+                continue;
+            }
+            m_state.slots[i] = m_state.values.make(item->second);
+            m_known[i] = true;
+            out.hash = prism::hash::fnv1a(slots.names[i], out.hash);
+            out.hash = prism::hash::mix(out.hash, prism::hash_read({ slots.names[i], {} }, &item->second));
+        }
+    }
+
+    void run() {
+        m_out.root = std::make_shared<prism::Node>(prism::RootNode{ std::make_shared<NodeList>() }, nullptr);
+        TextRun run;
+        auto& children = *std::get<prism::RootNode>(m_out.root->node).children;
+        list(*std::get<prism::RootNode>(m_out.base->root->node).children, m_out.root, children, run);
+        flush(run, m_out.root, children);
+    }
+
+  private:
+    // The value of `program` if it only reads fixed slots and cannot fail
+    std::optional<prism::ContextTypes> fold(const prism::bytecode::Program& program) {
+        for (const auto& ins : program.code) {
+            if (ins.op == OpCode::Call || ins.op == OpCode::Assign) {
+                return std::nullopt;
+            }
+            if ((ins.op == OpCode::Load || ins.op == OpCode::Index) && !m_known[ins.arg]) {
+                return std::nullopt;
+            }
+        }
+        try {
+            return prism::Renderer::evaluate(program, m_state);
+        } catch (const std::exception&) {
+            // Left for the render to report, it may never get there
+            return std::nullopt;
+        }
+    }
+
+    // Loads of fixed numbers and strings become constants
+    prism::bytecode::Program rewrite(const prism::bytecode::Program& program) {
+        auto result = program;
+        for (auto& ins : result.code) {
+            if (ins.op != OpCode::Load || !m_known[ins.arg]) {
+                continue;
+            }
+            const auto& value = m_state.slots[ins.arg];
+            if (value.type == prism::Value::Int) {
+                ins = { OpCode::PushInt, 0, (uint32_t) value.i };
+            } else if (value.type == prism::Value::Float) {
+                ins = { OpCode::PushFloat, 0, std::bit_cast<uint32_t>(value.f) };
+            } else if (value.type == prism::Value::String) {
+                result.strings.push_back(*value.str);
+                ins = { OpCode::PushString, 0, (uint32_t) result.strings.size() - 1 };
+            }
+        }
+        return result;
+    }
+
+    void append(TextRun& run, std::string_view text, bool persistent, const prism::SourceLocation& location) {
+        if (text.empty()) {
+            return;
+        }
+        if (run.pieces == 0) {
+            run.location = location;
+        }
+        if (run.pieces == 0 && persistent) {
+            run.view = text;
+        } else {
+            if (!run.view.empty()) {
+                run.buffer.assign(run.view);
+                run.view = {};
+            }
+            run.buffer.append(text);
+        }
+        run.pieces++;
+    }
+
+    void flush(TextRun& run, const std::shared_ptr<prism::Node>& parent, NodeList& out) {
+        if (run.pieces == 0) {
+            return;
+        }
+        std::string_view text = run.view;
+        if (text.empty()) {
+            m_out.text.push_back(std::move(run.buffer));
+            text = m_out.text.back();
+        }
+        out.push_back(make_node(prism::TextNode{ text }, parent, run.location));
+        run = TextRun{};
+    }
+
+    static std::shared_ptr<prism::Node> make_node(prism::NodeType type, const std::shared_ptr<prism::Node>& parent,
+                                                  const prism::SourceLocation& location) {
+        auto node = std::make_shared<prism::Node>(std::move(type), parent);
+        node->location = location;
+        return node;
+    }
+
+    // Specializes a child list on its own, for a node that stays in the tree
+    void block(const NodeList& nodes, const std::shared_ptr<prism::Node>& parent, NodeList& out) {
+        TextRun run;
+        list(nodes, parent, out, run);
+        flush(run, parent, out);
+    }
+
+    template <typename T>
+    void unroll(const prism::MTDArray<T>& array, const prism::ForNode& forNode, const std::shared_ptr<prism::Node>& parent,
+                NodeList& out, TextRun& run) {
+        for (size_t i = 0; i < array.dimensions[0]; i++) {
+            m_state.slots[forNode.slot] = prism::Value::of(array.at(i));
+            list(*forNode.children, parent, out, run);
+        }
+    }
+
+    // Whether the loop was unrolled into `out`
+    bool unroll(const prism::ContextTypes& iterable, const prism::ForNode& forNode,
+                const std::shared_ptr<prism::Node>& parent, NodeList& out, TextRun& run) {
+        size_t count;
+        if (auto range = std::get_if<prism::GeneratedRange>(&iterable)) {
+            count = range->end > range->start ? range->end - range->start : 0;
+        } else if (auto array = std::get_if<prism::MTDArray<bool>>(&iterable)) {
+            count = array->dimensions[0];
+        } else if (auto array = std::get_if<prism::MTDArray<int>>(&iterable)) {
+            count = array->dimensions[0];
+        } else if (auto array = std::get_if<prism::MTDArray<float>>(&iterable)) {
+            count = array->dimensions[0];
+        } else {
+            return false;
+        }
+        if (count > MAX_UNROLL || assigns(*forNode.children)) {
+            return false;
+        }
+
+        m_known[forNode.slot] = true;
+        if (auto range = std::get_if<prism::GeneratedRange>(&iterable)) {
+            for (auto i = range->start; i < range->end; i++) {
+                m_state.slots[forNode.slot] = prism::Value::of((int) i);
+                list(*forNode.children, parent, out, run);
+            }
+        } else if (auto array = std::get_if<prism::MTDArray<bool>>(&iterable)) {
+            unroll(*array, forNode, parent, out, run);
+        } else if (auto array = std::get_if<prism::MTDArray<int>>(&iterable)) {
+            unroll(*array, forNode, parent, out, run);
+        } else {
+            unroll(std::get<prism::MTDArray<float>>(iterable), forNode, parent, out, run);
+        }
+        m_state.slots[forNode.slot] = prism::Value{};
+        m_known[forNode.slot] = false;
+        return true;
+    }
+
+    void branch(const prism::Node& node, const std::shared_ptr<prism::Node>& parent, NodeList& out, TextRun& run) {
+        const auto& ifNode = std::get<prism::IfNode>(node.node);
+        // Branches whose condition is left to the render, the first one taken for sure
+        std::vector<const prism::Node*> open;
+        const NodeList* taken = nullptr;
+        auto visit = [&](const prism::Node& from, const prism::bytecode::Program& program, const NodeList& children) {
+            if (taken != nullptr) {
+                return;
+            }
+            auto condition = fold(program);
+            if (!condition.has_value()) {
+                open.push_back(&from);
+            } else if (is_type(condition.value(), int) && std::get<int>(condition.value()) == 1) {
+                taken = &children;
+            }
+        };
+        visit(node, ifNode.program, *ifNode.children);
+        for (const auto& elseIf : ifNode.elseIfs) {
+            const auto& branch = std::get<prism::ElseIfNode>(elseIf->node);
+            visit(*elseIf, branch.program, *branch.children);
+        }
+        if (taken == nullptr && ifNode.elseBody != nullptr) {
+            taken = std::get<prism::ElseNode>(ifNode.elseBody->node).children.get();
+        }
+
+        if (open.empty()) {
+            if (taken != nullptr) {
+                list(*taken, parent, out, run);
+            }
+            return;
+        }
+
+        flush(run, parent, out);
+        auto program = [](const prism::Node& from) -> const prism::bytecode::Program& {
+            if (auto elseIf = std::get_if<prism::ElseIfNode>(&from.node)) {
+                return elseIf->program;
+            }
+            return std::get<prism::IfNode>(from.node).program;
+        };
+        auto children = [](const prism::Node& from) -> const NodeList& {
+            if (auto elseIf = std::get_if<prism::ElseIfNode>(&from.node)) {
+                return *elseIf->children;
+            }
+            return *std::get<prism::IfNode>(from.node).children;
+        };
+
+        const auto& first = *open.front();
+        auto condition = is_type(first.node, prism::IfNode) ? std::get<prism::IfNode>(first.node).condition
+                                                            : std::get<prism::ElseIfNode>(first.node).condition;
+        auto specialized = make_node(
+            prism::IfNode{ condition, std::make_shared<NodeList>(), nullptr, {}, rewrite(program(first)) }, parent,
+            first.location);
+        auto& result = std::get<prism::IfNode>(specialized->node);
+        out.push_back(specialized);
+        block(children(first), specialized, *result.children);
+
+        for (size_t i = 1; i < open.size(); i++) {
+            const auto& from = *open[i];
+            auto elseIf = make_node(prism::ElseIfNode{ std::get<prism::ElseIfNode>(from.node).condition,
+                                                       std::make_shared<NodeList>(), specialized,
+                                                       rewrite(program(from)) },
+                                    parent, from.location);
+            result.elseIfs.push_back(elseIf);
+            out.push_back(elseIf);
+            block(children(from), elseIf, *std::get<prism::ElseIfNode>(elseIf->node).children);
+        }
+        if (taken != nullptr) {
+            auto location = ifNode.elseBody != nullptr ? ifNode.elseBody->location : first.location;
+            auto elseNode = make_node(prism::ElseNode{ std::make_shared<NodeList>() }, parent, location);
+            result.elseBody = elseNode;
+            out.push_back(elseNode);
+            block(*taken, elseNode, *std::get<prism::ElseNode>(elseNode->node).children);
+        }
+    }
+
+    void list(const NodeList& nodes, const std::shared_ptr<prism::Node>& parent, NodeList& out, TextRun& run) {
+        for (const auto& node : nodes) {
+            if (auto text = std::get_if<prism::TextNode>(&node->node)) {
+                append(run, text->text, true, node->location);
+            } else if (auto var = std::get_if<prism::VariableNode>(&node->node)) {
+                if (auto value = fold(var->program)) {
+                    prism::StringSink folded;
+                    try {
+                        prism::Renderer::write_value(folded, value.value());
+                        append(run, folded.str(), false, node->location);
+                        continue;
+                    } catch (const std::exception&) {
+                    }
+                }
+                flush(run, parent, out);
+                out.push_back(make_node(prism::VariableNode{ var->name, rewrite(var->program) }, parent,
+                                        node->location));
+            } else if (is_type(node->node, prism::IfNode)) {
+                branch(*node, parent, out, run);
+            } else if (auto decision = std::get_if<prism::DecisionNode>(&node->node)) {
+                // Specialized from the nodes it replaced, the result gets decision nodes of its own
+                list(*decision->children, parent, out, run);
+            } else if (auto hoist = std::get_if<prism::HoistNode>(&node->node)) {
+                list(*hoist->children, parent, out, run);
+            } else if (auto forNode = std::get_if<prism::ForNode>(&node->node)) {
+                auto iterable = fold(forNode->program);
+                if (iterable.has_value() && unroll(iterable.value(), *forNode, parent, out, run)) {
+                    continue;
+                }
+                flush(run, parent, out);
+                auto loop = make_node(prism::ForNode{ forNode->condition, std::make_shared<NodeList>(),
+                                                      rewrite(forNode->program), forNode->slot, {} },
+                                      parent, node->location);
+                out.push_back(loop);
+                block(*forNode->children, loop, *std::get<prism::ForNode>(loop->node).children);
+            }
+            // Else and elseif nodes are reached through their if
+        }
+    }
+
+    prism::CompiledTemplate& m_out;
+    // Values of the fixed slots, Void elsewhere
+    prism::RenderState m_state;
+    std::vector<bool> m_known;
+};
+} // namespace
+
+std::shared_ptr<const prism::CompiledTemplate> prism::specialize(std::shared_ptr<const CompiledTemplate> compiled,
+                                                                 const ContextItems& statics) {
+    if (compiled == nullptr) {
+        throw RuntimeError("No template loaded");
+    }
+    auto residual = std::make_shared<CompiledTemplate>();
+    residual->settings = compiled->settings;
+    residual->includes = compiled->includes;
+    residual->includeInputs = compiled->includeInputs;
+    residual->slots = compiled->slots;
+    residual->base = std::move(compiled);
+    Specializer specializer(*residual, statics);
+    specializer.run();
+    decision::compile(*residual);
+    hoist::compile(*residual);
+    pool_text(*residual);
+    return residual;
+}
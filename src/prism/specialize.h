@@ -0,0 +1,18 @@
+#pragma once
+
+#include <memory>
+
+#include "processor.h"
+
+namespace prism {
+// Partially evaluates a compiled template against context entries that stay
+// fixed for the life of the host. @if branches on them are resolved, @{}
+// directives that only read them become text and @for loops over a fixed
+// range are unrolled when their body assigns nothing. Rendering the result
+// against a context gives the same output as rendering `compiled` against
+// that context plus `statics`. Variables the template assigns to are never
+// treated as fixed, and nothing is when it calls a native that may take the
+// context. The result keeps `compiled` alive.
+std::shared_ptr<const CompiledTemplate> specialize(std::shared_ptr<const CompiledTemplate> compiled,
+                                                   const ContextItems& statics);
+} // namespace prism
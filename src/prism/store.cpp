@@ -0,0 +1,798 @@
+#include "store.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <random>
+#include <type_traits>
+#include <unordered_map>
+#include "include_cache.h"
+#include "utils/hash.h"
+#include "utils/mapped_file.h"
+
+namespace {
+using prism::bytecode::OpCode;
+typedef std::vector<std::shared_ptr<prism::Node>> NodeList;
+
+constexpr char MAGIC[8] = { 'P', 'R', 'I', 'S', 'M', 'T', 'P', 'L' };
+// Read back as written only on a machine of the same byte order
+constexpr uint32_t ENDIANNESS = 0x01020304;
+constexpr uint32_t NONE = UINT32_MAX;
+// Magic, version, byte order, source hash and checksum of the rest
+constexpr size_t HEADER_SIZE = sizeof(MAGIC) + 4 + 4 + 8 + 8;
+
+enum Tag : uint8_t { Root, Text, Variable, If, ElseIf, Else, For, Decision, Hoist };
+
+class Writer {
+  public:
+    template <typename T> void put(T value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        m_out.append((const char*) &value, sizeof(T));
+    }
+    void put(std::string_view str) {
+        put((uint32_t) str.size());
+        m_out.append(str);
+    }
+    void put(const std::string& str) {
+        put(std::string_view(str));
+    }
+    std::string& str() {
+        return m_out;
+    }
+
+  private:
+    std::string m_out;
+};
+
+// Thrown on a file that does not hold what Writer wrote
+struct Corrupt {};
+
+class Reader {
+  public:
+    explicit Reader(std::string_view data) : m_data(data) {
+    }
+    template <typename T> T get() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value;
+        std::memcpy(&value, bytes(sizeof(T)).data(), sizeof(T));
+        return value;
+    }
+    std::string_view bytes(size_t size) {
+        if (size > m_data.size() - m_pos) {
+            throw Corrupt{};
+        }
+        auto result = m_data.substr(m_pos, size);
+        m_pos += size;
+        return result;
+    }
+    std::string_view view() {
+        return bytes(get<uint32_t>());
+    }
+    std::string string() {
+        return std::string(view());
+    }
+    size_t left() const {
+        return m_data.size() - m_pos;
+    }
+    // An index below `limit`
+    uint32_t index(size_t limit) {
+        auto value = get<uint32_t>();
+        if (value >= limit) {
+            throw Corrupt{};
+        }
+        return value;
+    }
+
+  private:
+    std::string_view m_data;
+    size_t m_pos = 0;
+};
+
+class TreeWriter {
+  public:
+    TreeWriter(const prism::CompiledTemplate& compiled, Writer& out) : m_compiled(compiled), m_out(out) {
+        m_sources[&compiled.source] = 0;
+        for (const auto& unit : compiled.units) {
+            m_sources[&unit->source] = (uint32_t) m_sources.size();
+        }
+    }
+
+    void run() {
+        number(m_compiled.root);
+        m_out.put((uint32_t) m_nodes.size());
+        for (const auto* node : m_nodes) {
+            node_of(*node);
+        }
+    }
+
+  private:
+    // Every node gets an index before any is written, nodes refer to each other by it
+    void number(const std::shared_ptr<prism::Node>& node) {
+        if (node == nullptr || m_index.contains(node.get())) {
+            return;
+        }
+        m_index[node.get()] = (uint32_t) m_nodes.size();
+        m_nodes.push_back(node.get());
+        auto children = [this](const std::shared_ptr<NodeList>& list) {
+            if (list != nullptr) {
+                for (const auto& child : *list) {
+                    number(child);
+                }
+            }
+        };
+        if (auto root = std::get_if<prism::RootNode>(&node->node)) {
+            children(root->children);
+        } else if (auto ifNode = std::get_if<prism::IfNode>(&node->node)) {
+            children(ifNode->children);
+            for (const auto& elseIf : ifNode->elseIfs) {
+                number(elseIf);
+            }
+            number(ifNode->elseBody);
+        } else if (auto elseIf = std::get_if<prism::ElseIfNode>(&node->node)) {
+            children(elseIf->children);
+            number(elseIf->parentIf);
+        } else if (auto elseNode = std::get_if<prism::ElseNode>(&node->node)) {
+            children(elseNode->children);
+        } else if (auto forNode = std::get_if<prism::ForNode>(&node->node)) {
+            children(forNode->children);
+        } else if (auto decision = std::get_if<prism::DecisionNode>(&node->node)) {
+            children(decision->children);
+        } else if (auto hoist = std::get_if<prism::HoistNode>(&node->node)) {
+            children(hoist->children);
+        } else if (!is_type(node->node, prism::TextNode) && !is_type(node->node, prism::VariableNode)) {
+            throw prism::RuntimeError("Template has nodes that cannot be stored");
+        }
+    }
+
+    uint32_t index_of(const prism::Node* node) const {
+        auto found = m_index.find(node);
+        return found != m_index.end() ? found->second : NONE;
+    }
+
+    void list(const std::shared_ptr<NodeList>& nodes) {
+        m_out.put((uint32_t) (nodes != nullptr ? nodes->size() : 0));
+        if (nodes != nullptr) {
+            for (const auto& node : *nodes) {
+                m_out.put(index_of(node.get()));
+            }
+        }
+    }
+
+    // Text lives in the pool
+    void text(std::string_view text) {
+        if (text.empty()) {
+            m_out.put((uint32_t) 0);
+            m_out.put((uint32_t) 0);
+            return;
+        }
+        auto pool = m_compiled.pool;
+        if (text.data() < pool.data() || text.data() + text.size() > pool.data() + pool.size()) {
+            throw prism::RuntimeError("Template text is not pooled");
+        }
+        m_out.put((uint32_t) (text.data() - pool.data()));
+        m_out.put((uint32_t) text.size());
+    }
+
+    void program(const prism::bytecode::Program& program) {
+        m_out.put((uint32_t) program.code.size());
+        for (const auto& ins : program.code) {
+            m_out.put((uint8_t) ins.op);
+            m_out.put(ins.count);
+            m_out.put(ins.arg);
+        }
+        m_out.put((uint32_t) program.strings.size());
+        for (const auto& str : program.strings) {
+            m_out.put(str);
+        }
+        m_out.put(program.hoisted);
+    }
+
+    void node_of(const prism::Node& node) {
+        auto source = m_sources.find(node.location.source);
+        m_out.put(source != m_sources.end() ? source->second : NONE);
+        m_out.put(node.location.offset);
+        m_out.put((int32_t) node.depth);
+        m_out.put(index_of(node.parent.get()));
+
+        if (auto root = std::get_if<prism::RootNode>(&node.node)) {
+            m_out.put(Root);
+            list(root->children);
+        } else if (auto textNode = std::get_if<prism::TextNode>(&node.node)) {
+            m_out.put(Text);
+            text(textNode->text);
+        } else if (auto var = std::get_if<prism::VariableNode>(&node.node)) {
+            m_out.put(Variable);
+            program(var->program);
+        } else if (auto ifNode = std::get_if<prism::IfNode>(&node.node)) {
+            m_out.put(If);
+            program(ifNode->program);
+            list(ifNode->children);
+            m_out.put((uint32_t) ifNode->elseIfs.size());
+            for (const auto& elseIf : ifNode->elseIfs) {
+                m_out.put(index_of(elseIf.get()));
+            }
+            m_out.put(index_of(ifNode->elseBody.get()));
+        } else if (auto elseIf = std::get_if<prism::ElseIfNode>(&node.node)) {
+            m_out.put(ElseIf);
+            program(elseIf->program);
+            list(elseIf->children);
+            m_out.put(index_of(elseIf->parentIf.get()));
+        } else if (auto elseNode = std::get_if<prism::ElseNode>(&node.node)) {
+            m_out.put(Else);
+            list(elseNode->children);
+        } else if (auto forNode = std::get_if<prism::ForNode>(&node.node)) {
+            m_out.put(For);
+            program(forNode->program);
+            m_out.put(forNode->slot);
+            m_out.put((uint32_t) forNode->hoisted.size());
+            for (auto index : forNode->hoisted) {
+                m_out.put(index);
+            }
+            list(forNode->children);
+        } else if (auto decision = std::get_if<prism::DecisionNode>(&node.node)) {
+            m_out.put(Decision);
+            const auto& program = *decision->program;
+            m_out.put((uint32_t) program.atoms.size());
+            for (const auto& atom : program.atoms) {
+                m_out.put(atom.slot);
+                m_out.put((int32_t) atom.value);
+            }
+            m_out.put((uint32_t) program.nodes.size());
+            for (const auto& entry : program.nodes) {
+                m_out.put(entry.atom);
+                m_out.put(entry.low);
+                m_out.put(entry.high);
+            }
+            m_out.put((uint32_t) program.segments.size());
+            for (const auto& segment : program.segments) {
+                m_out.put(segment.guard);
+                m_out.put(index_of(segment.node));
+                if (segment.node == nullptr) {
+                    text(segment.text);
+                }
+            }
+            list(decision->children);
+        } else if (auto hoist = std::get_if<prism::HoistNode>(&node.node)) {
+            m_out.put(Hoist);
+            m_out.put(hoist->index);
+            list(hoist->children);
+        }
+    }
+
+    const prism::CompiledTemplate& m_compiled;
+    Writer& m_out;
+    std::unordered_map<const prism::SourceBuffer*, uint32_t> m_sources;
+    std::unordered_map<const prism::Node*, uint32_t> m_index;
+    std::vector<const prism::Node*> m_nodes;
+};
+
+class TreeReader {
+  public:
+    TreeReader(prism::CompiledTemplate& compiled, Reader& in, std::vector<const prism::SourceBuffer*> sources)
+        : m_compiled(compiled), m_in(in), m_sources(std::move(sources)) {
+    }
+
+    void run() {
+        auto count = m_in.get<uint32_t>();
+        // Every node takes more than one byte
+        valid(count > 0 && count <= m_in.left());
+        m_nodes.reserve(count);
+        m_reached.resize(count, false);
+        for (uint32_t i = 0; i < count; i++) {
+            m_nodes.push_back(std::make_shared<prism::Node>(prism::NodeType{}, nullptr));
+        }
+        try {
+            for (m_current = 0; m_current < count; m_current++) {
+                node_of(*m_nodes[m_current]);
+            }
+            valid(is_type(m_nodes[0]->node, prism::RootNode));
+            // The tree is freed top down, see delete_node()
+            valid(std::find(m_reached.begin() + 1, m_reached.end(), false) == m_reached.end());
+            for (const auto* target : m_segments) {
+                valid(is_type(target->node, prism::VariableNode));
+            }
+        } catch (const Corrupt&) {
+            // Nodes keep a strong reference to their parent
+            for (auto& node : m_nodes) {
+                node->parent = nullptr;
+                node->node = prism::RootNode{};
+            }
+            throw;
+        }
+        m_compiled.root = m_nodes[0];
+    }
+
+  private:
+    std::shared_ptr<prism::Node> node_at() {
+        auto index = m_in.get<uint32_t>();
+        if (index == NONE) {
+            return nullptr;
+        }
+        valid(index < m_nodes.size());
+        return m_nodes[index];
+    }
+
+    // Nodes are numbered depth first, what a node contains comes after it. Keeps the tree free of cycles.
+    std::shared_ptr<prism::Node> child() {
+        auto index = m_in.get<uint32_t>();
+        if (index == NONE) {
+            return nullptr;
+        }
+        valid(index > m_current && index < m_nodes.size());
+        m_reached[index] = true;
+        return m_nodes[index];
+    }
+
+    std::shared_ptr<NodeList> list() {
+        auto count = m_in.get<uint32_t>();
+        valid(count <= m_in.left());
+        auto result = std::make_shared<NodeList>();
+        for (uint32_t i = 0; i < count; i++) {
+            auto node = child();
+            valid(node != nullptr);
+            result->push_back(std::move(node));
+        }
+        return result;
+    }
+
+    std::string_view text() {
+        auto offset = m_in.get<uint32_t>();
+        auto size = m_in.get<uint32_t>();
+        if (offset > m_compiled.pool.size() || size > m_compiled.pool.size() - offset) {
+            throw Corrupt{};
+        }
+        return m_compiled.pool.substr(offset, size);
+    }
+
+    prism::bytecode::Program program() {
+        prism::bytecode::Program result;
+        auto count = m_in.get<uint32_t>();
+        for (uint32_t i = 0; i < count; i++) {
+            auto op = m_in.get<uint8_t>();
+            auto arity = m_in.get<uint8_t>();
+            auto arg = m_in.get<uint32_t>();
+            if (op > (uint8_t) OpCode::JumpIfFalse) {
+                throw Corrupt{};
+            }
+            result.code.push_back({ (OpCode) op, arity, arg });
+        }
+        auto strings = m_in.get<uint32_t>();
+        for (uint32_t i = 0; i < strings; i++) {
+            result.strings.push_back(m_in.string());
+        }
+        result.hoisted = m_in.get<uint32_t>();
+        if (result.hoisted != prism::bytecode::NOT_HOISTED && result.hoisted >= m_compiled.hoisted) {
+            throw Corrupt{};
+        }
+
+        // What the evaluator indexes without checking
+        for (const auto& ins : result.code) {
+            switch (ins.op) {
+                case OpCode::PushString:
+                    valid(ins.arg < result.strings.size());
+                    break;
+                case OpCode::Index:
+                    // Its indices are copied into a fixed array of 4
+                    valid(ins.count <= 4);
+                    [[fallthrough]];
+                case OpCode::Load:
+                case OpCode::Call:
+                case OpCode::Assign:
+                case OpCode::In:
+                    valid(ins.arg < m_compiled.slots.size());
+                    break;
+                default:
+                    break;
+            }
+        }
+        stack_depths(result);
+        return result;
+    }
+
+    // Nor does it check the stack. The compiler only jumps forward, so one
+    // pass sees every way into an instruction before the instruction itself
+    static void stack_depths(const prism::bytecode::Program& program) {
+        constexpr int UNREACHED = -1;
+        const auto size = program.code.size();
+        std::vector<int> depths(size + 1, UNREACHED);
+        depths[0] = 0;
+        auto reach = [&depths, size](size_t pc, uint32_t target, int depth) {
+            valid(target > pc && target <= size);
+            valid(depths[target] == UNREACHED || depths[target] == depth);
+            depths[target] = depth;
+        };
+        for (size_t pc = 0; pc < size; pc++) {
+            const auto& ins = program.code[pc];
+            int depth = depths[pc];
+            if (depth == UNREACHED) {
+                continue;
+            }
+            // How many values it reads and how many it leaves in their place
+            int pops = 1;
+            int pushes = 1;
+            switch (ins.op) {
+                case OpCode::PushInt:
+                case OpCode::PushFloat:
+                case OpCode::PushString:
+                case OpCode::Load:
+                    pops = 0;
+                    break;
+                case OpCode::Index:
+                case OpCode::Call:
+                    pops = ins.count;
+                    break;
+                case OpCode::Or:
+                case OpCode::And:
+                    // Keeps the left operand when it decides, drops it otherwise
+                    valid(depth >= 1);
+                    reach(pc, ins.arg, depth);
+                    pushes = 0;
+                    break;
+                case OpCode::Equal:
+                case OpCode::Add:
+                case OpCode::Sub:
+                case OpCode::Mul:
+                case OpCode::Div:
+                case OpCode::Range:
+                    pops = 2;
+                    break;
+                case OpCode::Jump:
+                    reach(pc, ins.arg, depth);
+                    continue;
+                case OpCode::JumpIfFalse:
+                    valid(depth >= 1);
+                    reach(pc, ins.arg, depth - 1);
+                    pushes = 0;
+                    break;
+                default:
+                    break;
+            }
+            valid(depth >= pops);
+            reach(pc, (uint32_t) pc + 1, depth - pops + pushes);
+        }
+        // Leaves exactly one value
+        valid(depths[size] == 1);
+    }
+
+    static void valid(bool condition) {
+        if (!condition) {
+            throw Corrupt{};
+        }
+    }
+
+    void node_of(prism::Node& node) {
+        auto source = m_in.get<uint32_t>();
+        if (source != NONE) {
+            valid(source < m_sources.size());
+            node.location.source = m_sources[source];
+        }
+        node.location.offset = m_in.get<uint32_t>();
+        node.depth = m_in.get<int32_t>();
+        node.parent = node_at();
+
+        switch (m_in.get<uint8_t>()) {
+            case Root:
+                node.node = prism::RootNode{ list() };
+                break;
+            case Text:
+                node.node = prism::TextNode{ text() };
+                break;
+            case Variable:
+                node.node = prism::VariableNode{ nullptr, program() };
+                break;
+            case If: {
+                prism::IfNode ifNode{};
+                ifNode.program = program();
+                ifNode.children = list();
+                auto elseIfs = m_in.get<uint32_t>();
+                for (uint32_t i = 0; i < elseIfs; i++) {
+                    auto elseIf = child();
+                    valid(elseIf != nullptr);
+                    ifNode.elseIfs.push_back(std::move(elseIf));
+                }
+                ifNode.elseBody = child();
+                node.node = std::move(ifNode);
+                break;
+            }
+            case ElseIf: {
+                prism::ElseIfNode elseIf{};
+                elseIf.program = program();
+                elseIf.children = list();
+                elseIf.parentIf = node_at();
+                node.node = std::move(elseIf);
+                break;
+            }
+            case Else:
+                node.node = prism::ElseNode{ list() };
+                break;
+            case For: {
+                prism::ForNode forNode{};
+                forNode.program = program();
+                forNode.slot = m_in.index(m_compiled.slots.size());
+                auto hoisted = m_in.get<uint32_t>();
+                for (uint32_t i = 0; i < hoisted; i++) {
+                    forNode.hoisted.push_back(m_in.index(m_compiled.hoisted));
+                }
+                forNode.children = list();
+                node.node = std::move(forNode);
+                break;
+            }
+            case Decision: {
+                auto program = std::make_shared<prism::decision::Program>();
+                auto atoms = m_in.get<uint32_t>();
+                valid(atoms <= 64);
+                for (uint32_t i = 0; i < atoms; i++) {
+                    auto slot = m_in.index(m_compiled.slots.size());
+                    program->atoms.push_back({ slot, m_in.get<int32_t>() });
+                }
+                auto nodes = m_in.get<uint32_t>();
+                valid(nodes >= 2);
+                for (uint32_t i = 0; i < nodes; i++) {
+                    auto atom = m_in.get<uint32_t>();
+                    auto low = m_in.get<uint32_t>();
+                    auto high = m_in.get<uint32_t>();
+                    // Terminals aside, nodes only point at nodes made before them
+                    valid(i < 2 || (atom < atoms && low < i && high < i));
+                    program->nodes.push_back({ atom, low, high });
+                }
+                auto segments = m_in.get<uint32_t>();
+                for (uint32_t i = 0; i < segments; i++) {
+                    prism::decision::Segment segment;
+                    segment.guard = m_in.index(nodes);
+                    auto target = node_at();
+                    if (target == nullptr) {
+                        segment.text = text();
+                    } else {
+                        // Checked once every node is read
+                        m_segments.push_back(target.get());
+                    }
+                    segment.node = target.get();
+                    program->segments.push_back(segment);
+                }
+                auto children = list();
+                node.node = prism::DecisionNode{ std::move(program), std::move(children) };
+                break;
+            }
+            case Hoist: {
+                auto index = m_in.index(m_compiled.hoisted);
+                node.node = prism::HoistNode{ list(), index };
+                break;
+            }
+            default:
+                throw Corrupt{};
+        }
+    }
+
+    prism::CompiledTemplate& m_compiled;
+    Reader& m_in;
+    std::vector<const prism::SourceBuffer*> m_sources;
+    std::vector<std::shared_ptr<prism::Node>> m_nodes;
+    uint32_t m_current = 0;
+    std::vector<bool> m_reached;
+    // Nodes decision segments render, have to be variables
+    std::vector<const prism::Node*> m_segments;
+};
+} // namespace
+
+std::string prism::store::write(const CompiledTemplate& compiled, uint64_t sourceHash) {
+    if (compiled.base != nullptr) {
+        throw RuntimeError("Specialized templates cannot be stored");
+    }
+    if (!compiled.storable) {
+        throw RuntimeError("Templates whose include paths call natives cannot be stored");
+    }
+    Writer body;
+    body.put(compiled.hash);
+    body.put((uint32_t) compiled.includes.size());
+    for (const auto& include : compiled.includes) {
+        body.put(include.path);
+        body.put(include.hash);
+    }
+    body.put((uint32_t) compiled.includeInputs.size());
+    for (const auto& input : compiled.includeInputs) {
+        body.put(input.name);
+        body.put(input.value);
+    }
+
+    // Sources, for error locations
+    body.put((uint32_t) (compiled.units.size() + 1));
+    auto source = [&body](const SourceBuffer& source) {
+        body.put(source.path);
+        body.put(source.text);
+        body.put(source.firstLine);
+    };
+    source(compiled.source);
+    for (const auto& unit : compiled.units) {
+        source(unit->source);
+    }
+
+    body.put((uint32_t) compiled.settings.size());
+    for (const auto& setting : compiled.settings) {
+        body.put(setting.var);
+        body.put(setting.name);
+        body.put(setting.type);
+        body.put(setting.def);
+        body.put(setting.min);
+        body.put(setting.max);
+        body.put(setting.step);
+        body.put((uint32_t) setting.optionLabels.size());
+        for (const auto& label : setting.optionLabels) {
+            body.put(label);
+        }
+        body.put((uint32_t) setting.optionValues.size());
+        for (auto value : setting.optionValues) {
+            body.put(value);
+        }
+        for (auto component : setting.defColor) {
+            body.put(component);
+        }
+    }
+
+    body.put((uint32_t) compiled.slots.size());
+    for (size_t i = 0; i < compiled.slots.size(); i++) {
+        body.put(compiled.slots.names[i]);
+        body.put((uint8_t) compiled.slots.loop[i]);
+    }
+    body.put(compiled.hoisted);
+    body.put(compiled.pool);
+    TreeWriter(compiled, body).run();
+
+    Writer out;
+    out.str().append(MAGIC, sizeof(MAGIC));
+    out.put(VERSION);
+    out.put(ENDIANNESS);
+    out.put(sourceHash);
+    out.put(hash::fnv1a(body.str()));
+    out.str().append(body.str());
+    return std::move(out.str());
+}
+
+std::shared_ptr<prism::CompiledTemplate> prism::store::read(std::shared_ptr<const MappedFile> file,
+                                                            uint64_t sourceHash) {
+    if (file == nullptr || file->size() < HEADER_SIZE) {
+        return nullptr;
+    }
+    try {
+        Reader header(file->view().substr(0, HEADER_SIZE));
+        if (header.bytes(sizeof(MAGIC)) != std::string_view(MAGIC, sizeof(MAGIC)) ||
+            header.get<uint32_t>() != VERSION || header.get<uint32_t>() != ENDIANNESS ||
+            header.get<uint64_t>() != sourceHash) {
+            return nullptr;
+        }
+        auto data = file->view().substr(HEADER_SIZE);
+        if (header.get<uint64_t>() != hash::fnv1a(data)) {
+            return nullptr;
+        }
+
+        Reader in(data);
+        auto compiled = std::make_shared<CompiledTemplate>();
+        compiled->hash = in.get<uint64_t>();
+        auto includes = in.get<uint32_t>();
+        for (uint32_t i = 0; i < includes; i++) {
+            auto path = in.string();
+            compiled->includes.push_back({ std::move(path), in.get<uint64_t>() });
+        }
+        auto inputs = in.get<uint32_t>();
+        for (uint32_t i = 0; i < inputs; i++) {
+            auto name = in.string();
+            compiled->includeInputs.push_back({ std::move(name), in.string() });
+        }
+
+        auto sources = in.get<uint32_t>();
+        if (sources == 0) {
+            return nullptr;
+        }
+        std::vector<const SourceBuffer*> buffers;
+        for (uint32_t i = 0; i < sources; i++) {
+            // Never parsed again, the text can stay in the mapping
+            SourceBuffer source;
+            source.path = in.string();
+            source.text = in.view();
+            source.firstLine = in.get<uint32_t>();
+            source.owner = file;
+            if (i == 0) {
+                compiled->source = std::move(source);
+                buffers.push_back(&compiled->source);
+            } else {
+                // Units without a tree, they only hold the text
+                auto unit = std::make_shared<IncludeUnit>();
+                unit->source = std::move(source);
+                buffers.push_back(&unit->source);
+                compiled->units.push_back(std::move(unit));
+            }
+        }
+
+        auto settings = in.get<uint32_t>();
+        for (uint32_t i = 0; i < settings; i++) {
+            SettingDecl setting;
+            setting.var = in.string();
+            setting.name = in.string();
+            setting.type = in.string();
+            setting.def = in.get<float>();
+            setting.min = in.get<float>();
+            setting.max = in.get<float>();
+            setting.step = in.get<float>();
+            auto labels = in.get<uint32_t>();
+            for (uint32_t j = 0; j < labels; j++) {
+                setting.optionLabels.push_back(in.string());
+            }
+            auto values = in.get<uint32_t>();
+            for (uint32_t j = 0; j < values; j++) {
+                setting.optionValues.push_back(in.get<float>());
+            }
+            for (auto& component : setting.defColor) {
+                component = in.get<float>();
+            }
+            compiled->settings.push_back(std::move(setting));
+        }
+
+        auto slots = in.get<uint32_t>();
+        for (uint32_t i = 0; i < slots; i++) {
+            auto name = in.string();
+            bool loop = in.get<uint8_t>() != 0;
+            if (!loop) {
+                compiled->slots.globals[name] = i;
+            }
+            compiled->slots.names.push_back(std::move(name));
+            compiled->slots.loop.push_back(loop);
+        }
+        compiled->hoisted = in.get<uint32_t>();
+        // Rendered from the mapping as is
+        compiled->pool = in.view();
+        compiled->mapping = std::move(file);
+        TreeReader(*compiled, in, std::move(buffers)).run();
+        return compiled;
+    } catch (const Corrupt&) {
+        return nullptr;
+    }
+}
+
+prism::TemplateStore::TemplateStore(std::string directory) : m_directory(std::move(directory)) {
+}
+
+std::string prism::TemplateStore::path_of(uint64_t sourceHash) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.prismc", (unsigned long long) sourceHash);
+    return (std::filesystem::path(m_directory) / name).string();
+}
+
+std::shared_ptr<const prism::CompiledTemplate> prism::TemplateStore::find(std::string_view data) const {
+    auto sourceHash = hash::fnv1a(data);
+    return store::read(MappedFile::open(path_of(sourceHash)), sourceHash);
+}
+
+bool prism::TemplateStore::insert(std::string_view data, const CompiledTemplate& compiled) const {
+    auto sourceHash = hash::fnv1a(data);
+    auto path = path_of(sourceHash);
+    // Written aside and moved in place, a concurrent find() never sees half a file.
+    // Named per process and per call so concurrent inserts never share one
+    static const uint64_t process = ((uint64_t) std::random_device{}() << 32) ^ std::random_device{}();
+    static std::atomic<uint64_t> inserts{ 0 };
+    char suffix[48];
+    std::snprintf(suffix, sizeof(suffix), ".%016llx.%llu.tmp", (unsigned long long) process,
+                  (unsigned long long) inserts.fetch_add(1, std::memory_order_relaxed));
+    auto temporary = path + suffix;
+    std::error_code error;
+    std::filesystem::create_directories(m_directory, error);
+    auto contents = store::write(compiled, sourceHash);
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            return false;
+        }
+        out.write(contents.data(), (std::streamsize) contents.size());
+        out.close();
+        if (!out.good()) {
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+    }
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
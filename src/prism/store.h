@@ -0,0 +1,44 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+#include "processor.h"
+
+namespace prism {
+namespace store {
+// Bumped whenever the layout changes, files of other versions are ignored
+constexpr uint32_t VERSION = 2;
+
+// The compiled form of a template as a self-contained binary: tree,
+// programs, slots, settings, text pool, the sources error locations point
+// into, the hash of every include and the context values include paths were
+// computed from. `sourceHash` identifies the template source it was compiled
+// from. Specialized templates cannot be written, nor those that are not
+// `storable`.
+std::string write(const CompiledTemplate& compiled, uint64_t sourceHash);
+// Rebuilds a template from what write() produced, without lexing or
+// parsing; its text pool points into `file`. nullptr if the file is of
+// another version, corrupt or was written for another source.
+std::shared_ptr<CompiledTemplate> read(std::shared_ptr<const MappedFile> file, uint64_t sourceHash);
+} // namespace store
+
+// Compiled templates kept on disk across runs, one file per template source
+// in `directory`. A stored template is only valid while every include it
+// was compiled with still has the same contents, which Processor checks.
+class TemplateStore {
+  public:
+    explicit TemplateStore(std::string directory);
+    // nullptr if `data` was never stored
+    std::shared_ptr<const CompiledTemplate> find(std::string_view data) const;
+    // False if the file could not be written
+    bool insert(std::string_view data, const CompiledTemplate& compiled) const;
+
+  private:
+    std::string path_of(uint64_t sourceHash) const;
+
+    std::string m_directory;
+};
+} // namespace prism
@@ -0,0 +1,123 @@
+#include "file_watcher.h"
+
+#include <thread>
+#include <algorithm>
+
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+namespace {
+// How long the events of one save keep coming
+constexpr std::chrono::milliseconds SETTLE{ 30 };
+constexpr std::chrono::milliseconds POLL_INTERVAL{ 100 };
+
+std::string absolute(const std::string& path) {
+    std::error_code error;
+    auto result = std::filesystem::absolute(path, error);
+    return (error ? std::filesystem::path(path) : result).lexically_normal().string();
+}
+
+std::filesystem::file_time_type modified(const std::string& path) {
+    std::error_code error;
+    auto time = std::filesystem::last_write_time(path, error);
+    return error ? std::filesystem::file_time_type::min() : time;
+}
+} // namespace
+
+prism::FileWatcher::FileWatcher() {
+#ifdef __linux__
+    m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+prism::FileWatcher::~FileWatcher() {
+#ifdef __linux__
+    if (m_inotify >= 0) {
+        close(m_inotify);
+    }
+#endif
+}
+
+void prism::FileWatcher::add(const std::string& path) {
+    auto key = absolute(path);
+    auto& paths = m_paths[key];
+    if (std::find(paths.begin(), paths.end(), path) != paths.end()) {
+        return;
+    }
+    paths.push_back(path);
+    m_times[path] = modified(path);
+#ifdef __linux__
+    if (m_inotify >= 0) {
+        auto directory = std::filesystem::path(key).parent_path();
+        // Adding a directory again returns the descriptor it already has
+        int wd = inotify_add_watch(m_inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        if (wd >= 0) {
+            m_directories[wd] = directory;
+        }
+    }
+#endif
+}
+
+std::vector<std::string> prism::FileWatcher::wait(std::chrono::milliseconds timeout) {
+#ifdef __linux__
+    if (m_inotify < 0) {
+        return poll_times(timeout);
+    }
+    std::vector<std::string> changed;
+    alignas(inotify_event) char buffer[4096];
+    pollfd fd{ m_inotify, POLLIN, 0 };
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (true) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        auto wait = changed.empty() ? std::max(left, std::chrono::milliseconds(0)) : SETTLE;
+        if (poll(&fd, 1, (int) wait.count()) <= 0) {
+            break;
+        }
+        ssize_t size;
+        while ((size = read(m_inotify, buffer, sizeof(buffer))) > 0) {
+            for (ssize_t offset = 0; offset < size;) {
+                const auto* event = (const inotify_event*) (buffer + offset);
+                offset += (ssize_t) (sizeof(inotify_event) + event->len);
+                auto directory = m_directories.find(event->wd);
+                if (event->len == 0 || directory == m_directories.end()) {
+                    continue;
+                }
+                auto found = m_paths.find((directory->second / event->name).string());
+                if (found == m_paths.end()) {
+                    continue;
+                }
+                for (const auto& path : found->second) {
+                    if (std::find(changed.begin(), changed.end(), path) == changed.end()) {
+                        changed.push_back(path);
+                    }
+                }
+            }
+        }
+    }
+    return changed;
+#else
+    return poll_times(timeout);
+#endif
+}
+
+std::vector<std::string> prism::FileWatcher::poll_times(std::chrono::milliseconds timeout) {
+    std::vector<std::string> changed;
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (true) {
+        for (auto& [path, time] : m_times) {
+            auto current = modified(path);
+            if (current != time) {
+                time = current;
+                changed.push_back(path);
+            }
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (!changed.empty() || now >= deadline) {
+            return changed;
+        }
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(POLL_INTERVAL, deadline - now));
+    }
+}
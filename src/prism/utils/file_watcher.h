@@ -0,0 +1,38 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <unordered_map>
+
+namespace prism {
+// Reports watched files that changed on disk. On Linux the directory of
+// every file is watched with inotify, so editors that save by renaming a
+// new file over the old one are seen too. Elsewhere, or when inotify is
+// unavailable, modification times are polled.
+class FileWatcher {
+  public:
+    FileWatcher();
+    ~FileWatcher();
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // Watching a path twice is harmless. Files that do not exist yet are
+    // seen once they are created, as long as their directory exists.
+    void add(const std::string& path);
+    // Waits up to `timeout` for a change. A burst of events, such as an
+    // editor's save, is reported once; paths come back as they were added.
+    std::vector<std::string> wait(std::chrono::milliseconds timeout);
+
+  private:
+    std::vector<std::string> poll_times(std::chrono::milliseconds timeout);
+
+    // Paths as added, by their absolute form
+    std::unordered_map<std::string, std::vector<std::string>> m_paths;
+    std::unordered_map<std::string, std::filesystem::file_time_type> m_times;
+    int m_inotify = -1;
+    // Watched directories by watch descriptor
+    std::unordered_map<int, std::filesystem::path> m_directories;
+};
+} // namespace prism
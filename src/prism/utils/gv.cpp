@@ -1,5 +1,6 @@
 #include "gv.h"
 
+#include <cstdio>
 #include <regex>
 #include <sstream>
 #include "exceptions.h"
@@ -46,4 +47,21 @@ std::unordered_map<std::string, std::optional<std::string>> prism::gv::il_args(c
         }
     }
     return result;
-}
\ No newline at end of file
+}
+
+void prism::gv::append_json(std::string& out, std::string_view str) {
+    out += '"';
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char) c < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <sstream>
 #include <optional>
@@ -13,6 +14,8 @@ std::vector<std::string> split(const std::string line, char delimiter);
 std::vector<std::string> parenthesis(const std::string line);
 std::vector<std::string> fn_args(const std::string line);
 std::unordered_map<std::string, std::optional<std::string>> il_args(const std::string line);
+// Appends `str` as a quoted and escaped JSON string
+void append_json(std::string& out, std::string_view str);
 inline void ltrim(std::string& s) {
     s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](unsigned char ch) { return !std::isspace(ch); }));
 }
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace prism::hash {
+constexpr uint64_t FNV_OFFSET = 14695981039346656037ull;
+constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+inline uint64_t fnv1a(const void* data, size_t size, uint64_t seed = FNV_OFFSET) {
+    auto bytes = (const uint8_t*) data;
+    for (size_t i = 0; i < size; i++) {
+        seed ^= bytes[i];
+        seed *= FNV_PRIME;
+    }
+    return seed;
+}
+
+inline uint64_t fnv1a(std::string_view str, uint64_t seed = FNV_OFFSET) {
+    return fnv1a(str.data(), str.size(), seed);
+}
+
+template <typename T> uint64_t mix(uint64_t seed, const T& value) {
+    return fnv1a(&value, sizeof(T), seed);
+}
+} // namespace prism::hash
@@ -0,0 +1,101 @@
+#include "mapped_file.h"
+
+#include <fstream>
+#include <iterator>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+size_t page_size() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return (size_t) sysconf(_SC_PAGESIZE);
+#endif
+}
+} // namespace
+
+std::shared_ptr<const prism::MappedFile> prism::MappedFile::open(const std::string& path) {
+    std::shared_ptr<MappedFile> file(new MappedFile());
+#ifdef _WIN32
+    auto handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size)) {
+        CloseHandle(handle);
+        return nullptr;
+    }
+    file->m_size = (size_t) size.QuadPart;
+    if (file->m_size % page_size() != 0) {
+        file->m_mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (file->m_mapping != nullptr) {
+            file->m_data = (const char*) MapViewOfFile(file->m_mapping, FILE_MAP_READ, 0, 0, 0);
+            file->m_mapped = file->m_data != nullptr;
+        }
+        if (!file->m_mapped && file->m_mapping != nullptr) {
+            CloseHandle(file->m_mapping);
+            file->m_mapping = nullptr;
+        }
+    }
+    CloseHandle(handle);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        return nullptr;
+    }
+    file->m_size = (size_t) info.st_size;
+    // The rest of the last page reads as zeros
+    if (file->m_size % page_size() != 0) {
+        auto data = mmap(nullptr, file->m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            file->m_data = (const char*) data;
+            file->m_mapped = true;
+        }
+    }
+    // The mapping stays valid once the descriptor is closed
+    close(fd);
+#endif
+    if (file->m_mapped) {
+        return file;
+    }
+    if (file->m_size > 0) {
+        std::ifstream input(path, std::ios::binary);
+        file->m_copy.assign(std::istreambuf_iterator<char>(input), {});
+        if (!input.good() && !input.eof()) {
+            return nullptr;
+        }
+        file->m_size = file->m_copy.size();
+    }
+    file->m_data = file->m_copy.c_str();
+    return file;
+}
+
+prism::MappedFile::~MappedFile() {
+    if (!m_mapped) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(m_data);
+    CloseHandle(m_mapping);
+#else
+    munmap((void*) m_data, m_size);
+#endif
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+namespace prism {
+// A whole file mapped read-only into memory. Pages are shared with the OS
+// page cache, so nothing is copied until it is read. Like a std::string the
+// data is followed by a '\0', the template parser relies on it.
+class MappedFile {
+  public:
+    // nullptr if the file cannot be opened or mapped
+    static std::shared_ptr<const MappedFile> open(const std::string& path);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    const char* data() const {
+        return m_data;
+    }
+    size_t size() const {
+        return m_size;
+    }
+    std::string_view view() const {
+        return { m_data, m_size };
+    }
+
+  private:
+    MappedFile() = default;
+
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+    // Files ending on a page boundary have no zero byte after them, they are read in here
+    std::string m_copy;
+    bool m_mapped = false;
+#ifdef _WIN32
+    void* m_mapping = nullptr;
+#endif
+};
+} // namespace prism
@@ -0,0 +1,107 @@
+#include "trace.h"
+
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "gv.h"
+
+namespace {
+struct ThreadBuffer {
+    std::mutex mutex;
+    uint32_t id;
+    std::string name;
+    std::vector<prism::trace::Event> events;
+};
+
+// Buffers outlive their thread so pool workers that exited still export
+std::mutex registryMutex;
+std::vector<std::shared_ptr<ThreadBuffer>> registry;
+prism::trace::Clock::time_point epoch;
+
+ThreadBuffer& local_buffer() {
+    thread_local std::shared_ptr<ThreadBuffer> buffer = [] {
+        auto created = std::make_shared<ThreadBuffer>();
+        std::lock_guard lock(registryMutex);
+        created->id = (uint32_t) registry.size() + 1;
+        registry.push_back(created);
+        return created;
+    }();
+    return *buffer;
+}
+
+double microseconds(prism::trace::Clock::duration time) {
+    return (double) std::chrono::duration_cast<std::chrono::nanoseconds>(time).count() / 1000.0;
+}
+} // namespace
+
+void prism::trace::start() {
+    std::lock_guard lock(registryMutex);
+    for (auto& buffer : registry) {
+        std::lock_guard bufferLock(buffer->mutex);
+        buffer->events.clear();
+    }
+    epoch = Clock::now();
+    recording.store(true, std::memory_order_relaxed);
+}
+
+void prism::trace::stop() {
+    recording.store(false, std::memory_order_relaxed);
+}
+
+void prism::trace::record(Event event) {
+    auto& buffer = local_buffer();
+    std::lock_guard lock(buffer.mutex);
+    buffer.events.push_back(std::move(event));
+}
+
+void prism::trace::name_thread(std::string name) {
+    auto& buffer = local_buffer();
+    std::lock_guard lock(buffer.mutex);
+    buffer.name = std::move(name);
+}
+
+std::string prism::trace::to_chrome_json() {
+    std::string out = "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool first = true;
+    char number[96];
+    auto separate = [&out, &first] {
+        out += first ? "\n  " : ",\n  ";
+        first = false;
+    };
+
+    std::lock_guard lock(registryMutex);
+    for (auto& buffer : registry) {
+        std::lock_guard bufferLock(buffer->mutex);
+        if (!buffer->name.empty()) {
+            separate();
+            std::snprintf(number, sizeof(number), "{\"ph\": \"M\", \"pid\": 1, \"tid\": %u, ", buffer->id);
+            out += number;
+            out += "\"name\": \"thread_name\", \"args\": {\"name\": ";
+            gv::append_json(out, buffer->name);
+            out += "}}";
+        }
+        for (const auto& event : buffer->events) {
+            // Scopes still open when start() was called again belong to the previous trace
+            if (event.start < epoch) {
+                continue;
+            }
+            separate();
+            out += "{\"ph\": \"X\", \"name\": ";
+            gv::append_json(out, event.name);
+            out += ", \"cat\": ";
+            gv::append_json(out, event.category);
+            std::snprintf(number, sizeof(number), ", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %u",
+                          microseconds(event.start - epoch), microseconds(event.end - event.start), buffer->id);
+            out += number;
+            if (!event.detail.empty()) {
+                out += ", \"args\": {\"detail\": ";
+                gv::append_json(out, event.detail);
+                out += "}";
+            }
+            out += "}";
+        }
+    }
+    out += first ? "]}\n" : "\n]}\n";
+    return out;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace prism::trace {
+// Events are only recorded when built with PRISM_TRACING, otherwise the
+// macros below expand to nothing and their arguments are never evaluated
+#ifdef PRISM_TRACING
+constexpr bool COMPILED = true;
+#else
+constexpr bool COMPILED = false;
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+struct Event {
+    const char* name;
+    const char* category;
+    Clock::time_point start;
+    Clock::time_point end;
+    std::string detail;
+};
+
+inline std::atomic<bool> recording{ false };
+
+// Drops what was recorded so far and records from every thread until stop()
+void start();
+void stop();
+// Appends to the calling thread's buffer, only contended while exporting
+void record(Event event);
+// Shown instead of the thread id in the trace viewer
+void name_thread(std::string name);
+// Everything recorded since start() as Chrome trace-event JSON, loadable
+// in chrome://tracing or Perfetto; timestamps are relative to start()
+std::string to_chrome_json();
+
+// Records the time between its construction and destruction as one event
+class Scope {
+  public:
+    Scope(const char* name, const char* category) : m_name(name), m_category(category) {
+        if (recording.load(std::memory_order_relaxed)) {
+            m_active = true;
+            m_start = Clock::now();
+        }
+    }
+    Scope(const char* name, const char* category, std::string_view detail) : Scope(name, category) {
+        if (m_active) {
+            m_detail = detail;
+        }
+    }
+    ~Scope() {
+        if (m_active) {
+            record({ m_name, m_category, m_start, Clock::now(), std::move(m_detail) });
+        }
+    }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    const char* m_name;
+    const char* m_category;
+    bool m_active = false;
+    Clock::time_point m_start;
+    std::string m_detail;
+};
+} // namespace prism::trace
+
+#ifdef PRISM_TRACING
+#define PRISM_TRACE_CONCAT_(a, b) a##b
+#define PRISM_TRACE_CONCAT(a, b) PRISM_TRACE_CONCAT_(a, b)
+#define PRISM_TRACE_SCOPE(name, category) \
+    prism::trace::Scope PRISM_TRACE_CONCAT(prismTrace, __LINE__)(name, category)
+#define PRISM_TRACE_SCOPE_DETAIL(name, category, detail) \
+    prism::trace::Scope PRISM_TRACE_CONCAT(prismTrace, __LINE__)(name, category, detail)
+#define PRISM_TRACE_THREAD(name) prism::trace::name_thread(name)
+#else
+#define PRISM_TRACE_SCOPE(name, category) ((void) 0)
+#define PRISM_TRACE_SCOPE_DETAIL(name, category, detail) ((void) 0)
+#define PRISM_TRACE_THREAD(name) ((void) 0)
+#endif
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <functional>
+#include <unordered_set>
+#include <deque>
+#include <span>
+#include <cstdint>
+
+#include "processor.h"
+
+namespace prism {
+// Immutable strings, stored once each. Two interned strings are equal
+// exactly when their handles are.
+class StringPool {
+  public:
+    const std::string* intern(std::string_view str) {
+        auto found = m_strings.find(str);
+        if (found != m_strings.end()) {
+            return &*found;
+        }
+        return &*m_strings.emplace(str).first;
+    }
+    const std::string* intern(std::string&& str) {
+        auto found = m_strings.find(std::string_view(str));
+        if (found != m_strings.end()) {
+            return &*found;
+        }
+        return &*m_strings.insert(std::move(str)).first;
+    }
+    size_t size() const {
+        return m_strings.size();
+    }
+    void clear() {
+        m_strings.clear();
+    }
+
+  private:
+    struct Hash {
+        using is_transparent = void;
+        size_t operator()(std::string_view str) const {
+            return std::hash<std::string_view>{}(str);
+        }
+    };
+    std::unordered_set<std::string, Hash, std::equal_to<>> m_strings;
+};
+
+// What the evaluator computes with: ints and floats inline, strings as
+// handles into the render's StringPool and everything else, arrays
+// included, as a pointer to the ContextTypes holding it. Copies never
+// allocate.
+struct Value {
+    enum Type : uint8_t { Void, Int, Float, String, Array, Range, Boxed };
+
+    Type type = Void;
+    union {
+        int i;
+        float f;
+        const std::string* str;
+        // Array: one of the MTDArray alternatives
+        const ContextTypes* boxed;
+        struct {
+            uint32_t start;
+            uint32_t end;
+        } range;
+    };
+
+    Value() : i(0) {
+    }
+    static Value of(int value) {
+        Value result;
+        result.type = Int;
+        result.i = value;
+        return result;
+    }
+    static Value of(bool value) {
+        return of(value ? 1 : 0);
+    }
+    static Value of(float value) {
+        Value result;
+        result.type = Float;
+        result.f = value;
+        return result;
+    }
+    static Value of(const std::string* value) {
+        Value result;
+        result.type = String;
+        result.str = value;
+        return result;
+    }
+    static Value of(uint32_t start, uint32_t end) {
+        Value result;
+        result.type = Range;
+        result.range = { start, end };
+        return result;
+    }
+    static Value box(const ContextTypes* value) {
+        Value result;
+        result.type = is_type(*value, MTDArray<bool>) || is_type(*value, MTDArray<int>) ||
+                              is_type(*value, MTDArray<float>)
+                          ? Array
+                          : Boxed;
+        result.boxed = value;
+        return result;
+    }
+
+    // 1 is the only true value
+    bool is_true() const {
+        return type == Int && i == 1;
+    }
+};
+static_assert(sizeof(Value) == 16, "Values are copied around the evaluator by value");
+
+// Copies a value out of the evaluator
+inline ContextTypes to_context(const Value& value) {
+    switch (value.type) {
+        case Value::Int:
+            return value.i;
+        case Value::Float:
+            return value.f;
+        case Value::String:
+            return *value.str;
+        case Value::Range:
+            return GeneratedRange{ value.range.start, value.range.end };
+        case Value::Array:
+        case Value::Boxed:
+            return *value.boxed;
+        default:
+            return Void{};
+    }
+}
+
+// Backing storage of the values of a render
+class ValueStore {
+  public:
+    // `value` has to outlive the returned Value unless it is an int or a float
+    Value make(const ContextTypes& value) {
+        if (auto integer = std::get_if<int>(&value)) {
+            return Value::of(*integer);
+        }
+        if (auto number = std::get_if<float>(&value)) {
+            return Value::of(*number);
+        }
+        if (auto str = std::get_if<std::string>(&value)) {
+            return Value::of(strings.intern(*str));
+        }
+        if (auto range = std::get_if<GeneratedRange>(&value)) {
+            return Value::of((uint32_t) range->start, (uint32_t) range->end);
+        }
+        if (is_type(value, prism::Void)) {
+            return Value{};
+        }
+        return Value::box(&value);
+    }
+    // A temporary is kept here if it does not fit a Value
+    Value make(ContextTypes&& value) {
+        if (auto str = std::get_if<std::string>(&value)) {
+            return Value::of(strings.intern(std::move(*str)));
+        }
+        if (is_type(value, MTDArray<bool>) || is_type(value, MTDArray<int>) || is_type(value, MTDArray<float>) ||
+            is_type(value, ForContext) || is_type(value, Native) || is_type(value, Opaque)) {
+            boxes.push_back(std::move(value));
+            return Value::box(&boxes.back());
+        }
+        return make((const ContextTypes&) value);
+    }
+    const std::string* intern(std::string_view str) {
+        return strings.intern(str);
+    }
+    const std::string* intern(std::string&& str) {
+        return strings.intern(std::move(str));
+    }
+    // Invalidates every Value made so far. Strings are kept for the next
+    // render unless there are too many of them.
+    void reset() {
+        boxes.clear();
+        if (strings.size() > MAX_STRINGS) {
+            strings.clear();
+        }
+    }
+
+  private:
+    static constexpr size_t MAX_STRINGS = 4096;
+    StringPool strings;
+    std::deque<ContextTypes> boxes;
+};
+
+// One call of a native. The arguments are the top of the evaluator stack,
+// the thunk stores the return value in `result`.
+struct NativeCall {
+    ContextItems& items;
+    std::span<const Value> args;
+    ContextTypes result;
+};
+} // namespace prism
@@ -0,0 +1,80 @@
+#include "test.h"
+
+#include <vector>
+#include "prism/batch.h"
+#include "prism/jobs.h"
+#include "prism/processor.h"
+#include "prism/render.h"
+
+namespace {
+std::shared_ptr<const prism::CompiledTemplate> compile(const std::string& body) {
+    prism::Processor processor;
+    processor.load("@prism(type='fragment')\n" + body);
+    return processor.compiled();
+}
+
+const std::string PERMUTED = "@if(fog == 1)\nfog\n@end\n"
+                             "@if(a == 1 || b == 2)\neither\n@end\n"
+                             "@for(i in 0..n)\n@{i * b}\n@end\n";
+
+std::vector<prism::ContextItems> permutations() {
+    std::vector<prism::ContextItems> contexts;
+    for (int fog = 0; fog < 2; fog++) {
+        for (int a = 0; a < 3; a++) {
+            for (int b = 1; b < 3; b++) {
+                contexts.push_back({ { "fog", fog }, { "a", a }, { "b", b }, { "n", a } });
+            }
+        }
+    }
+    return contexts;
+}
+} // namespace
+
+TEST(batch_matches_sequential) {
+    prism::Renderer renderer(compile(PERMUTED));
+    auto contexts = permutations();
+    auto result = prism::render_batch(renderer, contexts);
+    CHECK_EQ(result.size(), contexts.size());
+    // Permutations rendering the same text share an output
+    CHECK(result.outputs.size() < contexts.size());
+    for (size_t i = 0; i < contexts.size(); i++) {
+        CHECK_EQ(result[i], renderer.render(contexts[i]));
+    }
+}
+
+TEST(batch_on_a_pool_of_its_own) {
+    prism::Renderer renderer(compile(PERMUTED));
+    auto contexts = permutations();
+    prism::ThreadPool jobs(3);
+    auto result = prism::render_batch(renderer, contexts, &jobs);
+    for (size_t i = 0; i < contexts.size(); i++) {
+        CHECK_EQ(result[i], renderer.render(contexts[i]));
+    }
+}
+
+TEST(batch_reports_errors) {
+    prism::Renderer renderer(compile("@{missing}\n"));
+    std::vector<prism::ContextItems> contexts(4);
+    CHECK_THROWS(prism::render_batch(renderer, contexts));
+}
+
+TEST(batch_leaves_contexts_untouched) {
+    // Renders read the contexts in place, defaults and assignments stay with each render
+    prism::Renderer renderer(compile("@setting(var='gain', name='Gain', type='int', default='3')\n"
+                                     "@if(a == 1)\n@{b = b + gain}\n@end\nb=@{b} gain=@{gain}\n"));
+    std::vector<prism::ContextItems> contexts;
+    for (int i = 0; i < 8; i++) {
+        contexts.push_back({ { "a", i % 2 }, { "b", i } });
+    }
+    contexts.push_back({ { "a", 1 }, { "b", 1 }, { "gain", 5 } });
+    prism::ThreadPool jobs(2);
+    auto result = prism::render_batch(renderer, contexts, &jobs);
+    for (size_t i = 0; i < 8; i++) {
+        int b = (int) i + (i % 2 == 1 ? 3 : 0);
+        CHECK_EQ(result[i], "b=" + std::to_string(b) + " gain=3\n");
+        CHECK_EQ(contexts[i].size(), 2u);
+        CHECK_EQ(std::get<int>(contexts[i].at("b")), (int) i);
+    }
+    CHECK_EQ(result[8], "b=6 gain=5\n");
+    CHECK_EQ(std::get<int>(contexts[8].at("b")), 1);
+}
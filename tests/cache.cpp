@@ -0,0 +1,100 @@
+#include "test.h"
+
+#include "prism/cache.h"
+#include "prism/native.h"
+#include "prism/processor.h"
+
+namespace {
+std::shared_ptr<prism::OutputCache> cached(prism::Processor& processor, const std::string& body) {
+    auto cache = std::make_shared<prism::OutputCache>();
+    processor.bind_cache(cache);
+    processor.load("@prism(type='fragment')\n" + body);
+    return cache;
+}
+
+int peek(prism::ContextItems& items) {
+    return std::get<int>(items.at("hidden"));
+}
+} // namespace
+
+TEST(cache_keys_on_reads) {
+    prism::Processor processor;
+    auto cache = cached(processor, "@if(a)\nA @{b}\n@else\nC @{c}\n@end\n");
+    CHECK_EQ(processor.render({ { "a", 1 }, { "b", 2 }, { "c", 3 } }), "A 2\n");
+    // c is not read when a is set
+    CHECK_EQ(processor.render({ { "a", 1 }, { "b", 2 }, { "c", 4 } }), "A 2\n");
+    CHECK_EQ(cache->stats().hits, 1u);
+    CHECK_EQ(processor.render({ { "a", 1 }, { "b", 5 }, { "c", 4 } }), "A 5\n");
+    CHECK_EQ(processor.render({ { "a", 0 }, { "b", 5 }, { "c", 4 } }), "C 4\n");
+    CHECK_EQ(processor.render({ { "a", 0 }, { "b", 6 }, { "c", 4 } }), "C 4\n");
+    CHECK_EQ(cache->stats().hits, 2u);
+    CHECK_EQ(cache->stats().entries, 3u);
+}
+
+TEST(cache_compares_array_contents) {
+    int values[3] = { 1, 2, 3 };
+    prism::Processor processor;
+    auto cache = cached(processor, "@for(v in arr)\n@{v}\n@end\n@{arr[1]}\n");
+    prism::ContextItems items{ { "arr", M_ARRAY(values, int, 3) } };
+    CHECK_EQ(processor.render(items), "1\n2\n3\n2\n");
+    values[2] = 9;
+    CHECK_EQ(processor.render(items), "1\n2\n9\n2\n");
+    CHECK_EQ(cache->stats().hits, 0u);
+    CHECK_EQ(processor.render(items), "1\n2\n9\n2\n");
+    CHECK_EQ(cache->stats().hits, 1u);
+}
+
+TEST(cache_skips_context_natives) {
+    prism::Processor processor;
+    auto cache = cached(processor, "v=@{peek()}\n");
+    auto native = prism::make_native(peek);
+    CHECK_EQ(processor.render({ { "peek", native }, { "hidden", 1 } }), "v=1\n");
+    CHECK_EQ(processor.render({ { "peek", native }, { "hidden", 2 } }), "v=2\n");
+    CHECK_EQ(cache->stats().hits, 0u);
+    CHECK_EQ(cache->stats().entries, 0u);
+}
+
+TEST(cache_hit_keeps_assignments) {
+    prism::Processor processor;
+    auto cache = cached(processor, "@{x = y + 1}\nx=@{x}\n");
+    for (int i = 0; i < 2; i++) {
+        CHECK_EQ(processor.render({ { "y", 4 } }), "x=5\n");
+        auto types = processor.getTypes();
+        CHECK(types.contains("x"));
+        CHECK_EQ(std::get<int>(types.at("x")), 5);
+    }
+    CHECK_EQ(cache->stats().hits, 1u);
+}
+
+TEST(cache_entries_compare_values) {
+    prism::OutputCache cache;
+    prism::ReadSet reads{ { "s", {} } };
+    prism::ContextTypes first = std::string("first");
+    std::string values;
+    prism::encode_read(reads[0], &first, values);
+    cache.insert(1, reads, values, { "out", {} });
+
+    prism::ContextTypes second = std::string("second");
+    CHECK(!cache.find(1, [&second](const std::string&) { return &second; }).has_value());
+    CHECK(!cache.find(2, [&first](const std::string&) { return &first; }).has_value());
+    auto hit = cache.find(1, [&first](const std::string&) { return &first; });
+    CHECK(hit.has_value());
+    CHECK_EQ(hit->output, "out");
+}
+
+TEST(cache_budget_evicts) {
+    prism::OutputCache cache(4096);
+    prism::ReadSet reads{ { "i", {} } };
+    for (int i = 0; i < 64; i++) {
+        prism::ContextTypes value = i;
+        std::string values;
+        prism::encode_read(reads[0], &value, values);
+        cache.insert(1, reads, values, { std::string(256, 'x'), {} });
+    }
+    auto stats = cache.stats();
+    CHECK(stats.bytes <= 4096);
+    CHECK(stats.evictions > 0);
+    CHECK_EQ(stats.entries + stats.evictions, 64u);
+    CHECK_EQ(cache.invalidate(1), stats.entries);
+    CHECK_EQ(cache.stats().entries, 0u);
+}
@@ -0,0 +1,55 @@
+#include "test.h"
+
+#include "prism/processor.h"
+#include "prism/render.h"
+
+namespace {
+std::shared_ptr<const prism::CompiledTemplate> compile(const std::string& body) {
+    prism::Processor processor;
+    processor.load("@prism(type='fragment')\n" + body);
+    return processor.compiled();
+}
+
+bool decided(const prism::CompiledTemplate& compiled) {
+    for (const auto& child : *std::get<prism::RootNode>(compiled.root->node).children) {
+        if (std::holds_alternative<prism::DecisionNode>(child->node)) {
+            return true;
+        }
+    }
+    return false;
+}
+} // namespace
+
+TEST(decision_toggle_chains) {
+    auto compiled = compile("a\n@if(fog)\nfog @{d}\n@elseif(!shadow)\nlit\n@else\nshadow\n@end\nb\n");
+    CHECK(decided(*compiled));
+    prism::Renderer renderer(compiled);
+    CHECK_EQ(renderer.render({ { "fog", 1 }, { "shadow", 0 }, { "d", 3 } }), "a\nfog 3\nb\n");
+    CHECK_EQ(renderer.render({ { "fog", 0 }, { "shadow", 0 }, { "d", 3 } }), "a\nlit\nb\n");
+    CHECK_EQ(renderer.render({ { "fog", 0 }, { "shadow", 1 }, { "d", 3 } }), "a\nshadow\nb\n");
+}
+
+TEST(decision_int_tests) {
+    auto compiled = compile("@if(mode == 2)\ntwo\n@elseif(mode == 3)\nthree\n@end\n");
+    CHECK(decided(*compiled));
+    prism::Renderer renderer(compiled);
+    CHECK_EQ(renderer.render({ { "mode", 2 } }), "two\n");
+    CHECK_EQ(renderer.render({ { "mode", 3 } }), "three\n");
+    CHECK_EQ(renderer.render({ { "mode", 4 } }), "");
+}
+
+TEST(decision_nested_toggles) {
+    auto compiled = compile("@if(a)\n@if(b)\nab\n@else\na\n@end\n@elseif(b == 1)\nb\n@end\n@if(!a)\nnot a\n@end\n");
+    CHECK(decided(*compiled));
+    prism::Renderer renderer(compiled);
+    CHECK_EQ(renderer.render({ { "a", 1 }, { "b", 1 } }), "ab\n");
+    CHECK_EQ(renderer.render({ { "a", 1 }, { "b", 0 } }), "a\n");
+    CHECK_EQ(renderer.render({ { "a", 0 }, { "b", 1 } }), "b\nnot a\n");
+    CHECK_EQ(renderer.render({ { "a", 0 }, { "b", 0 } }), "not a\n");
+}
+
+TEST(decision_leaves_other_conditions) {
+    auto compiled = compile("@if(a == b)\nsame\n@end\n");
+    CHECK(!decided(*compiled));
+    CHECK_EQ(prism::Renderer(compiled).render({ { "a", 2 }, { "b", 2 } }), "same\n");
+}
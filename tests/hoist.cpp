@@ -0,0 +1,67 @@
+#include "test.h"
+
+#include "prism/processor.h"
+
+namespace {
+struct Rendered {
+    std::string output;
+    // Hoisted blocks and expressions of the template
+    uint32_t hoisted;
+};
+
+Rendered render(const std::string& body, const prism::ContextItems& items,
+                prism::OutputMode mode = prism::OutputMode::Trim) {
+    prism::Processor processor;
+    processor.set_output_mode(mode);
+    processor.load("@prism(type='fragment')\n" + body);
+    auto output = processor.render(items);
+    return { output, processor.compiled()->hoisted };
+}
+} // namespace
+
+TEST(hoist_invariant_if_in_for) {
+    const std::string body = "@for(i in 0..3)\n@if(a == b)\non\n@end\n@{i}\n@end\n";
+    auto on = render(body, { { "a", 1 }, { "b", 1 } });
+    CHECK_EQ(on.output, "on\n0\non\n1\non\n2\n");
+    CHECK(on.hoisted > 0);
+    CHECK_EQ(render(body, { { "a", 1 }, { "b", 2 } }).output, "0\n1\n2\n");
+    // Turned into a decision node first
+    auto toggle = render("@for(i in 0..3)\n@if(mode == 1)\non\n@end\n@end\n", { { "mode", 1 } });
+    CHECK_EQ(toggle.output, "on\non\non\n");
+    CHECK(toggle.hoisted > 0);
+}
+
+TEST(hoist_nested_loop_reading_outer_variable) {
+    // Invariant to the inner loop only, so recomputed each time it is entered
+    auto result = render("@for(i in 0..3)\n@for(j in 0..2)\n@{i * 10}\n@end\n@end\n", {});
+    CHECK_EQ(result.output, "0\n0\n10\n10\n20\n20\n");
+    CHECK(result.hoisted > 0);
+}
+
+TEST(hoist_keeps_assigned_slots_variant) {
+    auto result = render("@{x = 0}\n@for(i in 0..3)\n@{x = x + 1}\n@{x * k}\n@end\n", { { "k", 2 } });
+    CHECK_EQ(result.output, "2\n4\n6\n");
+    CHECK_EQ(result.hoisted, 0u);
+}
+
+TEST(hoist_text_is_trimmed) {
+    // The same block with a condition reading the loop variable is not hoisted
+    const std::string hoisted = "@for(i in 0..2)\n  @if(a == b)\n    on  \n\n  @end\n@{i}\n@end\n";
+    const std::string walked = "@for(i in 0..2)\n  @if(a == b && i == i)\n    on  \n\n  @end\n@{i}\n@end\n";
+    prism::ContextItems items{ { "a", 1 }, { "b", 1 } };
+    auto result = render(hoisted, items);
+    CHECK(result.hoisted > 0);
+    CHECK_EQ(render(walked, items).hoisted, 0u);
+    CHECK_EQ(result.output, "on\n0\non\n1\n");
+    CHECK_EQ(result.output, render(walked, items).output);
+}
+
+TEST(hoist_text_is_minified) {
+    const std::string hoisted = "@for(i in 0..2)\n@if(a == b)\nx = y /* c */ + 1; // d\n@end\nz(@{i});\n@end\n";
+    const std::string walked = "@for(i in 0..2)\n@if(a == b && i == i)\nx = y /* c */ + 1; // d\n@end\nz(@{i});\n@end\n";
+    prism::ContextItems items{ { "a", 1 }, { "b", 1 } };
+    auto result = render(hoisted, items, prism::OutputMode::Minify);
+    CHECK(result.hoisted > 0);
+    CHECK_EQ(result.output, "x=y+1;z(0);x=y+1;z(1);\n");
+    CHECK_EQ(result.output, render(walked, items, prism::OutputMode::Minify).output);
+}
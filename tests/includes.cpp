@@ -0,0 +1,106 @@
+#include "test.h"
+
+#include <unordered_map>
+#include "prism/include_cache.h"
+#include "prism/processor.h"
+#include "prism/render.h"
+
+namespace {
+std::unordered_map<std::string, std::string> files;
+std::optional<std::string> load_file(const std::string& path) {
+    auto file = files.find(path);
+    if (file == files.end()) {
+        return std::nullopt;
+    }
+    return file->second;
+}
+
+const std::string TEMPLATE = "@prism(type='fragment')\n@include(\"part.fs\")\nend\n";
+} // namespace
+
+TEST(include_links_file) {
+    files = { { "part.fs", "@prism(type='fragment')\npart @{v}\n" } };
+    prism::Processor processor;
+    processor.bind_include_loader(load_file);
+    processor.load(TEMPLATE);
+    CHECK_EQ(processor.render({ { "v", 1 } }), "part 1\nend\n");
+    CHECK_EQ(processor.compiled()->includes.size(), 1u);
+}
+
+TEST(include_missing_file_throws) {
+    files.clear();
+    prism::Processor processor;
+    processor.bind_include_loader(load_file);
+    CHECK_THROWS(processor.load(TEMPLATE));
+}
+
+TEST(include_cache_sees_edits) {
+    files = { { "part.fs", "@prism(type='fragment')\nold\n" } };
+    auto cache = std::make_shared<prism::IncludeCache>();
+    prism::Processor processor;
+    processor.bind_include_loader(load_file);
+    processor.bind_include_cache(cache);
+    processor.load(TEMPLATE);
+    auto first = cache->find("part.fs");
+    CHECK_EQ(processor.render({}), "old\nend\n");
+
+    // Unchanged, the parse is shared
+    processor.load(TEMPLATE);
+    CHECK(cache->find("part.fs") == first);
+
+    files["part.fs"] = "@prism(type='fragment')\nnew\n";
+    processor.load(TEMPLATE);
+    CHECK_EQ(processor.render({}), "new\nend\n");
+    CHECK(cache->find("part.fs") != first);
+}
+
+TEST(include_cache_shares_contents) {
+    files = { { "a.fs", "@prism(type='fragment')\nsame\n" }, { "b.fs", "@prism(type='fragment')\nsame\n" } };
+    auto cache = std::make_shared<prism::IncludeCache>();
+    prism::Processor processor;
+    processor.bind_include_loader(load_file);
+    processor.bind_include_cache(cache);
+    processor.load("@prism(type='fragment')\n@include(\"a.fs\")\n@include(\"b.fs\")\n");
+    CHECK_EQ(processor.render({}), "same\nsame\n");
+    CHECK(cache->find("a.fs") == cache->find("b.fs"));
+}
+
+TEST(include_once_skips_repeats) {
+    files = { { "common.fs", "@prism(type='fragment')\ncommon\n" },
+              { "light.fs", "@prism(type='fragment')\n@include_once(\"common.fs\")\nlight\n" } };
+    prism::Processor processor;
+    processor.bind_include_loader(load_file);
+    processor.load("@prism(type='fragment')\n@include_once(\"common.fs\")\n@include(\"light.fs\")\n"
+                   "@include_once(\"common.fs\")\n@include(\"common.fs\")\n");
+    CHECK_EQ(processor.render({}), "common\nlight\ncommon\n");
+}
+
+TEST(include_path_follows_context) {
+    files = { { "a.fs", "@prism(type='fragment')\na\n" }, { "b.fs", "@prism(type='fragment')\nb\n" } };
+    prism::Processor processor;
+    processor.bind_include_loader(load_file);
+    // The path is resolved while loading
+    CHECK_THROWS(processor.load("@prism(type='fragment')\n@include(part)\n"));
+    processor.populate({ { "part", "a.fs" } });
+    processor.load("@prism(type='fragment')\n@include(part)\n");
+    auto linked = processor.compiled();
+    CHECK_EQ(processor.render({ { "part", "a.fs" } }), "a\n");
+    CHECK(processor.compiled() == linked);
+    CHECK_EQ(processor.render({ { "part", "b.fs" } }), "b\n");
+    CHECK(processor.compiled() != linked);
+
+    // A renderer cannot link again
+    prism::Renderer renderer(processor.compiled());
+    CHECK_EQ(renderer.render({ { "part", "b.fs" } }), "b\n");
+    CHECK_THROWS(renderer.render({ { "part", "a.fs" } }));
+}
+
+TEST(include_once_per_branch) {
+    files = { { "c.fs", "@prism(type='fragment')\ncommon\n" } };
+    prism::Processor processor;
+    processor.bind_include_loader(load_file);
+    processor.load("@prism(type='fragment')\n@if(es == 1)\n@include_once(\"c.fs\")\n@else\n"
+                   "@include_once(\"c.fs\")\n@end\n");
+    CHECK_EQ(processor.render({ { "es", 0 } }), "common\n");
+    CHECK_EQ(processor.render({ { "es", 1 } }), "common\n");
+}
@@ -0,0 +1,75 @@
+#include "test.h"
+
+#include "prism/lexer.h"
+
+using prism::lexer::TokenType;
+
+namespace {
+std::vector<prism::lexer::Token> lex(std::string_view text) {
+    prism::lexer::Lexer lexer(text);
+    return lexer.tokenize();
+}
+
+std::vector<TokenType> types(std::string_view text) {
+    std::vector<TokenType> result;
+    for (const auto& token : lex(text)) {
+        result.push_back(token.type);
+    }
+    return result;
+}
+} // namespace
+
+TEST(lexer_operators) {
+    CHECK(types("a || b && !c == d") == std::vector<TokenType>({ TokenType::Identifier, TokenType::Or,
+                                                                  TokenType::Identifier, TokenType::And, TokenType::Not,
+                                                                  TokenType::Identifier, TokenType::Equal,
+                                                                  TokenType::Identifier, TokenType::EndOfinput }));
+    CHECK(types("x = a[1] + f(2, 3) * 4 / 5 - 6") ==
+          std::vector<TokenType>({ TokenType::Identifier, TokenType::Assign, TokenType::Identifier, TokenType::LBracket,
+                                   TokenType::Integer, TokenType::RBracket, TokenType::Add, TokenType::Identifier,
+                                   TokenType::LParen, TokenType::Integer, TokenType::Comma, TokenType::Integer,
+                                   TokenType::RParen, TokenType::Mul, TokenType::Integer, TokenType::Div,
+                                   TokenType::Integer, TokenType::Sub, TokenType::Integer, TokenType::EndOfinput }));
+}
+
+TEST(lexer_keywords_are_whole_words) {
+    CHECK(types("if else elseif then true false in") ==
+          std::vector<TokenType>({ TokenType::If, TokenType::Else, TokenType::Elseif, TokenType::Then, TokenType::True,
+                                   TokenType::False, TokenType::In, TokenType::EndOfinput }));
+    auto tokens = lex("index iffy elsewhere truth in_range");
+    CHECK_EQ(tokens.size(), 6u);
+    for (size_t i = 0; i < 5; i++) {
+        CHECK(tokens[i].type == TokenType::Identifier);
+    }
+    CHECK_EQ(tokens[1].value, "iffy");
+}
+
+TEST(lexer_numbers_and_ranges) {
+    auto tokens = lex("i in 0..10 + 1.5");
+    CHECK(tokens[2].type == TokenType::Integer);
+    CHECK_EQ(tokens[2].value, "0");
+    CHECK(tokens[3].type == TokenType::Range);
+    CHECK_EQ(tokens[4].value, "10");
+    CHECK(tokens[6].type == TokenType::Float);
+    CHECK_EQ(prism::lexer::parse_float(tokens[6].value), 1.5f);
+    CHECK_EQ(prism::lexer::parse_int("42"), 42);
+    CHECK_THROWS(prism::lexer::parse_int("4x"));
+}
+
+TEST(lexer_strings_are_views) {
+    std::string text = "a + \"x y\"";
+    auto tokens = lex(text);
+    CHECK(tokens[2].type == TokenType::Quote);
+    CHECK_EQ(tokens[2].value, "x y");
+    CHECK(tokens[2].value.data() == text.data() + 5);
+    CHECK_THROWS(lex("\"open"));
+}
+
+TEST(lexer_rejects_lone_characters) {
+    // Reported instead of looping or being dropped
+    CHECK_THROWS(lex("a | b"));
+    CHECK_THROWS(lex("a & b"));
+    CHECK_THROWS(lex("a |"));
+    CHECK_THROWS(lex("a . b"));
+    CHECK_THROWS(lex("a $ b"));
+}
@@ -0,0 +1,31 @@
+#include "test.h"
+
+#include <cstdio>
+#include <cstring>
+
+std::vector<prism::test::Case>& prism::test::cases() {
+    static std::vector<Case> registered;
+    return registered;
+}
+
+// Runs every case, or only those whose name contains the first argument
+int main(int argc, char** argv) {
+    size_t run = 0;
+    size_t failed = 0;
+    for (const auto& test : prism::test::cases()) {
+        if (argc > 1 && std::strstr(test.name, argv[1]) == nullptr) {
+            continue;
+        }
+        run++;
+        try {
+            test.run();
+        } catch (const std::exception& e) {
+            failed++;
+            std::printf("FAIL %s\n  %s\n", test.name, e.what());
+            continue;
+        }
+        std::printf("ok   %s\n", test.name);
+    }
+    std::printf("%zu/%zu passed\n", run - failed, run);
+    return failed == 0 && run > 0 ? 0 : 1;
+}
@@ -0,0 +1,60 @@
+#include "test.h"
+
+#include "prism/native.h"
+#include "prism/processor.h"
+
+namespace {
+std::string render(const std::string& body, prism::ContextItems items) {
+    prism::Processor processor;
+    processor.load("@prism(type='fragment')\n" + body);
+    return processor.render(items);
+}
+
+void define_n(prism::ContextItems& items) {
+    items["n"] = 7;
+}
+
+void bump_n(prism::ContextItems& items) {
+    std::get<int>(items.at("n"))++;
+}
+
+void clear_flag(prism::ContextItems& items) {
+    items["flag"] = 0;
+}
+
+int twice(int value) {
+    return value * 2;
+}
+} // namespace
+
+TEST(native_arguments_and_result) {
+    CHECK_EQ(render("@{twice(21)}\n", { { "twice", prism::make_native(twice) } }), "42\n");
+    CHECK_THROWS(render("@{twice('a')}\n", { { "twice", prism::make_native(twice) } }));
+    CHECK_THROWS(render("@{twice(1, 2)}\n", { { "twice", prism::make_native(twice) } }));
+}
+
+TEST(native_defines_variable) {
+    CHECK_EQ(render("@{define_n()}\nn=@{n}\n", { { "define_n", prism::make_native(define_n) } }), "n=7\n");
+}
+
+TEST(native_updates_variable) {
+    prism::ContextItems items{ { "n", 10 }, { "bump_n", prism::make_native(bump_n) } };
+    CHECK_EQ(render("n=@{n}\n@{bump_n()}\nn=@{n}\n", items), "n=10\nn=11\n");
+}
+
+TEST(native_updates_hoisted_variable) {
+    prism::ContextItems items{ { "n", 10 }, { "bump_n", prism::make_native(bump_n) } };
+    CHECK_EQ(render("@for(i in 0..3)\n@{bump_n()}\n@{n}\n@end\n", items), "11\n12\n13\n");
+}
+
+TEST(native_updates_condition) {
+    prism::ContextItems items{ { "flag", 1 }, { "clear_flag", prism::make_native(clear_flag) } };
+    CHECK_EQ(render("@if(flag)\nA@{clear_flag()}\n@end\n@if(flag)\nB\n@end\nC\n", items), "A\nC\n");
+}
+
+TEST(native_writes_reach_processor) {
+    prism::Processor processor;
+    processor.load("@prism(type='fragment')\n@{bump_n()}\n");
+    processor.render({ { "n", 1 }, { "bump_n", prism::make_native(bump_n) } });
+    CHECK_EQ(std::get<int>(processor.getTypes().at("n")), 2);
+}
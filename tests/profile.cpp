@@ -0,0 +1,91 @@
+#include "test.h"
+
+#include <algorithm>
+#include "prism/cache.h"
+#include "prism/processor.h"
+#include "prism/profile.h"
+
+namespace {
+std::shared_ptr<prism::Profiler> profiled(prism::Processor& processor, const std::string& body) {
+    auto profiler = std::make_shared<prism::Profiler>();
+    processor.bind_profiler(profiler);
+    processor.load("@prism(type='fragment')\n" + body);
+    return profiler;
+}
+
+const prism::DirectiveProfile* find(const std::vector<prism::DirectiveProfile>& report, prism::DirectiveKind kind) {
+    auto entry = std::find_if(report.begin(), report.end(),
+                              [kind](const prism::DirectiveProfile& profile) { return profile.kind == kind; });
+    return entry != report.end() ? &*entry : nullptr;
+}
+
+size_t count(const std::string& text, const std::string& piece) {
+    size_t result = 0;
+    for (auto at = text.find(piece); at != std::string::npos; at = text.find(piece, at + 1)) {
+        result++;
+    }
+    return result;
+}
+} // namespace
+
+TEST(profile_counts_directives) {
+    prism::Processor processor;
+    auto profiler = profiled(processor, "@for(i in 0..3)\n@if(i == 1)\none\n@elseif(i == 2)\ntwo\n@end\n@{i}\n@end\n");
+    CHECK_EQ(processor.render({}), "0\none\n1\ntwo\n2\n");
+    auto report = profiler->report();
+    CHECK_EQ(report.size(), 4u);
+    auto loop = find(report, prism::DirectiveKind::For);
+    auto branch = find(report, prism::DirectiveKind::If);
+    auto elseIf = find(report, prism::DirectiveKind::ElseIf);
+    auto value = find(report, prism::DirectiveKind::Expression);
+    CHECK(loop != nullptr && branch != nullptr && elseIf != nullptr && value != nullptr);
+    CHECK_EQ(loop->hits, 1u);
+    CHECK_EQ(branch->hits, 3u);
+    // Only tested when the @if is not taken
+    CHECK_EQ(elseIf->hits, 2u);
+    CHECK_EQ(value->hits, 3u);
+    CHECK_EQ(value->bytes, 3u);
+    CHECK(loop->total >= loop->self);
+    CHECK(loop->total >= branch->total + value->total);
+    // Counted before the lines are trimmed
+    CHECK(loop->bytes >= 13u);
+}
+
+TEST(profile_renders_skip_the_cache) {
+    prism::Processor processor;
+    auto cache = std::make_shared<prism::OutputCache>();
+    processor.bind_cache(cache);
+    auto profiler = profiled(processor, "@{a}\n");
+    CHECK_EQ(processor.render({ { "a", 1 } }), "1\n");
+    CHECK_EQ(processor.render({ { "a", 1 } }), "1\n");
+    CHECK_EQ(cache->stats().entries, 0u);
+    CHECK_EQ(profiler->report()[0].hits, 2u);
+    profiler->clear();
+    CHECK(profiler->report().empty());
+}
+
+TEST(profile_text_report) {
+    prism::Processor processor;
+    auto profiler = profiled(processor, "@if(a == 1)\n@{a}\n@end\n");
+    processor.render({ { "a", 1 } });
+    auto text = profiler->to_text();
+    CHECK_EQ(count(text, "\n"), 3u);
+    CHECK(text.starts_with("     self us     total us"));
+    CHECK(text.find(" if ") != std::string::npos);
+    CHECK(text.find("@if(a == 1)") != std::string::npos);
+    CHECK(text.find(" expression ") != std::string::npos);
+}
+
+TEST(profile_json_report) {
+    prism::Processor processor;
+    CHECK_EQ(prism::Profiler().to_json(), "[]\n");
+    auto profiler = profiled(processor, "@{a}\t\"quoted\" \\\n");
+    processor.render({ { "a", 1 } });
+    auto json = profiler->to_json();
+    CHECK(json.starts_with("[\n  {\"location\": "));
+    CHECK(json.ends_with("\"bytes\": 1}\n]\n"));
+    CHECK(json.find("\"kind\": \"expression\"") != std::string::npos);
+    // The rest of the line is escaped
+    CHECK(json.find("\"directive\": \"@{a}\\u0009\\\"quoted\\\" \\\\\"") != std::string::npos);
+    CHECK(json.find("\"hits\": 1, \"total_us\": ") != std::string::npos);
+}
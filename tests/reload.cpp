@@ -0,0 +1,132 @@
+#include "test.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include "prism/cache.h"
+#include "prism/reload.h"
+#include "prism/utils/file_watcher.h"
+#include "prism/utils/mapped_file.h"
+
+namespace {
+using namespace std::chrono_literals;
+
+// Files in a directory of their own, removed with it
+struct TemporaryDirectory {
+    std::filesystem::path directory;
+
+    explicit TemporaryDirectory(const char* name)
+        : directory(std::filesystem::temp_directory_path() / ("prism_test_" + std::string(name))) {
+        std::filesystem::remove_all(directory);
+        std::filesystem::create_directories(directory);
+    }
+    ~TemporaryDirectory() {
+        std::error_code error;
+        std::filesystem::remove_all(directory, error);
+    }
+    std::string path(const std::string& name) const {
+        return (directory / name).string();
+    }
+    std::string write(const std::string& name, const std::string& contents) const {
+        std::ofstream(path(name), std::ios::binary | std::ios::trunc) << contents;
+        return path(name);
+    }
+};
+
+bool contains(const std::vector<std::string>& paths, const std::string& path) {
+    return std::find(paths.begin(), paths.end(), path) != paths.end();
+}
+} // namespace
+
+TEST(file_watcher_reports_writes) {
+    TemporaryDirectory files("watch_writes");
+    auto path = files.write("a.fs", "one");
+    auto other = files.write("b.fs", "one");
+    prism::FileWatcher watcher;
+    watcher.add(path);
+    watcher.add(path);
+    CHECK(watcher.wait(0ms).empty());
+    files.write("a.fs", "two");
+    files.write("b.fs", "two");
+    auto changed = watcher.wait(2000ms);
+    CHECK_EQ(changed.size(), 1u);
+    CHECK(contains(changed, path));
+    CHECK(!contains(changed, other));
+    CHECK(watcher.wait(0ms).empty());
+}
+
+TEST(file_watcher_sees_replaced_and_created_files) {
+    TemporaryDirectory files("watch_replace");
+    auto path = files.write("a.fs", "one");
+    auto later = files.path("later.fs");
+    prism::FileWatcher watcher;
+    watcher.add(path);
+    watcher.add(later);
+    // Saved the way editors do, a new file renamed over the old one
+    auto temporary = files.write("a.fs.swp", "two");
+    std::filesystem::rename(temporary, path);
+    CHECK(contains(watcher.wait(2000ms), path));
+    files.write("later.fs", "new");
+    CHECK(contains(watcher.wait(2000ms), later));
+}
+
+TEST(hot_reload_recompiles_affected_templates) {
+    TemporaryDirectory files("reload");
+    auto common = files.write("common.fs", "@prism(type='fragment')\ncommon one\n");
+    auto main = files.write("main.fs", "@prism(type='fragment')\n@include(\"" + common + "\")\nmain @{n}\n");
+    auto other = files.write("other.fs", "@prism(type='fragment')\nother\n");
+    auto cache = std::make_shared<prism::OutputCache>();
+    prism::HotReloader reloader(cache);
+    prism::Processor first;
+    prism::Processor second;
+    first.bind_include_loader(prism::MappedFile::open);
+    first.bind_cache(cache);
+    reloader.add(first, main);
+    reloader.add(second, other);
+    CHECK_EQ(first.render({ { "n", 1 } }), "common one\nmain 1\n");
+    CHECK_EQ(cache->stats().entries, 1u);
+    auto otherTemplate = second.compiled();
+
+    files.write("common.fs", "@prism(type='fragment')\ncommon two\n");
+    auto reloaded = reloader.poll(2000ms);
+    CHECK_EQ(reloaded.size(), 1u);
+    CHECK(contains(reloaded, main));
+    // The renders of the old template are gone, the other one is untouched
+    CHECK_EQ(cache->stats().entries, 0u);
+    CHECK(second.compiled() == otherTemplate);
+    CHECK_EQ(first.render({ { "n", 1 } }), "common two\nmain 1\n");
+}
+
+TEST(hot_reload_keeps_template_on_error) {
+    TemporaryDirectory files("reload_error");
+    auto main = files.write("main.fs", "@prism(type='fragment')\nfine\n");
+    prism::HotReloader reloader;
+    prism::Processor processor;
+    reloader.add(processor, main);
+    files.write("main.fs", "no header\n");
+    CHECK(reloader.poll(2000ms).empty());
+    CHECK_EQ(processor.render({}), "fine\n");
+    files.write("main.fs", "@prism(type='fragment')\nfixed\n");
+    CHECK(contains(reloader.poll(2000ms), main));
+    CHECK_EQ(processor.render({}), "fixed\n");
+}
+
+TEST(hot_reload_survives_files_shrunk_in_place) {
+    TemporaryDirectory files("reload_shrink");
+    auto part = files.write("part.fs", "@prism(type='fragment')\n" + std::string(8192, '/') + "\n@{missing}\n");
+    auto main = files.write("main.fs", "@prism(type='fragment')\n@include(\"" + part + "\")\n");
+    prism::HotReloader reloader;
+    prism::Processor processor;
+    processor.bind_include_loader(prism::MappedFile::open);
+    reloader.add(processor, main);
+    // Truncated without replacing the file, as an editor saving in place does
+    files.write("part.fs", "");
+    files.write("main.fs", "");
+    std::string error;
+    try {
+        processor.render({});
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+    CHECK(error.find(part + ":3:") != std::string::npos);
+}
@@ -0,0 +1,123 @@
+#include "test.h"
+
+#include <string_view>
+#include <vector>
+#include "prism/processor.h"
+#include "prism/render.h"
+#include "prism/sink.h"
+
+namespace {
+std::shared_ptr<const prism::CompiledTemplate> compile(const std::string& body) {
+    prism::Processor processor;
+    processor.load("@prism(type='fragment')\n" + body);
+    return processor.compiled();
+}
+
+size_t occurrences(std::string_view text, std::string_view piece) {
+    size_t count = 0;
+    for (auto at = text.find(piece); at != std::string_view::npos; at = text.find(piece, at + 1)) {
+        count++;
+    }
+    return count;
+}
+
+// Each piece is a write of its own
+std::string minify(const std::vector<std::string_view>& pieces) {
+    prism::StringSink target;
+    prism::MinifySink sink(target);
+    for (auto piece : pieces) {
+        sink.write(piece);
+    }
+    sink.flush();
+    return target.str();
+}
+} // namespace
+
+TEST(scatter_references_stable_text) {
+    const std::string stable = "hello world";
+    std::string_view view(stable);
+    prism::ScatterSink sink(view);
+    sink.write(view.substr(0, 5));
+    sink.write(view.substr(5, 1));
+    sink.write(std::string_view("there, "));
+    sink.write(std::string_view("the "));
+    sink.write(view.substr(6));
+    CHECK_EQ(sink.str(), "hello there, the world");
+    CHECK_EQ(sink.size(), 22u);
+    // Adjacent pieces of either kind are merged
+    CHECK_EQ(sink.spans().size(), 3u);
+    CHECK(!sink.spans()[0].owned);
+    CHECK_EQ(sink.spans()[0].size, 6u);
+    CHECK(sink.spans()[1].owned);
+    CHECK(!sink.spans()[2].owned);
+    CHECK_EQ(sink.spans()[2].offset, 6u);
+}
+
+TEST(scatter_flushes_to_target) {
+    const std::string stable = "abc";
+    prism::StringSink target;
+    prism::ScatterSink sink(stable, &target);
+    sink.write(std::string_view(stable).substr(1));
+    sink.write(std::string_view("!"));
+    sink.flush();
+    CHECK_EQ(target.str(), "bc!");
+    CHECK(sink.spans().empty());
+    CHECK_EQ(sink.size(), 0u);
+    sink.write(std::string_view("again"));
+    sink.flush();
+    CHECK_EQ(target.str(), "bc!again");
+}
+
+TEST(pool_text_stores_pieces_once) {
+    auto compiled = compile("@if(a == b)\nsame text\n@else\nsame text\n@end\n@for(i in 0..2)\nsame text\n@end\n");
+    CHECK_EQ(occurrences(compiled->pool, "same text"), 1u);
+    CHECK(compiled->text.empty());
+}
+
+TEST(pool_text_renders_in_place) {
+    auto compiled = compile("head\n@for(i in 0..2)\nline @{i}\n@end\ntail\n");
+    prism::Renderer renderer(compiled);
+    prism::RenderState state;
+    prism::ScatterSink sink(compiled->pool);
+    renderer.render_raw(state, sink);
+    // No trimming on the raw walk, the directive lines stay as blank ones
+    CHECK_EQ(sink.str(), "head\n\nline 0\n\nline 1\n\ntail\n");
+    size_t owned = 0;
+    for (const auto& span : sink.spans()) {
+        owned += span.owned ? span.size : 0;
+    }
+    // Only the loop variable is computed
+    CHECK_EQ(owned, 2u);
+}
+
+TEST(minify_strips_comments) {
+    CHECK_EQ(minify({ "float a = 1.0; // one\nfloat b = a / 2.0; /* two\n lines */ b++;\n" }),
+             "float a=1.0;float b=a/2.0;b++;\n");
+    CHECK_EQ(minify({ "int/* gone */x;\n" }), "int x;\n");
+    // The slash is only known to start a comment once the next write arrives
+    CHECK_EQ(minify({ "a = b /", "/ comment\nc = d /", " e;\n" }), "a=b c=d/e;\n");
+    CHECK_EQ(minify({ "x = 1; /", "* split *", "/ y = 2;\n" }), "x=1;y=2;\n");
+    CHECK_EQ(minify({ "x = y /" }), "x=y/\n");
+}
+
+TEST(minify_keeps_directives_on_their_lines) {
+    CHECK_EQ(minify({ "  #version 330   core  \nvoid main() {}\n" }), "#version 330   core\nvoid main(){}\n");
+    CHECK_EQ(minify({ "x = 1;\n#define TWO 2\ny = TWO;\n" }), "x=1;\n#define TWO 2\ny=TWO;\n");
+    // A continued directive keeps its line break
+    CHECK_EQ(minify({ "#define ADD(a, b) \\\n    (a + b)\nz = ADD(1, 2);\n" }),
+             "#define ADD(a, b) \\\n    (a + b)\nz=ADD(1,2);\n");
+    CHECK_EQ(minify({ "#define A \\", "\n1\nb;\n" }), "#define A \\\n1\nb;\n");
+}
+
+TEST(minify_spaces_only_where_tokens_merge) {
+    CHECK_EQ(minify({ "a - -b;\n" }), "a- -b;\n");
+    CHECK_EQ(minify({ "a + +b; c - 1;\n" }), "a+ +b;c-1;\n");
+    CHECK_EQ(minify({ "vec3 color = vec3 ( 1.0 , 0.5 , 0.0 ) ;\n" }), "vec3 color=vec3(1.0,0.5,0.0);\n");
+    CHECK_EQ(minify({ "uniform", "\n", "float", " x;\n" }), "uniform float x;\n");
+}
+
+TEST(minify_hash_inside_line_is_code) {
+    // Only a '#' first on its line starts a directive
+    CHECK_EQ(minify({ "a = 1; # b\nc;\n" }), "a=1;#b c;\n");
+    CHECK_EQ(minify({ "x;\n   \t#if A\ny;\n#endif\n" }), "x;\n#if A\ny;\n#endif\n");
+}
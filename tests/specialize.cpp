@@ -0,0 +1,59 @@
+#include "test.h"
+
+#include "prism/native.h"
+#include "prism/processor.h"
+#include "prism/render.h"
+#include "prism/specialize.h"
+
+namespace {
+std::shared_ptr<const prism::CompiledTemplate> compile(const std::string& body) {
+    prism::Processor processor;
+    processor.load("@prism(type='fragment')\n" + body);
+    return processor.compiled();
+}
+
+const std::string BRANCHES = "@if(mode == 0)\nzero\n@elseif(mode == 1)\none @{a}\n@elseif(mode == 2)\ntwo\n"
+                             "@else\nother\n@end\n"
+                             "@if(a == 1 && b == 2)\nboth\n@end\n"
+                             "@if(a == 1 || b == 2)\neither\n@end\n"
+                             "@for(i in 0..n)\n@if(i == a)\nat @{i}\n@else\n@{i + b}\n@end\n@end\n";
+
+void set_mode(prism::ContextItems& items) {
+    items["mode"] = 5;
+}
+} // namespace
+
+TEST(specialize_matches_generic) {
+    auto compiled = compile(BRANCHES);
+    prism::Renderer generic(compiled);
+    for (int mode = 0; mode < 4; mode++) {
+        prism::ContextItems statics{ { "mode", mode }, { "n", mode } };
+        prism::Renderer specialized(prism::specialize(compiled, statics));
+        for (int a = 0; a < 3; a++) {
+            prism::ContextItems items{ { "mode", mode }, { "n", mode }, { "a", a }, { "b", 2 } };
+            CHECK_EQ(specialized.render({ { "a", a }, { "b", 2 } }), generic.render(items));
+        }
+    }
+
+    // Fixed entries a native overwrites
+    compiled = compile("@{set()}\n@{mode}\n@if(mode == 5)\nfive\n@end\n");
+    auto set = prism::make_native(set_mode);
+    prism::Renderer specialized(prism::specialize(compiled, { { "mode", 1 } }));
+    CHECK_EQ(specialized.render({ { "mode", 1 }, { "set", set } }), "5\nfive\n");
+    CHECK_EQ(specialized.render({ { "mode", 1 }, { "set", set } }),
+             prism::Renderer(compiled).render({ { "mode", 1 }, { "set", set } }));
+}
+
+TEST(specialize_folds_fixed_entries) {
+    auto compiled = compile("@if(mode == 1)\none\n@else\nother @{a}\n@end\n@{mode + 1}\n");
+    auto specialized = prism::specialize(compiled, { { "mode", 1 } });
+    CHECK(specialized->hash != compiled->hash);
+    // Nothing is left that reads `mode` or anything else
+    CHECK_EQ(prism::Renderer(specialized).render({}), "one\n2\n");
+}
+
+TEST(specialize_keeps_assigned_entries) {
+    auto compiled = compile("@{mode = mode + 1}\n@if(mode == 2)\ntwo\n@else\nother\n@end\n");
+    prism::Renderer specialized(prism::specialize(compiled, { { "mode", 1 } }));
+    CHECK_EQ(specialized.render({ { "mode", 1 } }), "two\n");
+}
@@ -0,0 +1,211 @@
+#include "test.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+#include "prism/native.h"
+#include "prism/processor.h"
+#include "prism/render.h"
+#include "prism/store.h"
+#include "prism/utils/mapped_file.h"
+
+namespace {
+std::unordered_map<std::string, std::string> files;
+
+std::optional<std::string> load_file(const std::string& path) {
+    auto file = files.find(path);
+    if (file == files.end()) {
+        return std::nullopt;
+    }
+    return file->second;
+}
+
+std::string suffix(const std::string& name) {
+    return name;
+}
+
+// A store in a directory of its own, removed with it
+struct TemporaryStore {
+    std::filesystem::path directory;
+    std::shared_ptr<prism::TemplateStore> store;
+
+    explicit TemporaryStore(const char* name)
+        : directory(std::filesystem::temp_directory_path() / ("prism_test_" + std::string(name))),
+          store(std::make_shared<prism::TemplateStore>(directory.string())) {
+        std::filesystem::remove_all(directory);
+    }
+    ~TemporaryStore() {
+        std::error_code error;
+        std::filesystem::remove_all(directory, error);
+    }
+    size_t files() const {
+        size_t count = 0;
+        for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+            count += entry.path().extension() == ".prismc";
+        }
+        return count;
+    }
+};
+
+std::shared_ptr<const prism::CompiledTemplate> load(const TemporaryStore& store, const std::string& input,
+                                                    const prism::ContextItems& items = {}) {
+    prism::Processor processor;
+    processor.bind_include_loader(load_file);
+    processor.bind_template_store(store.store);
+    processor.populate(items);
+    processor.load(input);
+    return processor.compiled();
+}
+
+const std::string TEMPLATE = "@prism(type='fragment')\n"
+                             "@setting(var='gain', name='Gain', type='float', default='0.5')\n"
+                             "@for(i in 0..n)\n"
+                             "@if(i == 1)\none\n@else\n@{i + 1}\n@end\n"
+                             "@end\n"
+                             "@include(\"part.fs\")\n";
+} // namespace
+
+TEST(store_round_trip) {
+    files = { { "part.fs", "@prism(type='fragment')\npart @{n}\n" } };
+    TemporaryStore store("round_trip");
+    auto compiled = load(store, TEMPLATE);
+    CHECK(compiled->mapping == nullptr);
+    CHECK_EQ(store.files(), 1u);
+    auto stored = load(store, TEMPLATE);
+    CHECK(stored->mapping != nullptr);
+    CHECK_EQ(stored->hash, compiled->hash);
+
+    prism::Renderer fresh(compiled);
+    prism::Renderer mapped(stored);
+    for (int n = 0; n < 4; n++) {
+        CHECK_EQ(mapped.render({ { "n", n } }), fresh.render({ { "n", n } }));
+    }
+}
+
+TEST(store_sees_include_edits) {
+    files = { { "part.fs", "@prism(type='fragment')\nold\n" } };
+    TemporaryStore store("include_edits");
+    load(store, TEMPLATE);
+    files["part.fs"] = "@prism(type='fragment')\nnew\n";
+    auto edited = load(store, TEMPLATE);
+    CHECK(edited->mapping == nullptr);
+    CHECK_EQ(prism::Renderer(edited).render({ { "n", 0 } }), "new\n");
+    // Stored again with the new contents
+    auto stored = load(store, TEMPLATE);
+    CHECK(stored->mapping != nullptr);
+    CHECK_EQ(prism::Renderer(stored).render({ { "n", 0 } }), "new\n");
+}
+
+TEST(store_checks_computed_include_paths) {
+    files = { { "a.fs", "@prism(type='fragment')\nfrom a\n" }, { "b.fs", "@prism(type='fragment')\nfrom b\n" } };
+    TemporaryStore store("include_paths");
+    const std::string input = "@prism(type='fragment')\n@include(dir + \".fs\")\n";
+    auto a = load(store, input, { { "dir", "a" } });
+    CHECK_EQ(prism::Renderer(a).render({ { "dir", "a" } }), "from a\n");
+    auto b = load(store, input, { { "dir", "b" } });
+    CHECK(b->mapping == nullptr);
+    CHECK_EQ(prism::Renderer(b).render({ { "dir", "b" } }), "from b\n");
+    auto stored = load(store, input, { { "dir", "b" } });
+    CHECK(stored->mapping != nullptr);
+    CHECK_EQ(prism::Renderer(stored).render({ { "dir", "b" } }), "from b\n");
+    CHECK_THROWS(prism::Renderer(stored).render({ { "dir", "a" } }));
+}
+
+TEST(store_skips_native_include_paths) {
+    files = { { "a.fs", "@prism(type='fragment')\nfrom a\n" } };
+    TemporaryStore store("native_paths");
+    auto compiled = load(store, "@prism(type='fragment')\n@include(suffix(\"a.fs\"))\n",
+                         { { "suffix", prism::make_native(suffix) } });
+    CHECK(!compiled->storable);
+    CHECK_EQ(prism::Renderer(compiled).render({}), "from a\n");
+    CHECK(!std::filesystem::exists(store.directory) || store.files() == 0);
+}
+
+TEST(store_rejects_damaged_files) {
+    files = { { "part.fs", "@prism(type='fragment')\npart\n" } };
+    TemporaryStore store("damaged");
+    auto compiled = load(store, TEMPLATE);
+    auto sourceHash = 42;
+    auto contents = prism::store::write(*compiled, sourceHash);
+    auto path = store.directory / "damaged.prismc";
+    auto read = [&path, &sourceHash](const std::string& data) {
+        {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out.write(data.data(), (std::streamsize) data.size());
+        }
+        return prism::store::read(prism::MappedFile::open(path.string()), sourceHash);
+    };
+    CHECK(read(contents) != nullptr);
+    CHECK(read(contents.substr(0, contents.size() / 2)) == nullptr);
+    auto flipped = contents;
+    flipped[flipped.size() - 3] ^= 0x40;
+    CHECK(read(flipped) == nullptr);
+    sourceHash = 43;
+    CHECK(read(contents) == nullptr);
+}
+
+namespace {
+// The program of the template's first @{...}, edited in place to stand in for a damaged file
+prism::bytecode::Program& first_program(const prism::CompiledTemplate& compiled) {
+    auto& root = std::get<prism::RootNode>(compiled.root->node);
+    for (auto& child : *root.children) {
+        if (auto var = std::get_if<prism::VariableNode>(&child->node)) {
+            return const_cast<prism::bytecode::Program&>(var->program);
+        }
+    }
+    throw std::runtime_error("no @{...} in template");
+}
+
+bool reads_back(const prism::CompiledTemplate& compiled, const TemporaryStore& store) {
+    std::filesystem::create_directories(store.directory);
+    auto path = store.directory / "program.prismc";
+    {
+        auto contents = prism::store::write(compiled, 7);
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(contents.data(), (std::streamsize) contents.size());
+    }
+    return prism::store::read(prism::MappedFile::open(path.string()), 7) != nullptr;
+}
+} // namespace
+
+TEST(store_rejects_damaged_programs) {
+    files.clear();
+    TemporaryStore store("programs");
+    prism::Processor processor;
+    processor.load("@prism(type='fragment')\n@{v[0] + w}\n");
+    auto compiled = processor.compiled();
+    auto& program = first_program(*compiled);
+    CHECK(reads_back(*compiled, store));
+
+    auto index = std::find_if(program.code.begin(), program.code.end(),
+                              [](const auto& ins) { return ins.op == prism::bytecode::OpCode::Index; });
+    CHECK(index != program.code.end());
+    // More indices than the evaluator has room for
+    index->count = 5;
+    CHECK(!reads_back(*compiled, store));
+    // Pops more values than were pushed
+    index->count = 2;
+    CHECK(!reads_back(*compiled, store));
+    index->count = 1;
+    // Leaves two values
+    auto add = program.code.back();
+    program.code.pop_back();
+    CHECK(!reads_back(*compiled, store));
+    // Jumps backwards
+    program.code.push_back({ prism::bytecode::OpCode::Jump, 0, 0 });
+    CHECK(!reads_back(*compiled, store));
+    program.code.back() = add;
+    CHECK(reads_back(*compiled, store));
+}
+
+TEST(store_leaves_no_temporary_files) {
+    files = { { "part.fs", "@prism(type='fragment')\npart\n" } };
+    TemporaryStore store("temporary");
+    load(store, TEMPLATE);
+    load(store, "@prism(type='fragment')\nother\n");
+    for (const auto& entry : std::filesystem::directory_iterator(store.directory)) {
+        CHECK_EQ(entry.path().extension().string(), std::string(".prismc"));
+    }
+    CHECK_EQ(store.files(), 2u);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <stdexcept>
+
+namespace prism::test {
+struct Case {
+    const char* name;
+    void (*run)();
+};
+
+std::vector<Case>& cases();
+
+struct Register {
+    Register(const char* name, void (*run)()) {
+        cases().push_back({ name, run });
+    }
+};
+
+struct Failure : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+template <typename A, typename B>
+void check_eq(const A& actual, const B& expected, const char* expression, const char* file, int line) {
+    if (actual == expected) {
+        return;
+    }
+    std::ostringstream message;
+    message << file << ":" << line << ": " << expression << "\n  actual:   " << actual << "\n  expected: " << expected;
+    throw Failure(message.str());
+}
+} // namespace prism::test
+
+#define TEST(name)                                                                  \
+    static void test_##name();                                                      \
+    static prism::test::Register register_##name(#name, test_##name);               \
+    static void test_##name()
+
+#define CHECK(condition)                                                                                \
+    do {                                                                                                \
+        if (!(condition)) {                                                                             \
+            throw prism::test::Failure(std::string(__FILE__) + ":" + std::to_string(__LINE__) + ": " + \
+                                       #condition);                                                     \
+        }                                                                                               \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) prism::test::check_eq((actual), (expected), #actual, __FILE__, __LINE__)
+
+#define CHECK_THROWS(expression)                                                                        \
+    do {                                                                                                \
+        bool thrown = false;                                                                            \
+        try {                                                                                           \
+            expression;                                                                                 \
+        } catch (const std::exception&) {                                                               \
+            thrown = true;                                                                              \
+        }                                                                                               \
+        if (!thrown) {                                                                                  \
+            throw prism::test::Failure(std::string(__FILE__) + ":" + std::to_string(__LINE__) + ": " + \
+                                       #expression + " did not throw");                                 \
+        }                                                                                               \
+    } while (0)
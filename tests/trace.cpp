@@ -0,0 +1,60 @@
+#include "test.h"
+
+#include <thread>
+#include "prism/utils/trace.h"
+
+namespace {
+size_t count(const std::string& text, const std::string& piece) {
+    size_t result = 0;
+    for (auto at = text.find(piece); at != std::string::npos; at = text.find(piece, at + 1)) {
+        result++;
+    }
+    return result;
+}
+} // namespace
+
+TEST(trace_exports_chrome_json) {
+    prism::trace::start();
+    prism::trace::name_thread("main \"thread\"");
+    {
+        prism::trace::Scope outer("outer", "test");
+        prism::trace::Scope inner("inner", "test", "a\tdetail");
+    }
+    prism::trace::stop();
+    auto json = prism::trace::to_chrome_json();
+    CHECK(json.starts_with("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n  {"));
+    CHECK(json.ends_with("}\n]}\n"));
+    CHECK(json.find("\"name\": \"thread_name\", \"args\": {\"name\": \"main \\\"thread\\\"\"}}") != std::string::npos);
+    CHECK(json.find("{\"ph\": \"X\", \"name\": \"outer\", \"cat\": \"test\", \"ts\": ") != std::string::npos);
+    CHECK(json.find("\"args\": {\"detail\": \"a\\u0009detail\"}}") != std::string::npos);
+    CHECK_EQ(count(json, "\"ph\": \"X\""), 2u);
+}
+
+TEST(trace_records_between_start_and_stop) {
+    prism::trace::start();
+    prism::trace::stop();
+    {
+        prism::trace::Scope ignored("ignored", "test");
+    }
+    // Restarting drops the previous trace
+    prism::trace::start();
+    std::thread worker([] {
+        prism::trace::name_thread("worker");
+        prism::trace::Scope scope("on_worker", "test");
+    });
+    worker.join();
+    {
+        prism::trace::Scope scope("on_main", "test");
+    }
+    prism::trace::stop();
+    auto json = prism::trace::to_chrome_json();
+    CHECK(json.find("ignored") == std::string::npos);
+    CHECK(json.find("\"outer\"") == std::string::npos);
+    CHECK_EQ(count(json, "\"ph\": \"X\""), 2u);
+    // The worker's buffer outlives it
+    CHECK(json.find("\"on_worker\"") != std::string::npos);
+    CHECK(json.find("{\"name\": \"worker\"}") != std::string::npos);
+    prism::trace::start();
+    prism::trace::stop();
+    CHECK_EQ(count(prism::trace::to_chrome_json(), "\"ph\": \"X\""), 0u);
+}
@@ -0,0 +1,65 @@
+#include "test.h"
+
+#include "prism/native.h"
+#include "prism/processor.h"
+
+namespace {
+int calls = 0;
+
+int count(int value) {
+    calls++;
+    return value;
+}
+
+std::string render(const std::string& body, const prism::ContextItems& items) {
+    prism::Processor processor;
+    processor.load("@prism(type='fragment')\n" + body);
+    return processor.render(items);
+}
+
+const std::string BRANCHES = "@if(a == 1 && b == 2)\nboth\n@end\n"
+                             "@if(a == 1 || b == 2)\neither\n@end\n"
+                             "@for(i in 0..n)\n@if(i == a)\nat @{i}\n@else\n@{i + b}\n@end\n@end\n"
+                             "@if(mode == 0)\nzero\n@elseif(mode == 1)\none @{a}\n@elseif(mode == 2)\ntwo\n"
+                             "@else\nother\n@end\n";
+} // namespace
+
+TEST(vm_branches) {
+    CHECK_EQ(render(BRANCHES, { { "mode", 1 }, { "a", 1 }, { "b", 2 }, { "n", 2 } }),
+             "both\neither\n2\nat 1\none 1\n");
+    CHECK_EQ(render(BRANCHES, { { "mode", 3 }, { "a", 0 }, { "b", 1 }, { "n", 0 } }), "other\n");
+    CHECK_EQ(render(BRANCHES, { { "mode", 2 }, { "a", 2 }, { "b", 2 }, { "n", 1 } }), "either\n2\ntwo\n");
+}
+
+TEST(vm_arithmetic) {
+    prism::ContextItems items{ { "a", 7 }, { "b", 3 }, { "f", 0.5f } };
+    CHECK_EQ(render("@{a + b}\n@{a - b}\n@{a * b}\n@{a / b}\n@{f * 3.0}\n", items), "10\n4\n21\n2\n1.5\n");
+    CHECK_EQ(render("@{x = a + 1}\n@{x * 2}\n", items), "16\n");
+}
+
+TEST(vm_reports_bad_operands) {
+    CHECK_THROWS(render("@{a * b}\n", { { "a", 1 } }));
+    CHECK_THROWS(render("@{a * b}\n", { { "a", 1 }, { "b", "text" } }));
+}
+
+TEST(vm_taken_elseif_continues_block) {
+    CHECK_EQ(render("@if(a == 0)\nzero\n@elseif(a == 1)\none\n@else\nother\n@end\nafter\n", { { "a", 1 } }),
+             "one\nafter\n");
+}
+
+TEST(vm_assigned_array_keeps_its_values) {
+    int first[3] = { 1, 2, 3 };
+    int second[3] = { 7, 8, 9 };
+    prism::ContextItems items{ { "a", M_ARRAY(first, int, 3) }, { "c", M_ARRAY(second, int, 3) } };
+    CHECK_EQ(render("@{b = a}\n@{a = c}\n@{b[1]} @{a[1]}\n", items), "2 8\n");
+}
+
+TEST(vm_short_circuits) {
+    const std::string body = "@if(a == 1 || count(1) == 1)\nyes\n@end\n@if(a == 0 && count(1) == 1)\nno\n@end\n";
+    auto native = prism::make_native(count);
+    calls = 0;
+    CHECK_EQ(render(body, { { "a", 1 }, { "count", native } }), "yes\n");
+    CHECK_EQ(calls, 0);
+    CHECK_EQ(render(body, { { "a", 0 }, { "count", native } }), "yes\nno\n");
+    CHECK_EQ(calls, 2);
+}